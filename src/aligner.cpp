@@ -0,0 +1,280 @@
+/*!
+ * @file aligner.cpp
+ *
+ * @brief Aligner class source file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include "aligner.hpp"
+
+#include "edlib.h"
+
+namespace racon {
+
+// smallest band of kEdlibBanded (the one edlib starts from if it is not given)
+constexpr uint32_t kMinBand = 64;
+
+// overlaps longer than this are split at exact k-mer anchors by
+// kEdlibAnchored, the k-mer is searched for within a fraction of the segment
+// length around its expected query position
+constexpr uint32_t kSegmentLength = 16384;
+constexpr uint32_t kAnchorLength = 19;
+constexpr double kAnchorSearchRate = 0.1;
+constexpr uint32_t kAnchorNumTrials = 16;
+constexpr uint32_t kAnchorTrialStep = 64;
+
+// diagonals of alignOverlap around those between the beginning of both
+// sequences and the end of both
+constexpr int64_t kOverlapBand = 64;
+
+bool edlibAlignGlobal(const char* q, uint32_t q_length, const char* t,
+    uint32_t t_length, int32_t k, std::vector<uint8_t>& ops) {
+
+    EdlibAlignResult result = edlibAlign(q, q_length, t, t_length,
+        edlibNewAlignConfig(k, EDLIB_MODE_NW, EDLIB_TASK_PATH, nullptr, 0));
+
+    bool is_aligned = result.status == EDLIB_STATUS_OK && result.editDistance >= 0;
+    if (is_aligned) {
+        ops.assign(result.alignment, result.alignment + result.alignmentLength);
+    }
+
+    edlibFreeAlignResult(result);
+
+    return is_aligned;
+}
+
+class EdlibAligner: public Aligner {
+public:
+    ~EdlibAligner() = default;
+
+    bool align(const char* q, uint32_t q_length, const char* t,
+        uint32_t t_length, double, std::vector<uint8_t>& ops) const override {
+        return edlibAlignGlobal(q, q_length, t, t_length, -1, ops);
+    }
+};
+
+class BandedEdlibAligner: public Aligner {
+public:
+    ~BandedEdlibAligner() = default;
+
+    bool align(const char* q, uint32_t q_length, const char* t,
+        uint32_t t_length, double error, std::vector<uint8_t>& ops) const override {
+
+        // edlib widens the band from 64 until the alignment fits, starting
+        // from the estimated edit distance (never below the length
+        // difference) skips most of the repeated passes, the band is doubled
+        // as edlib would until it covers the longer sequence
+        uint32_t length = std::max(q_length, t_length);
+        uint32_t k = std::max(std::max(kMinBand, length - std::min(q_length,
+            t_length)), static_cast<uint32_t>(std::max(error, 0.) * length));
+
+        while (!edlibAlignGlobal(q, q_length, t, t_length, k, ops)) {
+            if (k >= length) {
+                return false;
+            }
+            k = std::min(2 * static_cast<uint64_t>(k), static_cast<uint64_t>(length));
+        }
+        return true;
+    }
+};
+
+class AnchoredAligner: public Aligner {
+public:
+    AnchoredAligner()
+            : Aligner(), segment_aligner_(new BandedEdlibAligner()) {
+    }
+
+    ~AnchoredAligner() = default;
+
+    bool align(const char* q, uint32_t q_length, const char* t,
+        uint32_t t_length, double error, std::vector<uint8_t>& ops) const override {
+
+        // pairs of query and target positions where segments are cut
+        std::vector<std::pair<uint32_t, uint32_t>> anchors = {{0, 0}};
+        for (uint32_t t_cut = kSegmentLength; t_cut + kSegmentLength < t_length;
+            t_cut += kSegmentLength) {
+
+            const auto& prev = anchors.back();
+            if (t_cut <= prev.second + kSegmentLength / 2) {
+                continue;
+            }
+            uint32_t q_begin, t_begin;
+            if (find_anchor(q, q_length, t, t_length, prev, t_cut, q_begin,
+                t_begin)) {
+                anchors.emplace_back(q_begin, t_begin);
+            }
+        }
+        anchors.emplace_back(q_length, t_length);
+
+        // segments are aligned one after another to bound memory usage
+        ops.clear();
+        std::vector<uint8_t> segment_ops;
+        for (uint32_t i = 0; i + 1 < anchors.size(); ++i) {
+            if (!segment_aligner_->align(q + anchors[i].first,
+                anchors[i + 1].first - anchors[i].first, t + anchors[i].second,
+                anchors[i + 1].second - anchors[i].second, error, segment_ops)) {
+                return false;
+            }
+            ops.insert(ops.end(), segment_ops.begin(), segment_ops.end());
+        }
+
+        return true;
+    }
+
+private:
+    // looks for a k-mer of t at (or shortly after) t_cut which occurs exactly
+    // once in q around the position expected from the previous anchor
+    bool find_anchor(const char* q, uint32_t q_length, const char* t,
+        uint32_t t_length, const std::pair<uint32_t, uint32_t>& prev,
+        uint32_t t_cut, uint32_t& q_begin, uint32_t& t_begin) const {
+
+        double slope = (q_length - prev.first) /
+            static_cast<double>(t_length - prev.second);
+        uint32_t radius = kAnchorSearchRate * kSegmentLength;
+
+        for (uint32_t i = 0; i < kAnchorNumTrials; ++i) {
+            t_begin = t_cut + i * kAnchorTrialStep;
+            if (t_begin + kAnchorLength > t_length) {
+                break;
+            }
+
+            int64_t expected = prev.first + slope * (t_begin - prev.second);
+            int64_t begin = std::max(static_cast<int64_t>(prev.first) + 1,
+                expected - radius);
+            int64_t end = std::min(static_cast<int64_t>(q_length) - kAnchorLength,
+                expected + radius);
+
+            uint32_t num_hits = 0;
+            for (int64_t j = begin; j <= end && num_hits < 2; ++j) {
+                if (memcmp(q + j, t + t_begin, kAnchorLength) == 0) {
+                    q_begin = j;
+                    ++num_hits;
+                }
+            }
+            if (num_hits == 1) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    std::unique_ptr<Aligner> segment_aligner_;
+};
+
+void alignOverlap(const char* l, uint32_t l_length, const char* r,
+    uint32_t r_length, std::string& row_l, std::string& row_r,
+    std::vector<int32_t>& matrix) {
+
+    constexpr int32_t kMatch = 3, kMismatch = -5, kGap = -6;
+    constexpr int32_t kMinScore = std::numeric_limits<int32_t>::min() / 2;
+
+    // cell (i, j) lies on diagonal j - i, rows store only those of the band
+    int64_t shift = static_cast<int64_t>(r_length) - l_length;
+    int64_t min_diagonal = std::min<int64_t>(0, shift) - kOverlapBand;
+    int64_t max_diagonal = std::max<int64_t>(0, shift) + kOverlapBand;
+    uint64_t num_columns = max_diagonal - min_diagonal + 1;
+    matrix.assign((l_length + 1) * num_columns, kMinScore);
+    auto is_banded = [&](int64_t i, int64_t j) -> bool {
+        return j >= 0 && j <= r_length && j - i >= min_diagonal &&
+            j - i <= max_diagonal;
+    };
+    auto score = [&](int64_t i, int64_t j) -> int32_t& {
+        return matrix[i * num_columns + (j - i - min_diagonal)];
+    };
+    auto banded_score = [&](int64_t i, int64_t j) -> int32_t {
+        return is_banded(i, j) ? score(i, j) : kMinScore;
+    };
+
+    for (int64_t i = 0; i <= l_length; ++i) {
+        if (is_banded(i, 0)) {
+            score(i, 0) = 0;
+        }
+    }
+    for (int64_t j = 0; j <= r_length; ++j) {
+        if (is_banded(0, j)) {
+            score(0, j) = 0;
+        }
+    }
+    for (int64_t i = 1; i <= l_length; ++i) {
+        int64_t end = std::min<int64_t>(r_length, i + max_diagonal);
+        for (int64_t j = std::max<int64_t>(1, i + min_diagonal); j <= end; ++j) {
+            score(i, j) = std::max({
+                banded_score(i - 1, j - 1) + (l[i - 1] == r[j - 1] ? kMatch : kMismatch),
+                banded_score(i - 1, j) + kGap,
+                banded_score(i, j - 1) + kGap});
+        }
+    }
+
+    uint32_t max_i = l_length, max_j = r_length;
+    for (uint32_t i = 0; i <= l_length; ++i) {
+        if (banded_score(i, r_length) > score(max_i, max_j)) {
+            max_i = i;
+            max_j = r_length;
+        }
+    }
+    for (uint32_t j = 0; j <= r_length; ++j) {
+        if (banded_score(l_length, j) > score(max_i, max_j)) {
+            max_i = l_length;
+            max_j = j;
+        }
+    }
+
+    // rows are built backwards
+    row_l.assign(l + max_i, l_length - max_i);
+    row_l.append(r_length - max_j, '-');
+    row_r.assign(l_length - max_i, '-');
+    row_r.append(r + max_j, r_length - max_j);
+    std::reverse(row_l.begin(), row_l.end());
+    std::reverse(row_r.begin(), row_r.end());
+
+    uint32_t i = max_i, j = max_j;
+    while (i > 0 && j > 0) {
+        if (score(i, j) == banded_score(i - 1, j - 1) +
+            (l[i - 1] == r[j - 1] ? kMatch : kMismatch)) {
+            row_l += l[--i];
+            row_r += r[--j];
+        } else if (score(i, j) == banded_score(i - 1, j) + kGap) {
+            row_l += l[--i];
+            row_r += '-';
+        } else {
+            row_l += '-';
+            row_r += r[--j];
+        }
+    }
+    for (; i > 0; --i) {
+        row_l += l[i - 1];
+        row_r += '-';
+    }
+    for (; j > 0; --j) {
+        row_l += '-';
+        row_r += r[j - 1];
+    }
+
+    std::reverse(row_l.begin(), row_l.end());
+    std::reverse(row_r.begin(), row_r.end());
+}
+
+std::unique_ptr<Aligner> createAligner(AlignerType type) {
+
+    switch (type) {
+        case AlignerType::kEdlib:
+            return std::unique_ptr<Aligner>(new EdlibAligner());
+        case AlignerType::kEdlibBanded:
+            return std::unique_ptr<Aligner>(new BandedEdlibAligner());
+        case AlignerType::kEdlibAnchored:
+            return std::unique_ptr<Aligner>(new AnchoredAligner());
+        default:
+            fprintf(stderr, "[racon::createAligner] error: "
+                "invalid aligner type!\n");
+            exit(1);
+    }
+}
+
+}
@@ -0,0 +1,56 @@
+/*!
+ * @file aligner.hpp
+ *
+ * @brief Aligner class header file
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace racon {
+
+enum class AlignerType {
+    kEdlib, // global alignment with edlib
+    kEdlibBanded, // global alignment with edlib in a band from the overlap error
+    kEdlibAnchored // kEdlibBanded on segments split at exact k-mer anchors
+};
+
+class Aligner;
+std::unique_ptr<Aligner> createAligner(AlignerType type);
+
+// overlap alignment (end gaps are free) of l and r with linear gap penalties
+// in a band around the diagonal from the beginning of both to the end of both,
+// aligned rows are written to row_l and row_r in which '-' denotes a gap,
+// matrix is the reusable score matrix
+void alignOverlap(const char* l, uint32_t l_length, const char* r,
+    uint32_t r_length, std::string& row_l, std::string& row_r,
+    std::vector<int32_t>& matrix);
+
+/*!
+ * @brief Pairwise aligner used for overlaps without alignments, shared
+ * between threads
+ */
+class Aligner {
+public:
+    virtual ~Aligner() = default;
+
+    /*!
+     * @brief Fills ops with the global alignment of q to t encoded as in
+     * edlib (0 - match, 1 - insertion, 2 - deletion, 3 - mismatch), returns
+     * false on failure, error is the estimated edit distance per base (see
+     * Overlap::error()) which banded aligners start from
+     */
+    virtual bool align(const char* q, uint32_t q_length, const char* t,
+        uint32_t t_length, double error, std::vector<uint8_t>& ops) const = 0;
+
+protected:
+    Aligner() = default;
+    Aligner(const Aligner&) = delete;
+    const Aligner& operator=(const Aligner&) = delete;
+};
+
+}
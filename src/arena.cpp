@@ -0,0 +1,110 @@
+/*!
+ * @file arena.cpp
+ *
+ * @brief Arena class source file
+ */
+
+#include <new>
+#include <thread>
+#include <algorithm>
+
+#include "arena.hpp"
+
+namespace racon {
+
+constexpr std::size_t kArenaAlignment = alignof(std::max_align_t);
+
+// threads are numbered in order of their first use of any arena
+uint32_t threadIndex() {
+    static std::atomic<uint32_t> num_threads(0);
+    static thread_local uint32_t index = num_threads++;
+    return index;
+}
+
+Arena::Arena(std::size_t object_size, std::size_t chunk_length)
+        : object_size_(((std::max(object_size, sizeof(void*)) +
+        kArenaAlignment - 1) / kArenaAlignment) * kArenaAlignment),
+        chunk_length_(chunk_length), shards_(), num_objects_(0) {
+
+    uint32_t num_shards = std::max(1U, std::thread::hardware_concurrency());
+    for (uint32_t i = 0; i < num_shards; ++i) {
+        shards_.emplace_back(new Shard());
+        shards_.back()->chunk_offset = chunk_length_;
+        shards_.back()->free_list = nullptr;
+    }
+}
+
+Arena::Shard& Arena::shard() {
+    return *shards_[threadIndex() % shards_.size()];
+}
+
+std::size_t Arena::num_chunks() const {
+
+    std::size_t num_chunks = 0;
+    for (const auto& it: shards_) {
+        std::lock_guard<std::mutex> lock(it->mutex);
+        num_chunks += it->chunks.size();
+    }
+    return num_chunks;
+}
+
+void* Arena::allocate() {
+
+    auto& shard = this->shard();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // counted under the lock so that release() can not free the chunk
+    ++num_objects_;
+
+    if (shard.free_list != nullptr) {
+        void* ptr = shard.free_list;
+        shard.free_list = *static_cast<void**>(ptr);
+        return ptr;
+    }
+
+    if (shard.chunk_offset == chunk_length_) {
+        shard.chunks.emplace_back(new char[object_size_ * chunk_length_]);
+        shard.chunk_offset = 0;
+    }
+
+    return shard.chunks.back().get() + object_size_ * shard.chunk_offset++;
+}
+
+void Arena::deallocate(void* ptr) {
+
+    if (ptr == nullptr) {
+        return;
+    }
+
+    // objects freed by other threads than the allocating one are reused by
+    // the freeing thread
+    {
+        auto& shard = this->shard();
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        *static_cast<void**>(ptr) = shard.free_list;
+        shard.free_list = ptr;
+    }
+
+    if (--num_objects_ == 0) {
+        release();
+    }
+}
+
+void Arena::release() {
+
+    std::vector<std::unique_lock<std::mutex>> locks;
+    for (auto& it: shards_) {
+        locks.emplace_back(it->mutex);
+    }
+    if (num_objects_ != 0) {
+        return;
+    }
+
+    for (auto& it: shards_) {
+        std::vector<std::unique_ptr<char[]>>().swap(it->chunks);
+        it->chunk_offset = chunk_length_;
+        it->free_list = nullptr;
+    }
+}
+
+}
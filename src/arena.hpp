@@ -0,0 +1,60 @@
+/*!
+ * @file arena.hpp
+ *
+ * @brief Arena class header file
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <mutex>
+
+namespace racon {
+
+/*!
+ * @brief Thread safe allocator of fixed size objects which are carved out of
+ * large chunks. Each thread allocates from and frees into its own shard
+ * (chunks and a free list behind a mutex which other threads rarely take),
+ * freed objects are reused and all chunks are released at once when the
+ * last object is freed.
+ */
+class Arena {
+public:
+    Arena(std::size_t object_size, std::size_t chunk_length);
+    ~Arena() = default;
+
+    void* allocate();
+    void deallocate(void* ptr);
+
+    uint64_t num_objects() const {
+        return num_objects_;
+    }
+
+    std::size_t num_chunks() const;
+
+private:
+    Arena(const Arena&) = delete;
+    const Arena& operator=(const Arena&) = delete;
+
+    struct Shard {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<char[]>> chunks;
+        std::size_t chunk_offset;
+        void* free_list;
+    };
+
+    Shard& shard();
+    // releases all chunks unless objects were allocated in the meantime
+    void release();
+
+    std::size_t object_size_;
+    std::size_t chunk_length_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<uint64_t> num_objects_;
+};
+
+}
@@ -0,0 +1,125 @@
+/*!
+ * @file breaking_points.cpp
+ *
+ * @brief BreakingPoints class source file
+ */
+
+#include <new>
+
+#include "arena.hpp"
+#include "breaking_points.hpp"
+
+namespace racon {
+
+constexpr uint32_t kBlockLength = 14;
+
+constexpr uint32_t kEscapeWord = 0xFFFFFFFF;
+constexpr int64_t kMaxDelta = 32767;
+
+// deltas in [-kMaxDelta, kMaxDelta] are coded below 0xFFFF so that no coded
+// pair equals the marker
+uint32_t zigZagEncode(int64_t delta) {
+    return delta < 0 ? -2 * delta - 1 : 2 * delta;
+}
+
+int64_t zigZagDecode(uint32_t code) {
+    return code & 1 ? -static_cast<int64_t>(code >> 1) - 1 : code >> 1;
+}
+
+// a cache line on common hardware
+struct BreakingPoints::Block {
+    Block* next;
+    uint32_t words[kBlockLength];
+};
+
+Arena& BreakingPoints::block_arena() {
+    static Arena arena(sizeof(BreakingPoints::Block), 16384);
+    return arena;
+}
+
+BreakingPoints::BreakingPoints()
+        : head_(nullptr), tail_(nullptr), num_words_(0), size_(0),
+        last_t_position_(0), last_q_position_(0) {
+}
+
+BreakingPoints::~BreakingPoints() {
+    clear();
+}
+
+void BreakingPoints::push_word(uint32_t word) {
+
+    if (num_words_ % kBlockLength == 0) {
+        Block* block = static_cast<Block*>(block_arena().allocate());
+        block->next = nullptr;
+        if (tail_ == nullptr) {
+            head_ = block;
+        } else {
+            tail_->next = block;
+        }
+        tail_ = block;
+    }
+    tail_->words[num_words_ % kBlockLength] = word;
+    ++num_words_;
+}
+
+void BreakingPoints::push_back(uint32_t t_position, uint32_t q_position) {
+
+    int64_t t_delta = static_cast<int64_t>(t_position) - last_t_position_;
+    int64_t q_delta = static_cast<int64_t>(q_position) - last_q_position_;
+    if (size_ != 0 && t_delta >= -kMaxDelta && t_delta <= kMaxDelta &&
+        q_delta >= -kMaxDelta && q_delta <= kMaxDelta) {
+        push_word(zigZagEncode(t_delta) << 16 | zigZagEncode(q_delta));
+    } else {
+        push_word(kEscapeWord);
+        push_word(t_position);
+        push_word(q_position);
+    }
+
+    last_t_position_ = t_position;
+    last_q_position_ = q_position;
+    ++size_;
+}
+
+std::vector<std::pair<uint32_t, uint32_t>> BreakingPoints::decode() const {
+
+    std::vector<std::pair<uint32_t, uint32_t>> dst;
+    dst.reserve(size_);
+
+    const Block* block = head_;
+    auto next_word = [&](uint32_t i) -> uint32_t {
+        if (i != 0 && i % kBlockLength == 0) {
+            block = block->next;
+        }
+        return block->words[i % kBlockLength];
+    };
+
+    uint32_t t_position = 0, q_position = 0;
+    for (uint32_t i = 0; i < num_words_; ++i) {
+        uint32_t word = next_word(i);
+        if (word == kEscapeWord) {
+            t_position = next_word(++i);
+            q_position = next_word(++i);
+        } else {
+            t_position += zigZagDecode(word >> 16);
+            q_position += zigZagDecode(word & 0xFFFF);
+        }
+        dst.emplace_back(t_position, q_position);
+    }
+
+    return dst;
+}
+
+void BreakingPoints::clear() {
+    while (head_ != nullptr) {
+        Block* next = head_->next;
+        block_arena().deallocate(head_);
+        head_ = next;
+    }
+    tail_ = nullptr;
+    num_words_ = 0;
+    size_ = 0;
+    last_t_position_ = 0;
+    last_q_position_ = 0;
+}
+
+}
@@ -0,0 +1,66 @@
+/*!
+ * @file breaking_points.hpp
+ *
+ * @brief BreakingPoints class header file
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <utility>
+
+namespace racon {
+
+class Arena;
+
+/*!
+ * @brief Pairs of target and query positions at which an alignment enters
+ * and leaves windows (two pairs per window). Each pair is stored as one word
+ * of 16 bit zig-zag coded deltas to the previous pair, pairs whose deltas do
+ * not fit take a marker word followed by both positions. Words are appended
+ * to a list of fixed size blocks allocated from an arena shared by all
+ * breaking points.
+ */
+class BreakingPoints {
+public:
+    BreakingPoints();
+    ~BreakingPoints();
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    // number of pairs
+    uint32_t size() const {
+        return size_;
+    }
+
+    void push_back(uint32_t t_position, uint32_t q_position);
+
+    std::vector<std::pair<uint32_t, uint32_t>> decode() const;
+
+    void clear();
+
+    bool operator==(const BreakingPoints& other) const {
+        return decode() == other.decode();
+    }
+
+private:
+    BreakingPoints(const BreakingPoints&) = delete;
+    const BreakingPoints& operator=(const BreakingPoints&) = delete;
+
+    struct Block;
+    static Arena& block_arena();
+
+    void push_word(uint32_t word);
+
+    Block* head_;
+    Block* tail_;
+    uint32_t num_words_;
+    uint32_t size_;
+    uint32_t last_t_position_;
+    uint32_t last_q_position_;
+};
+
+}
@@ -51,9 +51,12 @@ CUDABatchAligner::~CUDABatchAligner()
 
 bool CUDABatchAligner::addOverlap(Overlap* overlap, std::vector<std::unique_ptr<Sequence>>& sequences)
 {
-    const char* q = !overlap->strand_ ? &(sequences[overlap->q_id_]->data()[overlap->q_begin_]) :
-        &(sequences[overlap->q_id_]->reverse_complement()[overlap->q_length_ - overlap->q_end_]);
+    // add_alignment copies the sequences so the buffer can be local
+    std::string buffer;
     int32_t q_len = overlap->q_end_ - overlap->q_begin_;
+    const char* q = sequences[overlap->q_id_]->data(overlap->strand_,
+        !overlap->strand_ ? overlap->q_begin_ : overlap->q_length_ - overlap->q_end_,
+        q_len, buffer);
     const char* t = &(sequences[overlap->t_id_]->data()[overlap->t_begin_]);
     int32_t t_len = overlap->t_end_ - overlap->t_begin_;
 
@@ -42,6 +42,13 @@ class CUDABatchAligner
             return overlaps_.size() > 0;
         };
 
+        /**
+         * @brief Number of overlaps in the batch which are aligned on GPU.
+         */
+        uint32_t numOverlaps() const {
+            return overlaps_.size();
+        }
+
         /**
          * @brief Runs batched alignment of overlaps on GPU.
          *
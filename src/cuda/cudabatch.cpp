@@ -19,21 +19,33 @@ namespace racon {
 
 std::atomic<uint32_t> CUDABatchProcessor::batches;
 
+// Longest sequence cudapoa accepts, longer ones are skipped when a window is
+// added to a batch.
+const uint32_t MAX_SEQUENCE_SIZE = 1024;
+
 std::unique_ptr<CUDABatchProcessor> createCUDABatch(uint32_t max_window_depth,
                                                     uint32_t device,
                                                     size_t avail_mem,
                                                     int8_t gap,
                                                     int8_t mismatch,
                                                     int8_t match,
-                                                    bool cuda_banded_alignment)
+                                                    bool cuda_banded_alignment,
+                                                    uint32_t num_slots)
 {
+    if (num_slots == 0)
+    {
+        fprintf(stderr, "[racon::createCUDABatch] error: invalid number of slots!\n");
+        exit(1);
+    }
+
     return std::unique_ptr<CUDABatchProcessor>(new CUDABatchProcessor(max_window_depth,
                                                                       device,
                                                                       avail_mem,
                                                                       gap,
                                                                       mismatch,
                                                                       match,
-                                                                      cuda_banded_alignment));
+                                                                      cuda_banded_alignment,
+                                                                      num_slots));
 }
 
 CUDABatchProcessor::CUDABatchProcessor(uint32_t max_window_depth,
@@ -42,34 +54,47 @@ CUDABatchProcessor::CUDABatchProcessor(uint32_t max_window_depth,
                                        int8_t gap,
                                        int8_t mismatch,
                                        int8_t match,
-                                       bool cuda_banded_alignment)
-    : windows_()
-    , seqs_added_per_window_()
+                                       bool cuda_banded_alignment,
+                                       uint32_t num_slots)
+    : slots_(num_slots)
+    , current_slot_(0)
+    , num_pending_(0)
+    , window_consensus_status_()
 {
     bid_ = CUDABatchProcessor::batches++;
-    
-    // Create new CUDA stream.
-    CGA_CU_CHECK_ERR(cudaStreamCreate(&stream_));
-
-    cudapoa_batch_ = claragenomics::cudapoa::create_batch(max_window_depth,
-                                                          device,
-                                                          stream_,
-                                                          avail_mem,
-                                                          claragenomics::cudapoa::OutputType::consensus,
-                                                          gap,
-                                                          mismatch,
-                                                          match,
-                                                          cuda_banded_alignment);
+
+    for(auto& slot : slots_)
+    {
+        // Create new CUDA stream.
+        CGA_CU_CHECK_ERR(cudaStreamCreate(&slot.stream));
+
+        slot.cudapoa_batch = claragenomics::cudapoa::create_batch(max_window_depth,
+                                                                  device,
+                                                                  slot.stream,
+                                                                  avail_mem / num_slots,
+                                                                  claragenomics::cudapoa::OutputType::consensus,
+                                                                  gap,
+                                                                  mismatch,
+                                                                  match,
+                                                                  cuda_banded_alignment);
+    }
 }
 
 CUDABatchProcessor::~CUDABatchProcessor()
 {
-    // Destroy CUDA stream.
-    CGA_CU_CHECK_ERR(cudaStreamDestroy(stream_));
+    for(auto& slot : slots_)
+    {
+        // Batch has to be released before its stream.
+        slot.cudapoa_batch.reset();
+
+        // Destroy CUDA stream.
+        CGA_CU_CHECK_ERR(cudaStreamDestroy(slot.stream));
+    }
 }
 
 bool CUDABatchProcessor::addWindow(std::shared_ptr<Window> window)
 {
+    Slot& slot = slots_[current_slot_];
     claragenomics::cudapoa::Group poa_group;
     uint32_t num_seqs = window->sequences_.size();
     std::vector<std::vector<int8_t>> all_read_weights(num_seqs, std::vector<int8_t>());
@@ -98,6 +123,9 @@ bool CUDABatchProcessor::addWindow(std::shared_ptr<Window> window)
             return window->positions_[lhs].first < window->positions_[rhs].first; });
 
     // Start from index 1 since first sequence has already been added as backbone.
+    // Layers of packed sequences are decoded into buffers which are kept
+    // until the group is added.
+    std::vector<std::string> data_buffers(num_seqs), quality_buffers(num_seqs);
     uint32_t long_seq = 0;
     uint32_t skipped_seq = 0;
     for(uint32_t j = 1; j < num_seqs; j++)
@@ -105,10 +133,11 @@ bool CUDABatchProcessor::addWindow(std::shared_ptr<Window> window)
         uint32_t i = rank.at(j);
         seq = window->sequences_.at(i);
         qualities = window->qualities_.at(i);
-        convertPhredQualityToWeights(qualities.first, qualities.second, all_read_weights[i]);
+        auto layer = window->layer(i, data_buffers[i], quality_buffers[i]);
+        convertPhredQualityToWeights(layer.second, qualities.second, all_read_weights[i]);
 
         claragenomics::cudapoa::Entry p = {
-            seq.first,
+            layer.first,
             all_read_weights[i].data(),
             static_cast<int32_t>(seq.second)
         };
@@ -117,7 +146,7 @@ bool CUDABatchProcessor::addWindow(std::shared_ptr<Window> window)
 
     // Add group to CUDAPOA batch object.
     std::vector<claragenomics::cudapoa::StatusType> entry_status;
-    claragenomics::cudapoa::StatusType status = cudapoa_batch_->add_poa_group(entry_status,
+    claragenomics::cudapoa::StatusType status = slot.cudapoa_batch->add_poa_group(entry_status,
                                                                               poa_group);
 
     // If group was added, then push window in accepted windows list.
@@ -127,7 +156,7 @@ bool CUDABatchProcessor::addWindow(std::shared_ptr<Window> window)
     }
     else
     {
-        windows_.push_back(window);
+        slot.windows.push_back(window);
     }
 
     // Keep track of how many sequences were actually processed for this
@@ -148,12 +177,12 @@ bool CUDABatchProcessor::addWindow(std::shared_ptr<Window> window)
         else if (entry_status[i] != claragenomics::cudapoa::StatusType::success)
         {
             fprintf(stderr, "Could not add sequence to POA in batch %d.\n",
-                    cudapoa_batch_->batch_id());
+                    slot.cudapoa_batch->batch_id());
             exit(1);
         }
         seq_added++;
     }
-    seqs_added_per_window_.push_back(seq_added);
+    slot.seqs_added_per_window.push_back(seq_added);
 
 #ifndef NDEBUG
     if (long_seq > 0)
@@ -171,7 +200,23 @@ bool CUDABatchProcessor::addWindow(std::shared_ptr<Window> window)
 
 bool CUDABatchProcessor::hasWindows() const
 {
-    return (cudapoa_batch_->get_total_poas() > 0);
+    return (slots_[current_slot_].cudapoa_batch->get_total_poas() > 0);
+}
+
+bool CUDABatchProcessor::isWindowSuitable(const Window& window, uint32_t max_window_depth)
+{
+    if (window.sequences_.size() > max_window_depth)
+    {
+        return false;
+    }
+    for(const auto& it : window.sequences_)
+    {
+        if (it.second > MAX_SEQUENCE_SIZE)
+        {
+            return false;
+        }
+    }
+    return true;
 }
 
 void CUDABatchProcessor::convertPhredQualityToWeights(const char* qual,
@@ -185,22 +230,23 @@ void CUDABatchProcessor::convertPhredQualityToWeights(const char* qual,
     }
 }
 
-void CUDABatchProcessor::generatePOA()
+void CUDABatchProcessor::generatePOA(Slot& slot)
 {
     // call generate poa function
-    cudapoa_batch_->generate_poa();
+    slot.cudapoa_batch->generate_poa();
 }
 
-void CUDABatchProcessor::getConsensus()
+void CUDABatchProcessor::getConsensus(Slot& slot)
 {
     std::vector<std::string> consensuses;
     std::vector<std::vector<uint16_t>> coverages;
     std::vector<claragenomics::cudapoa::StatusType> output_status;
-    cudapoa_batch_->get_consensus(consensuses, coverages, output_status);
+    slot.cudapoa_batch->get_consensus(consensuses, coverages, output_status);
 
-    for(uint32_t i = 0; i < windows_.size(); i++)
+    window_consensus_status_.clear();
+    for(uint32_t i = 0; i < slot.windows.size(); i++)
     {
-        auto window = windows_.at(i);
+        auto window = slot.windows.at(i);
         if (output_status.at(i) != claragenomics::cudapoa::StatusType::success)
         {
             // leave the failure cases to CPU polisher
@@ -225,7 +271,7 @@ void CUDABatchProcessor::getConsensus()
                 window->consensus_ = consensuses[i];
                 if (window->type_ ==  WindowType::kTGS)
                 {
-                    uint32_t num_seqs_in_window = seqs_added_per_window_[i];
+                    uint32_t num_seqs_in_window = slot.seqs_added_per_window[i];
                     uint32_t average_coverage = num_seqs_in_window / 2;
 
                     int32_t begin = 0, end =  window->consensus_.size() - 1;
@@ -255,21 +301,48 @@ void CUDABatchProcessor::getConsensus()
     }
 }
 
-const std::vector<bool>& CUDABatchProcessor::generateConsensus()
+void CUDABatchProcessor::launch()
 {
-    // Generate consensus for all windows in the batch
-    generatePOA();
-    getConsensus();
+    if (num_pending_ == slots_.size())
+    {
+        fprintf(stderr, "[racon::CUDABatchProcessor::launch] error: "
+                "all slots are in flight!\n");
+        exit(1);
+    }
+
+    generatePOA(slots_[current_slot_]);
+
+    current_slot_ = (current_slot_ + 1) % slots_.size();
+    ++num_pending_;
+}
+
+const std::vector<bool>& CUDABatchProcessor::collect()
+{
+    if (num_pending_ == 0)
+    {
+        fprintf(stderr, "[racon::CUDABatchProcessor::collect] error: "
+                "no batch in flight!\n");
+        exit(1);
+    }
+
+    uint32_t oldest_slot = (current_slot_ + slots_.size() - num_pending_) % slots_.size();
+    Slot& slot = slots_[oldest_slot];
+    getConsensus(slot);
+    --num_pending_;
+
+    // Windows are not needed by the batch anymore.
+    slot.windows.clear();
+    slot.seqs_added_per_window.clear();
 
     return window_consensus_status_;
 }
 
 void CUDABatchProcessor::reset()
 {
-    windows_.clear();
-    window_consensus_status_.clear();
-    seqs_added_per_window_.clear();
-    cudapoa_batch_->reset();
+    Slot& slot = slots_[current_slot_];
+    slot.windows.clear();
+    slot.seqs_added_per_window.clear();
+    slot.cudapoa_batch->reset();
 }
 
 } // namespace racon
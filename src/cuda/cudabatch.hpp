@@ -22,7 +22,7 @@ namespace racon {
 class Window;
 
 class CUDABatchProcessor;
-std::unique_ptr<CUDABatchProcessor> createCUDABatch(uint32_t max_window_depth, uint32_t device, size_t avail_mem, int8_t gap, int8_t mismatch, int8_t match, bool cuda_banded_alignment);
+std::unique_ptr<CUDABatchProcessor> createCUDABatch(uint32_t max_window_depth, uint32_t device, size_t avail_mem, int8_t gap, int8_t mismatch, int8_t match, bool cuda_banded_alignment, uint32_t num_slots = 2);
 
 class CUDABatchProcessor
 {
@@ -30,7 +30,7 @@ public:
     ~CUDABatchProcessor();
 
     /**
-     * @brief Add a new window to the batch.
+     * @brief Add a new window to the batch which is being filled.
      *
      * @param[in] window : The window to add to the batch.
      *
@@ -39,22 +39,53 @@ public:
     bool addWindow(std::shared_ptr<Window> window);
 
     /**
-     * @brief Checks if batch has any windows to process.
+     * @brief Checks if the batch which is being filled has any windows to
+     *        process.
      */
     bool hasWindows() const;
 
     /**
-     * @brief Runs the core computation to generate consensus for
-     *        all windows in the batch.
+     * @brief Checks if a window can be polished on GPU without dropping any
+     *        of its sequences.
+     *
+     * @param[in] window           : The window to check.
+     * @param[in] max_window_depth : Maximum number of sequences per window
+     *
+     * @return False for windows which are too deep or have too long sequences,
+     *         these are left to the CPU.
+     */
+    static bool isWindowSuitable(const Window& window, uint32_t max_window_depth);
+
+    /**
+     * @brief Starts generating consensus for all windows in the batch which
+     *        is being filled (asynchronously, on the stream of its slot) and
+     *        moves on to filling the next slot. The next slot has to be
+     *        collected first if it is still in flight.
+     */
+    void launch();
+
+    /**
+     * @brief Waits for the oldest launched batch and copies its consensus
+     *        into its windows.
      *
      * @return Vector of bool indicating succesful generation of consensus
-     *         for each window in the batch.
+     *         for each window of the batch, in the order they were added.
      */
-    const std::vector<bool>& generateConsensus();
+    const std::vector<bool>& collect();
 
     /**
-     * @brief Resets the state of the object, which includes
-     *        resetting buffer states and counters.
+     * @brief Number of launched batches which are not collected yet.
+     */
+    uint32_t numPending() const { return num_pending_; }
+
+    /**
+     * @brief Number of batches which can be in flight at once.
+     */
+    uint32_t numSlots() const { return slots_.size(); }
+
+    /**
+     * @brief Resets the state of the batch which is being filled, which
+     *        includes resetting buffer states and counters.
      */
     void reset();
 
@@ -65,30 +96,49 @@ public:
 
     // Builder function to create a new CUDABatchProcessor object.
     friend std::unique_ptr<CUDABatchProcessor>
-    createCUDABatch(uint32_t max_window_depth, uint32_t device, size_t avail_mem, int8_t gap, int8_t mismatch, int8_t match, bool cuda_banded_alignment);
+    createCUDABatch(uint32_t max_window_depth, uint32_t device, size_t avail_mem, int8_t gap, int8_t mismatch, int8_t match, bool cuda_banded_alignment, uint32_t num_slots);
 
 protected:
     /**
      * @brief Constructor for CUDABatch class.
      *
      * @param[in] max_window_depth : Maximum number of sequences per window
+     * @param[in] avail_mem : Device memory shared by all slots
      * @param[in] cuda_banded_alignment : Use banded POA alignment
+     * @param[in] num_slots : Number of batches which can be in flight at once
      */
-    CUDABatchProcessor(uint32_t max_window_depth, uint32_t device, size_t avail_mem, int8_t gap, int8_t mismatch, int8_t match, bool cuda_banded_alignment);
+    CUDABatchProcessor(uint32_t max_window_depth, uint32_t device, size_t avail_mem, int8_t gap, int8_t mismatch, int8_t match, bool cuda_banded_alignment, uint32_t num_slots);
     CUDABatchProcessor(const CUDABatchProcessor&) = delete;
     const CUDABatchProcessor& operator=(const CUDABatchProcessor&) = delete;
 
+    // A batch with its own stream, so that packing, copies and kernels of
+    // different slots overlap.
+    struct Slot
+    {
+        // CUDA-POA library object that manages POA batch.
+        std::unique_ptr<claragenomics::cudapoa::Batch> cudapoa_batch;
+
+        // Stream for running POA batch.
+        cudaStream_t stream;
+
+        // Windows belonging to the batch.
+        std::vector<std::shared_ptr<Window>> windows;
+
+        // Number of sequences actually added per window.
+        std::vector<uint32_t> seqs_added_per_window;
+    };
+
     /*
      * @brief Run the CUDA kernel for generating POA on the batch.
      *        This call is asynchronous.
      */
-    void generatePOA();
+    void generatePOA(Slot& slot);
 
     /*
      * @brief Wait for execution to complete and grab the output
      *        consensus from the device.
      */
-    void getConsensus();
+    void getConsensus(Slot& slot);
 
     /*
      * @brief Convert PHRED quality scores to weights.
@@ -105,19 +155,17 @@ protected:
     // Batch ID.
     uint32_t bid_ = 0;
 
-    // CUDA-POA library object that manages POA batch.
-    std::unique_ptr<claragenomics::cudapoa::Batch> cudapoa_batch_;
+    // Batches which are filled, in flight and collected in round robin order.
+    std::vector<Slot> slots_;
 
-    // Stream for running POA batch.
-    cudaStream_t stream_;
-    // Windows belonging to the batch.
-    std::vector<std::shared_ptr<Window>> windows_;
+    // Slot which is being filled.
+    uint32_t current_slot_;
 
-    // Consensus generation status for each window.
-    std::vector<bool> window_consensus_status_;
+    // Number of launched slots preceding the current one.
+    uint32_t num_pending_;
 
-    // Number of sequences actually added per window.
-    std::vector<uint32_t> seqs_added_per_window_;
+    // Consensus generation status for each window of the collected batch.
+    std::vector<bool> window_consensus_status_;
 
 };
 
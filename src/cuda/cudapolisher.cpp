@@ -4,6 +4,9 @@
  * @brief CUDA Polisher class source file
  */
 
+#include <algorithm>
+#include <atomic>
+#include <deque>
 #include <future>
 #include <iostream>
 #include <chrono>
@@ -11,10 +14,11 @@
 
 #include "sequence.hpp"
 #include "logger.hpp"
+#include "source.hpp"
+#include "stats.hpp"
 #include "cudapolisher.hpp"
 #include <claragenomics/utils/cudautils.hpp>
 
-#include "bioparser/bioparser.hpp"
 
 namespace racon {
 
@@ -23,22 +27,31 @@ namespace racon {
 // updates need to be broken into 20 bins.
 const uint32_t RACON_LOGGER_BIN_SIZE = 20;
 
-CUDAPolisher::CUDAPolisher(std::unique_ptr<bioparser::Parser<Sequence>> sparser,
-    std::unique_ptr<bioparser::Parser<Overlap>> oparser,
-    std::unique_ptr<bioparser::Parser<Sequence>> tparser,
-    PolisherType type, uint32_t window_length, double quality_threshold,
-    double error_threshold, bool trim, int8_t match, int8_t mismatch, int8_t gap,
-    uint32_t num_threads, uint32_t cudapoa_batches, bool cuda_banded_alignment,
-    uint32_t cudaaligner_batches)
+// Maximal lengths of overlaps aligned on GPU, overlaps are binned into the
+// shortest one they fit in.
+const std::vector<uint32_t> ALIGNER_BIN_LENGTHS = { 1024, 2048, 4096, 8192, 16384, 32768 };
+
+// Number of alignments of the aligner used to measure memory per alignment.
+const uint32_t PROBE_ALIGNMENTS = 16;
+
+// Used if memory per alignment can not be measured.
+const uint32_t DEFAULT_MAX_ALIGNMENTS = 200;
+
+// Upper bound on alignments in one batch.
+const uint32_t MAX_ALIGNMENTS = 100000;
+
+CUDAPolisher::CUDAPolisher(std::unique_ptr<Source<Sequence>> sparser,
+    std::unique_ptr<Source<Overlap>> oparser,
+    std::unique_ptr<Source<Sequence>> tparser,
+    const PolisherOptions& options)
         : Polisher(std::move(sparser), std::move(oparser), std::move(tparser),
-                type, window_length, quality_threshold, error_threshold, trim,
-                match, mismatch, gap, num_threads)
-        , cudapoa_batches_(cudapoa_batches)
-        , cudaaligner_batches_(cudaaligner_batches)
-        , gap_(gap)
-        , mismatch_(mismatch)
-        , match_(match)
-        , cuda_banded_alignment_(cuda_banded_alignment)
+                options)
+        , cudapoa_batches_(options.cuda_batches)
+        , cudaaligner_batches_(options.cudaaligner_batches)
+        , gap_(options.gap)
+        , mismatch_(options.mismatch)
+        , match_(options.match)
+        , cuda_banded_alignment_(options.cuda_banded_alignment)
 {
     claragenomics::cudapoa::Init();
     claragenomics::cudaaligner::Init();
@@ -69,6 +82,26 @@ CUDAPolisher::~CUDAPolisher()
     cudaProfilerStop();
 }
 
+uint32_t CUDAPolisher::calculate_max_alignments(uint32_t max_length, int32_t device, size_t avail_mem)
+{
+    // Memory taken by an aligner is measured on a small one, as it is linear
+    // in the number of alignments.
+    size_t total = 0, free_before = 0, free_after = 0;
+    CGA_CU_CHECK_ERR(cudaSetDevice(device));
+    CGA_CU_CHECK_ERR(cudaMemGetInfo(&free_before, &total));
+    {
+        auto probe = createCUDABatchAligner(max_length, max_length, PROBE_ALIGNMENTS, device);
+        CGA_CU_CHECK_ERR(cudaMemGetInfo(&free_after, &total));
+    }
+    if (free_after >= free_before)
+    {
+        return DEFAULT_MAX_ALIGNMENTS;
+    }
+
+    size_t mem_per_alignment = (free_before - free_after + PROBE_ALIGNMENTS - 1) / PROBE_ALIGNMENTS;
+    return std::min(avail_mem / mem_per_alignment, static_cast<size_t>(MAX_ALIGNMENTS));
+}
+
 std::vector<uint32_t> CUDAPolisher::calculate_batches_per_gpu(uint32_t batches, uint32_t gpus)
 {
     // Bin batches into each GPU.
@@ -87,34 +120,76 @@ void CUDAPolisher::find_overlap_breaking_points(std::vector<std::unique_ptr<Over
 {
     if (cudaaligner_batches_ >= 1)
     {
-        // TODO: Experimentally this is giving decent perf
-        const uint32_t MAX_ALIGNMENTS = 200;
+        logger_->log();
+
+        // Overlaps are binned by length so that alignments of similar lengths
+        // share a batch, overlaps longer than the last bin are left to CPU.
+        std::vector<std::vector<uint64_t>> bins(ALIGNER_BIN_LENGTHS.size());
+        for (uint64_t i = 0; i < overlaps.size(); ++i)
+        {
+            auto it = std::lower_bound(ALIGNER_BIN_LENGTHS.begin(), ALIGNER_BIN_LENGTHS.end(),
+                    overlaps[i]->length());
+            if (it != ALIGNER_BIN_LENGTHS.end())
+            {
+                bins[it - ALIGNER_BIN_LENGTHS.begin()].emplace_back(i);
+            }
+        }
 
+        // Bin batches into each GPU.
+        std::vector<uint32_t> batches_per_gpu = calculate_batches_per_gpu(cudaaligner_batches_, num_devices_);
+
+        // Number of alignments per batch for each device and bin, sized to
+        // the share of free memory of each batch.
+        std::vector<std::vector<uint32_t>> max_alignments(num_devices_,
+                std::vector<uint32_t>(bins.size(), 0));
+        for(int32_t device = 0; device < num_devices_; device++)
+        {
+            if (batches_per_gpu.at(device) == 0)
+            {
+                continue;
+            }
+            size_t total = 0, free = 0;
+            CGA_CU_CHECK_ERR(cudaSetDevice(device));
+            CGA_CU_CHECK_ERR(cudaMemGetInfo(&free, &total));
+            // Using 90% of available memory as heuristic since not all available memory can be used
+            // due to fragmentation.
+            size_t mem_per_batch = 0.9 * free / batches_per_gpu.at(device);
+            for(uint32_t bin = 0; bin < bins.size(); bin++)
+            {
+                if (!bins[bin].empty())
+                {
+                    max_alignments[device][bin] = calculate_max_alignments(
+                            ALIGNER_BIN_LENGTHS[bin], device, mem_per_batch);
+                }
+            }
+        }
+
+        logger_->log("[racon::CUDAPolisher::initialize] sized alignment batches to GPU memory");
         logger_->log();
+
         std::mutex mutex_overlaps;
-        uint32_t next_overlap_index = 0;
+        std::vector<uint64_t> next_overlap_index(bins.size(), 0);
 
-        // Lambda expression for filling up next batch of alignments.
-        auto fill_next_batch = [&mutex_overlaps, &next_overlap_index, &overlaps, this](CUDABatchAligner* batch) -> std::pair<uint32_t, uint32_t> {
+        // Lambda expression for filling up next batch of alignments of a bin.
+        auto fill_next_batch = [&](CUDABatchAligner* batch, uint32_t bin) -> uint64_t {
             batch->reset();
 
             // Use mutex to read the vector containing windows in a threadsafe manner.
             std::lock_guard<std::mutex> guard(mutex_overlaps);
 
-            uint32_t initial_count = next_overlap_index;
-            uint32_t count = overlaps.size();
-            while(next_overlap_index < count)
+            uint64_t initial_count = next_overlap_index[bin];
+            while(next_overlap_index[bin] < bins[bin].size())
             {
-                if (batch->addOverlap(overlaps.at(next_overlap_index).get(), sequences_))
+                if (batch->addOverlap(overlaps.at(bins[bin][next_overlap_index[bin]]).get(), sequences_))
                 {
-                    next_overlap_index++;
+                    next_overlap_index[bin]++;
                 }
                 else
                 {
                     break;
                 }
             }
-            return {initial_count, next_overlap_index};
+            return next_overlap_index[bin] - initial_count;
         };
 
         // Variables for keeping track of logger progress bar.
@@ -122,74 +197,79 @@ void CUDAPolisher::find_overlap_breaking_points(std::vector<std::unique_ptr<Over
         int32_t log_bar_idx = 0, log_bar_idx_prev = -1;
         uint32_t window_idx = 0;
         std::mutex mutex_log_bar_idx;
+        std::atomic<uint64_t> num_gpu_overlaps(0);
 
-        // Lambda expression for processing a batch of alignments.
-        auto process_batch = [&fill_next_batch, &logger_step, &log_bar_idx, &log_bar_idx_prev, &window_idx, &mutex_log_bar_idx, this](CUDABatchAligner* batch) -> void {
-            while(true)
+        // Lambda expression for processing batches of alignments, bins of
+        // longest overlaps first. Each bin gets an aligner of its own size.
+        auto process_batch = [&](int32_t device) -> void {
+            for(uint32_t bin = bins.size(); bin-- > 0;)
             {
-                auto range = fill_next_batch(batch);
-                if (batch->hasOverlaps())
+                if (max_alignments[device][bin] == 0)
                 {
-                    // Launch workload.
-                    batch->alignAll();
+                    continue;
+                }
+                auto batch = createCUDABatchAligner(ALIGNER_BIN_LENGTHS[bin],
+                        ALIGNER_BIN_LENGTHS[bin], max_alignments[device][bin], device);
+                while(true)
+                {
+                    uint64_t num_added = fill_next_batch(batch.get(), bin);
+                    if (batch->hasOverlaps())
+                    {
+                        // Launch workload.
+                        batch->alignAll();
 
-                    // Generate CIGAR strings for successful alignments. The actual breaking points
-                    // will be calculate by the overlap object.
-                    batch->generate_cigar_strings();
+                        // Generate CIGAR strings for successful alignments. The actual breaking points
+                        // will be calculate by the overlap object.
+                        batch->generate_cigar_strings();
+                        num_gpu_overlaps += batch->numOverlaps();
+                    }
+                    else if (num_added == 0)
+                    {
+                        break;
+                    }
 
                     // logging bar
                     {
                         std::lock_guard<std::mutex> guard(mutex_log_bar_idx);
-                        window_idx += range.second - range.first;
-                        log_bar_idx = window_idx / logger_step;
-                        if (log_bar_idx == log_bar_idx_prev) {
+                        window_idx += num_added;
+                        if (logger_step == 0)
+                        {
                             continue;
                         }
-                        else if (logger_step != 0 && log_bar_idx < static_cast<int32_t>(RACON_LOGGER_BIN_SIZE))
+                        log_bar_idx = window_idx / logger_step;
+                        if (log_bar_idx != log_bar_idx_prev && log_bar_idx < static_cast<int32_t>(RACON_LOGGER_BIN_SIZE))
                         {
                             logger_->bar("[racon::CUDAPolisher::initialize] aligning overlaps");
                             log_bar_idx_prev = log_bar_idx;
                         }
                     }
                 }
-                else
-                {
-                    break;
-                }
             }
         };
 
-        // Bin batches into each GPU.
-        std::vector<uint32_t> batches_per_gpu = calculate_batches_per_gpu(cudaaligner_batches_, num_devices_);
-
+        // Run batched alignment.
+        std::vector<std::future<void>> thread_futures;
         for(int32_t device = 0; device < num_devices_; device++)
         {
             for(uint32_t batch = 0; batch < batches_per_gpu.at(device); batch++)
             {
-                batch_aligners_.emplace_back(createCUDABatchAligner(15000, 15000, MAX_ALIGNMENTS, device));
+                thread_futures.emplace_back(
+                        thread_pool_->submit(
+                            process_batch,
+                            device
+                            )
+                        );
             }
         }
 
-        logger_->log("[racon::CUDAPolisher::initialize] allocated memory on GPUs for alignment");
-
-        // Run batched alignment.
-        std::vector<std::future<void>> thread_futures;
-        for(auto& aligner : batch_aligners_)
-        {
-            thread_futures.emplace_back(
-                    thread_pool_->submit(
-                        process_batch,
-                        aligner.get()
-                        )
-                    );
-        }
-
         // Wait for threads to finish, and collect their results.
         for (const auto& future : thread_futures) {
             future.wait();
         }
 
-        batch_aligners_.clear();
+        logger_->log("[racon::CUDAPolisher::initialize] aligned " +
+                std::to_string(num_gpu_overlaps.load()) + " overlaps on GPU, " +
+                std::to_string(overlaps.size() - num_gpu_overlaps.load()) + " are left to CPU");
     }
 
     // This call runs the breaking point detection code for all alignments.
@@ -208,14 +288,34 @@ void CUDAPolisher::polish(std::vector<std::unique_ptr<Sequence>>& dst,
     }
     else
     {
+        stats_->begin("consensus");
+
         // Creation and use of batches.
         const uint32_t MAX_DEPTH_PER_WINDOW = 200;
+        // Batches in flight per batch processor, device memory of a processor
+        // is split among them.
+        const uint32_t BATCH_SLOTS = 2;
+
+        // Batches are sized to the deepest window they can get, so that
+        // shallower windows fit more of them into the same memory.
+        uint32_t max_window_depth = 0;
+        for(const auto& it : windows_)
+        {
+            if (CUDABatchProcessor::isWindowSuitable(*it, MAX_DEPTH_PER_WINDOW))
+            {
+                max_window_depth = std::max(max_window_depth, static_cast<uint32_t>(it->q_ids().size()));
+            }
+        }
 
         // Bin batches into each GPU.
         std::vector<uint32_t> batches_per_gpu = calculate_batches_per_gpu(cudapoa_batches_, num_devices_);
 
         for(int32_t device = 0; device < num_devices_; device++)
         {
+            if (batches_per_gpu.at(device) == 0 || max_window_depth == 0)
+            {
+                continue;
+            }
             size_t total = 0, free = 0;
             CGA_CU_CHECK_ERR(cudaSetDevice(device));
             CGA_CU_CHECK_ERR(cudaMemGetInfo(&free, &total));
@@ -224,104 +324,216 @@ void CUDAPolisher::polish(std::vector<std::unique_ptr<Sequence>>& dst,
             size_t mem_per_batch = 0.9 * free/batches_per_gpu.at(device);
             for(uint32_t batch = 0; batch < batches_per_gpu.at(device); batch++)
             {
-                batch_processors_.emplace_back(createCUDABatch(MAX_DEPTH_PER_WINDOW, device, mem_per_batch, gap_, mismatch_, match_, cuda_banded_alignment_));
+                batch_processors_.emplace_back(createCUDABatch(max_window_depth, device, mem_per_batch, gap_, mismatch_, match_, cuda_banded_alignment_, BATCH_SLOTS));
             }
         }
 
-        logger_->log("[racon::CUDAPolisher::polish] allocated memory on GPUs for polishing");
-
-        // Mutex for accessing the vector of windows.
-        std::mutex mutex_windows;
+        logger_->log("[racon::CUDAPolisher::polish] allocated memory on GPUs for polishing "
+                "windows of up to " + std::to_string(max_window_depth) + " sequences");
 
         // Initialize window consensus statuses.
-        window_consensus_status_.resize(windows_.size(), false);
+        window_consensus_status_.assign(windows_.size(), false);
+
+        // Windows are kept in one queue shared by GPU and CPU workers. Windows
+        // which do not fit the GPU come first followed by the rest in descending
+        // order of their estimated cost. CPU workers take windows from the
+        // front while GPU workers take them from the back, until they meet.
+        std::vector<uint64_t> order;
+        order.reserve(windows_.size());
+        for (uint64_t i = 0; i < windows_.size(); ++i)
+        {
+            if (!CUDABatchProcessor::isWindowSuitable(*windows_[i], MAX_DEPTH_PER_WINDOW))
+            {
+                order.emplace_back(i);
+            }
+        }
+        uint64_t gpu_begin = order.size();
+        for (uint64_t i = 0; i < windows_.size(); ++i)
+        {
+            if (CUDABatchProcessor::isWindowSuitable(*windows_[i], MAX_DEPTH_PER_WINDOW))
+            {
+                order.emplace_back(i);
+            }
+        }
+        std::vector<uint64_t> costs(windows_.size());
+        for (uint64_t i = 0; i < windows_.size(); ++i)
+        {
+            costs[i] = windows_[i]->cost();
+        }
+        std::stable_sort(order.begin(), order.begin() + gpu_begin, [&](uint64_t lhs, uint64_t rhs) {
+            return costs[lhs] > costs[rhs];
+        });
+        std::stable_sort(order.begin() + gpu_begin, order.end(), [&](uint64_t lhs, uint64_t rhs) {
+            return costs[lhs] > costs[rhs];
+        });
+
+        // Mutex for accessing the queue, GPU workers fill their batches one
+        // at a time.
+        std::mutex mutex_queue;
+        std::mutex mutex_batches;
+        uint64_t queue_front = 0, queue_back = order.size();
+
+        // Windows processed on GPU, failed ones are retried on CPU at the end.
+        std::vector<uint8_t> is_gpu_window(windows_.size(), 0);
+        std::atomic<uint64_t> num_gpu_windows(0), num_cpu_windows(0);
 
-        // Index of next window to be added to a batch.
-        uint32_t next_window_index = 0;
+        // Variables for keeping track of logger progress bar.
+        uint32_t logger_step = windows_.size() / RACON_LOGGER_BIN_SIZE;
+        int32_t log_bar_idx = 0, log_bar_idx_prev = -1;
+        uint32_t window_idx = 0;
+        std::mutex mutex_log_bar_idx;
+        logger_->log();
 
-        // Lambda function for adding windows to batches.
-        auto fill_next_batch = [&mutex_windows, &next_window_index, this](CUDABatchProcessor* batch) -> std::pair<uint32_t, uint32_t> {
-            batch->reset();
+        auto log_progress = [&](uint32_t num_windows) -> void {
+            std::lock_guard<std::mutex> guard(mutex_log_bar_idx);
+            window_idx += num_windows;
+            if (logger_step == 0)
+            {
+                return;
+            }
+            log_bar_idx = window_idx / logger_step;
+            while(log_bar_idx_prev < log_bar_idx && log_bar_idx_prev + 1 < static_cast<int32_t>(RACON_LOGGER_BIN_SIZE))
+            {
+                logger_->bar("[racon::CUDAPolisher::polish] generating consensus");
+                log_bar_idx_prev++;
+            }
+        };
 
-            // Use mutex to read the vector containing windows in a threadsafe manner.
-            std::lock_guard<std::mutex> guard(mutex_windows);
+        auto polish_on_cpu = [&](uint64_t j) -> void {
+            auto it = thread_to_id_.find(std::this_thread::get_id());
+            if (it == thread_to_id_.end())
+            {
+                fprintf(stderr, "[racon::CUDAPolisher::polish] error: "
+                        "thread identifier not present!\n");
+                exit(1);
+            }
+            window_consensus_status_.at(j) = windows_[j]->generate_consensus(
+                    alignment_engines_[it->second], graphs_[it->second], trim_);
+            ++num_cpu_windows;
+            log_progress(1);
+        };
+
+        // Lambda function for adding windows from the back of the queue to a
+        // batch, windows rejected by an empty batch are returned in rejected.
+        auto fill_next_batch = [&](CUDABatchProcessor* batch, std::vector<uint64_t>& added,
+                std::vector<uint64_t>& rejected) -> void {
+            batch->reset();
+            added.clear();
+            rejected.clear();
 
-            // TODO: Reducing window wize by 10 for debugging.
-            uint32_t initial_count = next_window_index;
-            uint32_t count = windows_.size();
-            while(next_window_index < count)
+            std::lock_guard<std::mutex> guard(mutex_batches);
+            while(true)
             {
-                if (batch->addWindow(windows_.at(next_window_index)))
+                uint64_t j;
                 {
-                    next_window_index++;
+                    std::lock_guard<std::mutex> lock(mutex_queue);
+                    if (queue_back <= std::max(queue_front, gpu_begin))
+                    {
+                        break;
+                    }
+                    j = order[--queue_back];
+                }
+                if (batch->addWindow(windows_.at(j)))
+                {
+                    added.emplace_back(j);
+                }
+                else if (added.empty())
+                {
+                    rejected.emplace_back(j);
                 }
                 else
                 {
+                    // Only this worker takes windows from the back at the moment,
+                    // thus the window can be put back.
+                    std::lock_guard<std::mutex> lock(mutex_queue);
+                    ++queue_back;
                     break;
                 }
             }
-
-            return {initial_count, next_window_index};
         };
 
-        // Variables for keeping track of logger progress bar.
-        uint32_t logger_step = windows_.size() / RACON_LOGGER_BIN_SIZE;
-        int32_t log_bar_idx = 0, log_bar_idx_prev = -1;
-        uint32_t window_idx = 0;
-        std::mutex mutex_log_bar_idx;
-        logger_->log();
-
-        // Lambda function for processing each batch.
-        auto process_batch = [&fill_next_batch, &logger_step, &log_bar_idx, &mutex_log_bar_idx, &window_idx, &log_bar_idx_prev, this](CUDABatchProcessor* batch) -> void {
+        // Lambda function for CPU workers, GPU workers join them once there
+        // are no windows left for the GPU.
+        auto process_on_cpu = [&]() -> void {
             while(true)
             {
-                std::pair<uint32_t, uint32_t> range = fill_next_batch(batch);
-                if (batch->hasWindows())
+                uint64_t j;
                 {
-                    // Launch workload.
-                    const std::vector<bool>& results = batch->generateConsensus();
-
-                    // Check if the number of batches processed is same as the range of
-                    // of windows that were added.
-                    if (results.size() != (range.second - range.first))
+                    std::lock_guard<std::mutex> lock(mutex_queue);
+                    if (queue_front >= queue_back)
                     {
-                        throw std::runtime_error("Windows processed doesn't match \
-                                range of windows passed to batch\n");
+                        break;
                     }
+                    j = order[queue_front++];
+                }
+                polish_on_cpu(j);
+            }
+        };
 
-                    // Copy over the results from the batch into the per window
-                    // result vector of the CUDAPolisher.
-                    for(uint32_t i = 0; i < results.size(); i++)
-                    {
-                        window_consensus_status_.at(range.first + i) = results.at(i);
-                    }
+        // Lambda function for GPU workers.
+        // Lambda function for GPU workers. Up to numSlots() batches are in
+        // flight at once, so that the next batch is filled (and the previous
+        // one collected) while the kernel of the current one runs.
+        auto process_batch = [&](CUDABatchProcessor* batch) -> void {
+            std::deque<std::vector<uint64_t>> in_flight;
+            std::vector<uint64_t> added, rejected;
+
+            auto collect = [&]() -> void {
+                const std::vector<bool>& results = batch->collect();
+
+                // Check if the number of batches processed is same as the
+                // number of windows that were added.
+                const std::vector<uint64_t>& ids = in_flight.front();
+                if (results.size() != ids.size())
+                {
+                    throw std::runtime_error("Windows processed doesn't match \
+                            windows passed to batch\n");
+                }
 
-                    // logging bar
-                    {
-                        std::lock_guard<std::mutex> guard(mutex_log_bar_idx);
-                        window_idx += results.size();
-                        log_bar_idx = window_idx / logger_step;
-                        if (log_bar_idx == log_bar_idx_prev) {
-                            continue;
-                        }
-                        else if (logger_step != 0 && log_bar_idx < static_cast<int32_t>(RACON_LOGGER_BIN_SIZE))
-                        {
-                            while(log_bar_idx_prev <= log_bar_idx)
-                            {
-                                logger_->bar("[racon::CUDAPolisher::polish] generating consensus");
-                                log_bar_idx_prev++;
-                            }
-                        }
-                    }
+                // Copy over the results from the batch into the per window
+                // result vector of the CUDAPolisher.
+                for(uint32_t i = 0; i < results.size(); i++)
+                {
+                    window_consensus_status_.at(ids[i]) = results.at(i);
+                    is_gpu_window[ids[i]] = 1;
                 }
-                else
+                num_gpu_windows += results.size();
+                log_progress(results.size());
+                in_flight.pop_front();
+            };
+
+            while(true)
+            {
+                if (batch->numPending() == batch->numSlots())
+                {
+                    collect();
+                }
+                fill_next_batch(batch, added, rejected);
+                for(const auto& j : rejected)
+                {
+                    polish_on_cpu(j);
+                }
+                if (batch->hasWindows())
+                {
+                    // Launch workload.
+                    batch->launch();
+                    in_flight.emplace_back(std::move(added));
+                    added = std::vector<uint64_t>();
+                }
+                else if (rejected.empty())
                 {
                     break;
                 }
             }
+            while(!in_flight.empty())
+            {
+                collect();
+            }
+            process_on_cpu();
         };
 
-        // Process each of the batches in a separate thread.
+        // GPU workers are submitted first, the rest of the threads are CPU
+        // workers.
         std::vector<std::future<void>> thread_futures;
         for(auto& batch_processor : batch_processors_)
         {
@@ -332,20 +544,26 @@ void CUDAPolisher::polish(std::vector<std::unique_ptr<Sequence>>& dst,
                         )
                     );
         }
+        for(uint32_t i = batch_processors_.size(); i < thread_to_id_.size(); i++)
+        {
+            thread_futures.emplace_back(thread_pool_->submit(process_on_cpu));
+        }
 
         // Wait for threads to finish, and collect their results.
         for (const auto& future : thread_futures) {
             future.wait();
         }
 
-        logger_->log("[racon::CUDAPolisher::polish] polished windows on GPU");
+        logger_->log("[racon::CUDAPolisher::polish] polished " +
+                std::to_string(num_gpu_windows.load()) + " windows on GPU and " +
+                std::to_string(num_cpu_windows.load()) + " on CPU");
 
         // Start timing CPU time for failed windows on GPU
         logger_->log();
         // Process each failed windows in parallel on CPU
         std::vector<std::future<bool>> thread_failed_windows;
         for (uint64_t i = 0; i < windows_.size(); ++i) {
-            if (window_consensus_status_.at(i) == false)
+            if (is_gpu_window[i] && window_consensus_status_.at(i) == false)
             {
                 thread_failed_windows.emplace_back(thread_pool_->submit(
                             [&](uint64_t j) -> bool {
@@ -355,8 +573,8 @@ void CUDAPolisher::polish(std::vector<std::unique_ptr<Sequence>>& dst,
                                     "thread identifier not present!\n");
                             exit(1);
                             }
-                            return window_consensus_status_.at(j) = windows_[j]->generate_consensus(
-                                    alignment_engines_[it->second], trim_);
+                            return (window_consensus_status_.at(j) = windows_[j]->generate_consensus(
+                                    alignment_engines_[it->second], graphs_[it->second], trim_));
                             }, i));
             }
         }
@@ -399,6 +617,7 @@ void CUDAPolisher::polish(std::vector<std::unique_ptr<Sequence>>& dst,
             windows_[i].reset();
         }
 
+        stats_->end();
         logger_->log("[racon::CUDAPolisher::polish] generated consensus");
 
         // Clear POA processors.
@@ -23,35 +23,30 @@ public:
     virtual void polish(std::vector<std::unique_ptr<Sequence>>& dst,
         bool drop_unpolished_sequences) override;
 
-    friend std::unique_ptr<Polisher> createPolisher(const std::string& sequences_path,
-        const std::string& overlaps_path, const std::string& target_path,
-        PolisherType type, uint32_t window_length, double quality_threshold,
-        double error_threshold, bool trim, int8_t match, int8_t mismatch, int8_t gap,
-        uint32_t num_threads, uint32_t cudapoa_batches, bool cuda_banded_alignment,
-        uint32_t cudaaligner_batches);
+    friend std::unique_ptr<Polisher> createPolisher(std::unique_ptr<Source<Sequence>> sequences,
+        std::unique_ptr<Source<Overlap>> overlaps, std::unique_ptr<Source<Sequence>> targets,
+        const PolisherOptions& options);
 
 protected:
-    CUDAPolisher(std::unique_ptr<bioparser::Parser<Sequence>> sparser,
-        std::unique_ptr<bioparser::Parser<Overlap>> oparser,
-        std::unique_ptr<bioparser::Parser<Sequence>> tparser,
-        PolisherType type, uint32_t window_length, double quality_threshold,
-        double error_threshold, bool trim, int8_t match, int8_t mismatch, int8_t gap,
-        uint32_t num_threads, uint32_t cudapoa_batches, bool cuda_banded_alignment,
-        uint32_t cudaaligner_batches);
+    CUDAPolisher(std::unique_ptr<Source<Sequence>> sparser,
+        std::unique_ptr<Source<Overlap>> oparser,
+        std::unique_ptr<Source<Sequence>> tparser,
+        const PolisherOptions& options);
     CUDAPolisher(const CUDAPolisher&) = delete;
     const CUDAPolisher& operator=(const CUDAPolisher&) = delete;
     virtual void find_overlap_breaking_points(std::vector<std::unique_ptr<Overlap>>& overlaps) override;
 
     static std::vector<uint32_t> calculate_batches_per_gpu(uint32_t cudapoa_batches, uint32_t gpus);
 
+    // Number of alignments of at most max_length bases which fit into
+    // avail_mem bytes of device memory.
+    static uint32_t calculate_max_alignments(uint32_t max_length, int32_t device, size_t avail_mem);
+
     // Vector of POA batches.
     std::vector<std::unique_ptr<CUDABatchProcessor>> batch_processors_;
 
-    // Vector of aligner batches.
-    std::vector<std::unique_ptr<CUDABatchAligner>> batch_aligners_;
-
     // Vector of bool indicating consensus generation status for each window.
-    std::vector<bool> window_consensus_status_;
+    std::vector<uint8_t> window_consensus_status_;
 
     // Number of batches for POA processing.
     uint32_t cudapoa_batches_;
@@ -8,6 +8,7 @@
 
 #include "sequence.hpp"
 #include "polisher.hpp"
+#include "sink.hpp"
 #ifdef CUDA_ENABLED
 #include "cuda/cudapolisher.hpp"
 #endif
@@ -18,6 +19,25 @@
 
 static const char* version = RACON_VERSION;
 static const int32_t CUDAALIGNER_INPUT_CODE = 10000;
+static const int32_t STREAM_INPUT_CODE = 10001;
+static const int32_t ALIGNER_INPUT_CODE = 10002;
+static const int32_t GAP_MODEL_INPUT_CODE = 10003;
+static const int32_t GAP_EXTEND_INPUT_CODE = 10004;
+static const int32_t GAP_OPEN_2_INPUT_CODE = 10005;
+static const int32_t GAP_EXTEND_2_INPUT_CODE = 10006;
+static const int32_t MAX_WINDOW_DEPTH_INPUT_CODE = 10007;
+static const int32_t ROUNDS_INPUT_CODE = 10008;
+static const int32_t CACHE_INPUT_CODE = 10009;
+static const int32_t READ_STORE_INPUT_CODE = 10010;
+static const int32_t SHARD_INPUT_CODE = 10011;
+static const int32_t OUTPUT_INPUT_CODE = 10012;
+static const int32_t FASTQ_INPUT_CODE = 10013;
+static const int32_t STATS_JSON_INPUT_CODE = 10014;
+static const int32_t NUMA_INPUT_CODE = 10015;
+static const int32_t TARGETS_INPUT_CODE = 10016;
+static const int32_t OVERLAP_INDEX_INPUT_CODE = 10017;
+static const int32_t UNORDERED_INPUT_CODE = 10018;
+static const int32_t NO_PACKING_INPUT_CODE = 10019;
 
 static struct option options[] = {
     {"include-unpolished", no_argument, 0, 'u'},
@@ -26,11 +46,30 @@ static struct option options[] = {
     {"window-overlap-percentage", required_argument, 0, 'p'},
     {"quality-threshold", required_argument, 0, 'q'},
     {"error-threshold", required_argument, 0, 'e'},
+    {"max-window-depth", required_argument, 0, MAX_WINDOW_DEPTH_INPUT_CODE},
     {"no-trimming", no_argument, 0, 'T'},
     {"match", required_argument, 0, 'm'},
     {"mismatch", required_argument, 0, 'x'},
     {"gap", required_argument, 0, 'g'},
+    {"gap-model", required_argument, 0, GAP_MODEL_INPUT_CODE},
+    {"gap-extend", required_argument, 0, GAP_EXTEND_INPUT_CODE},
+    {"gap-open-2", required_argument, 0, GAP_OPEN_2_INPUT_CODE},
+    {"gap-extend-2", required_argument, 0, GAP_EXTEND_2_INPUT_CODE},
     {"threads", required_argument, 0, 't'},
+    {"stream", no_argument, 0, STREAM_INPUT_CODE},
+    {"unordered", no_argument, 0, UNORDERED_INPUT_CODE},
+    {"rounds", required_argument, 0, ROUNDS_INPUT_CODE},
+    {"cache", required_argument, 0, CACHE_INPUT_CODE},
+    {"read-store", required_argument, 0, READ_STORE_INPUT_CODE},
+    {"no-packing", no_argument, 0, NO_PACKING_INPUT_CODE},
+    {"shard", required_argument, 0, SHARD_INPUT_CODE},
+    {"output", required_argument, 0, OUTPUT_INPUT_CODE},
+    {"fastq", no_argument, 0, FASTQ_INPUT_CODE},
+    {"stats-json", required_argument, 0, STATS_JSON_INPUT_CODE},
+    {"numa", no_argument, 0, NUMA_INPUT_CODE},
+    {"targets", required_argument, 0, TARGETS_INPUT_CODE},
+    {"overlap-index", no_argument, 0, OVERLAP_INDEX_INPUT_CODE},
+    {"aligner", required_argument, 0, ALIGNER_INPUT_CODE},
     {"version", no_argument, 0, 'v'},
     {"help", no_argument, 0, 'h'},
 #ifdef CUDA_ENABLED
@@ -47,23 +86,11 @@ int main(int argc, char** argv) {
 
     std::vector<std::string> input_paths;
 
-    uint32_t window_length = 500;
-    double overlap_percentage = 0.0;
-    double quality_threshold = 10.0;
-    double error_threshold = 0.3;
-    bool trim = true;
-
-    int8_t match = 3;
-    int8_t mismatch = -5;
-    int8_t gap = -4;
-    uint32_t type = 0;
-
+    // defaults are those of racon::PolisherOptions
+    racon::PolisherOptions polisher_options;
     bool drop_unpolished_sequences = true;
-    uint32_t num_threads = 1;
-
-    uint32_t cudapoa_batches = 0;
-    uint32_t cudaaligner_batches = 0;
-    bool cuda_banded_alignment = false;
+    std::string output_path = "";
+    bool fastq = false;
 
     std::string optstring = "ufw:p:q:e:m:x:g:t:h";
 #ifdef CUDA_ENABLED
@@ -77,34 +104,113 @@ int main(int argc, char** argv) {
                 drop_unpolished_sequences = false;
                 break;
             case 'f':
-                type = 1;
+                polisher_options.type = racon::PolisherType::kF;
                 break;
             case 'w':
-                window_length = atoi(optarg);
+                polisher_options.window_length = atoi(optarg);
                 break;
             case 'p':
-            	overlap_percentage = atof(optarg);
+            	polisher_options.overlap_percentage = atof(optarg);
             	break;
             case 'q':
-                quality_threshold = atof(optarg);
+                polisher_options.quality_threshold = atof(optarg);
                 break;
             case 'e':
-                error_threshold = atof(optarg);
+                polisher_options.error_threshold = atof(optarg);
+                break;
+            case MAX_WINDOW_DEPTH_INPUT_CODE:
+                polisher_options.max_window_depth = atoi(optarg);
                 break;
             case 'T':
-                trim = false;
+                polisher_options.trim = false;
                 break;
             case 'm':
-                match = atoi(optarg);
+                polisher_options.match = atoi(optarg);
                 break;
             case 'x':
-                mismatch = atoi(optarg);
+                polisher_options.mismatch = atoi(optarg);
                 break;
             case 'g':
-                gap = atoi(optarg);
+                polisher_options.gap = atoi(optarg);
+                break;
+            case GAP_MODEL_INPUT_CODE:
+                if (std::string(optarg) == "linear") {
+                    polisher_options.gap_model = racon::GapModel::kLinear;
+                } else if (std::string(optarg) == "affine") {
+                    polisher_options.gap_model = racon::GapModel::kAffine;
+                } else if (std::string(optarg) == "convex") {
+                    polisher_options.gap_model = racon::GapModel::kConvex;
+                } else {
+                    fprintf(stderr, "[racon::] error: unknown gap model %s!\n", optarg);
+                    exit(1);
+                }
+                break;
+            case GAP_EXTEND_INPUT_CODE:
+                polisher_options.gap_extend = atoi(optarg);
+                break;
+            case GAP_OPEN_2_INPUT_CODE:
+                polisher_options.gap_open_2 = atoi(optarg);
+                break;
+            case GAP_EXTEND_2_INPUT_CODE:
+                polisher_options.gap_extend_2 = atoi(optarg);
                 break;
             case 't':
-                num_threads = atoi(optarg);
+                polisher_options.num_threads = atoi(optarg);
+                break;
+            case STREAM_INPUT_CODE:
+                polisher_options.stream = true;
+                break;
+            case UNORDERED_INPUT_CODE:
+                polisher_options.unordered_output = true;
+                break;
+            case ROUNDS_INPUT_CODE:
+                polisher_options.num_rounds = atoi(optarg);
+                break;
+            case CACHE_INPUT_CODE:
+                polisher_options.cache_path = optarg;
+                break;
+            case READ_STORE_INPUT_CODE:
+                polisher_options.read_store_path = optarg;
+                break;
+            case NO_PACKING_INPUT_CODE:
+                polisher_options.pack_reads = false;
+                break;
+            case SHARD_INPUT_CODE:
+                if (sscanf(optarg, "%u/%u", &polisher_options.shard,
+                    &polisher_options.num_shards) != 2) {
+                    fprintf(stderr, "[racon::] error: invalid shard %s!\n", optarg);
+                    exit(1);
+                }
+                break;
+            case OUTPUT_INPUT_CODE:
+                output_path = optarg;
+                break;
+            case FASTQ_INPUT_CODE:
+                fastq = true;
+                break;
+            case STATS_JSON_INPUT_CODE:
+                polisher_options.stats_path = optarg;
+                break;
+            case NUMA_INPUT_CODE:
+                polisher_options.numa = true;
+                break;
+            case TARGETS_INPUT_CODE:
+                polisher_options.targets_path = optarg;
+                break;
+            case OVERLAP_INDEX_INPUT_CODE:
+                polisher_options.overlap_index = true;
+                break;
+            case ALIGNER_INPUT_CODE:
+                if (std::string(optarg) == "edlib") {
+                    polisher_options.aligner_type = racon::AlignerType::kEdlib;
+                } else if (std::string(optarg) == "edlib-banded") {
+                    polisher_options.aligner_type = racon::AlignerType::kEdlibBanded;
+                } else if (std::string(optarg) == "edlib-anchored") {
+                    polisher_options.aligner_type = racon::AlignerType::kEdlibAnchored;
+                } else {
+                    fprintf(stderr, "[racon::] error: unknown aligner %s!\n", optarg);
+                    exit(1);
+                }
                 break;
             case 'v':
                 printf("%s\n", version);
@@ -115,22 +221,22 @@ int main(int argc, char** argv) {
 #ifdef CUDA_ENABLED
             case 'c':
                 //if option c encountered, cudapoa_batches initialized with a default value of 1.
-                cudapoa_batches = 1;
+                polisher_options.cuda_batches = 1;
                 // next text entry is not an option, assuming it's the arg for option 'c'
                 if (optarg == NULL && argv[optind] != NULL
                     && argv[optind][0] != '-') {
-                    cudapoa_batches = atoi(argv[optind++]);
+                    polisher_options.cuda_batches = atoi(argv[optind++]);
                 }
                 // optional argument provided in the ususal way
                 if (optarg != NULL) {
-                    cudapoa_batches = atoi(optarg);
+                    polisher_options.cuda_batches = atoi(optarg);
                 }
                 break;
             case 'b':
-                cuda_banded_alignment = true;
+                polisher_options.cuda_banded_alignment = true;
                 break;
             case CUDAALIGNER_INPUT_CODE: // cudaaligner-batches
-                cudaaligner_batches = atoi(optarg);
+                polisher_options.cudaaligner_batches = atoi(optarg);
                 break;
 #endif
             default:
@@ -149,19 +255,18 @@ int main(int argc, char** argv) {
     }
 
     auto polisher = racon::createPolisher(input_paths[0], input_paths[1],
-        input_paths[2], type == 0 ? racon::PolisherType::kC :
-        racon::PolisherType::kF, window_length, overlap_percentage, quality_threshold,
-        error_threshold, trim, match, mismatch, gap, num_threads,
-        cudapoa_batches, cuda_banded_alignment, cudaaligner_batches);
+        input_paths[2], polisher_options);
 
-    polisher->initialize();
+    if (fastq && polisher_options.cuda_batches > 0) {
+        fprintf(stderr, "[racon::] error: consensus qualities are not available "
+            "with CUDA!\n");
+        exit(1);
+    }
 
-    std::vector<std::unique_ptr<racon::Sequence>> polished_sequences;
-    polisher->polish(polished_sequences, drop_unpolished_sequences);
+    polisher->initialize();
 
-    for (const auto& it: polished_sequences) {
-        fprintf(stdout, ">%s\n%s\n", it->name().c_str(), it->data().c_str());
-    }
+    auto sink = racon::createSink(output_path, fastq, polisher_options.num_threads);
+    polisher->polish(*sink, drop_unpolished_sequences);
 
     return 0;
 }
@@ -198,6 +303,11 @@ void help() {
         "        -e, --error-threshold <float>\n"
         "            default: 0.3\n"
         "            maximum allowed error rate used for filtering overlaps\n"
+        "        --max-window-depth <int>\n"
+        "            default: 0\n"
+        "            maximum number of layers per window (0 for no limit),\n"
+        "            layers spanning the whole window and then the ones with\n"
+        "            higher average quality are kept\n"
         "        --no-trimming\n"
         "            disables consensus trimming at window ends\n"
         "        -m, --match <int>\n"
@@ -208,10 +318,96 @@ void help() {
         "            score for mismatching bases\n"
         "        -g, --gap <int>\n"
         "            default: -4\n"
-        "            gap penalty (must be negative)\n"
+        "            gap penalty (must be negative), gap open penalty for\n"
+        "            affine and convex gap models\n"
+        "        --gap-model <string>\n"
+        "            default: linear\n"
+        "            gap model used in POA, one of: linear, affine, convex\n"
+        "        --gap-extend <int>\n"
+        "            default: -2\n"
+        "            gap extend penalty (must be in (gap, 0]), used by affine\n"
+        "            and convex gap models\n"
+        "        --gap-open-2 <int>\n"
+        "            default: -24\n"
+        "            gap open penalty of the second affine function (must be\n"
+        "            lower than gap), used by convex gap model\n"
+        "        --gap-extend-2 <int>\n"
+        "            default: -1\n"
+        "            gap extend penalty of the second affine function (must be\n"
+        "            in (gap-extend, 0]), used by convex gap model\n"
         "        -t, --threads <int>\n"
         "            default: 1\n"
         "            number of threads\n"
+        "        --stream\n"
+        "            polish target sequences while overlaps are being parsed\n"
+        "            (overlaps file has to be sorted by target sequences!), the\n"
+        "            file is scanned beforehand so that reads are kept in memory\n"
+        "            only until their last target sequence is polished\n"
+        "        --unordered\n"
+        "            outputs target sequences as soon as they are polished\n"
+        "            instead of in input order (less memory is held by\n"
+        "            polished windows waiting for a slow target sequence)\n"
+        "        --rounds <int>\n"
+        "            default: 1\n"
+        "            number of polishing rounds, each round polishes the output\n"
+        "            of the previous one with overlaps kept in memory and\n"
+        "            lifted onto it (not available with -f, --stream or CUDA)\n"
+        "        --cache <string>\n"
+        "            file in which aligned overlaps are cached, it is reused in\n"
+        "            later runs with the same input files, window length, window\n"
+        "            overlap percentage, error threshold and aligner (not\n"
+        "            available with --stream or CUDA)\n"
+        "        --read-store <string>\n"
+        "            scratch file into which sequences are packed while they are\n"
+        "            parsed, it is memory mapped so that only accessed sequences\n"
+        "            are kept in memory (removed at exit)\n"
+        "        --no-packing\n"
+        "            keeps reads as plain text instead of 2 bits per base with\n"
+        "            reverse strands decoded on demand (uses more memory, not\n"
+        "            available with --read-store)\n"
+        "        --shard <int>/<int>\n"
+        "            default: 0/1\n"
+        "            polish only target sequences of shard i (0-based) out of N,\n"
+        "            targets are split into consecutive ranges of similar\n"
+        "            polishing cost, concatenated outputs of all shards are\n"
+        "            identical to the output of a single run unless --unordered\n"
+        "            is used (not available with --stream)\n"
+        "        --output <string>\n"
+        "            default: stdout\n"
+        "            output file, compressed with bgzip if it ends with .gz\n"
+        "        --fastq\n"
+        "            output sequences in FASTQ format with consensus qualities\n"
+        "            estimated from the support of each base (not available with\n"
+        "            -p or CUDA)\n"
+        "        --stats-json <string>\n"
+        "            file to which wall and CPU time, peak memory and bytes read\n"
+        "            of each phase and time histograms of alignment, consensus,\n"
+        "            stitching and output tasks are written in JSON format (SIMD\n"
+        "            extensions of the CPU are logged as well)\n"
+        "        --numa\n"
+        "            pins threads to NUMA nodes and polishes target sequences on\n"
+        "            the node their windows are assigned to (windows are taken\n"
+        "            from other nodes only once a node runs out of them, not\n"
+        "            available with CUDA)\n"
+        "        --targets <string>\n"
+        "            file with names of target sequences to polish (one per\n"
+        "            line), others are treated as if they had no overlaps\n"
+        "        --overlap-index\n"
+        "            builds (once) and uses an index of the overlap file stored\n"
+        "            next to it with the suffix .ridx, so that only overlaps of\n"
+        "            target sequences given with --targets or polished by this\n"
+        "            shard are read (PAF and SAM files, either plain or\n"
+        "            compressed with bgzip; shards are then balanced by sizes\n"
+        "            of records of their targets, thus all shards have to use\n"
+        "            it), files which are not sorted by target sequences are read\n"
+        "            whole, as are those in which overlaps of one read span\n"
+        "            selected and other targets in consensus mode\n"
+        "        --aligner <string>\n"
+        "            default: edlib\n"
+        "            aligner used for overlaps without CIGAR strings, one of:\n"
+        "            edlib, edlib-banded (band from the overlap error estimate),\n"
+        "            edlib-anchored (edlib-banded on segments of long overlaps\n"
+        "            split at exact k-mer matches, bounds memory usage)\n"
         "        --version\n"
         "            prints the version number\n"
         "        -h, --help\n"
@@ -0,0 +1,103 @@
+/*!
+ * @file name_index.cpp
+ *
+ * @brief NameIndex class source file
+ */
+
+#include <string.h>
+
+#include "name_index.hpp"
+
+namespace racon {
+
+constexpr uint64_t kEmptyId = -1;
+constexpr uint64_t kInitialNumSlots = 1024; // has to be a power of 2
+
+uint64_t hashName(const char* name, uint32_t length) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (uint32_t i = 0; i < length; ++i) {
+        hash ^= static_cast<uint8_t>(name[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+NameIndex::NameIndex()
+        : names_(), slots_(), num_names_(0) {
+}
+
+uint64_t NameIndex::find_slot(const char* name, uint32_t length,
+    uint64_t hash) const {
+
+    uint64_t mask = slots_.size() - 1;
+    for (uint64_t i = hash & mask;; i = (i + 1) & mask) {
+        const auto& slot = slots_[i];
+        if (slot.ids[0] == kEmptyId && slot.ids[1] == kEmptyId) {
+            return i;
+        }
+        if (slot.hash == hash && slot.length == length &&
+            memcmp(&(names_[slot.begin]), name, length) == 0) {
+            return i;
+        }
+    }
+}
+
+void NameIndex::rehash(uint64_t num_slots) {
+
+    std::vector<Slot> slots(num_slots, Slot{0, 0, 0, {kEmptyId, kEmptyId}});
+    slots_.swap(slots);
+
+    uint64_t mask = slots_.size() - 1;
+    for (const auto& it: slots) {
+        if (it.ids[0] == kEmptyId && it.ids[1] == kEmptyId) {
+            continue;
+        }
+        uint64_t i = it.hash & mask;
+        while (slots_[i].ids[0] != kEmptyId || slots_[i].ids[1] != kEmptyId) {
+            i = (i + 1) & mask;
+        }
+        slots_[i] = it;
+    }
+}
+
+void NameIndex::insert(const std::string& name, bool is_target, uint64_t id) {
+
+    if ((num_names_ + 1) * 10 > slots_.size() * 7) {
+        rehash(slots_.empty() ? kInitialNumSlots : slots_.size() * 2);
+    }
+
+    uint64_t hash = hashName(name.c_str(), name.size());
+    auto& slot = slots_[find_slot(name.c_str(), name.size(), hash)];
+    if (slot.ids[0] == kEmptyId && slot.ids[1] == kEmptyId) {
+        slot.hash = hash;
+        slot.begin = names_.size();
+        slot.length = name.size();
+        names_.append(name);
+        ++num_names_;
+    }
+    slot.ids[is_target] = id;
+}
+
+bool NameIndex::find(const std::string& name, bool is_target, uint64_t& id) const {
+
+    if (slots_.empty()) {
+        return false;
+    }
+
+    const auto& slot = slots_[find_slot(name.c_str(), name.size(),
+        hashName(name.c_str(), name.size()))];
+    if (slot.ids[is_target] == kEmptyId) {
+        return false;
+    }
+    id = slot.ids[is_target];
+    return true;
+}
+
+void NameIndex::clear() {
+    std::string().swap(names_);
+    std::vector<Slot>().swap(slots_);
+    num_names_ = 0;
+}
+
+}
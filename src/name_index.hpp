@@ -0,0 +1,52 @@
+/*!
+ * @file name_index.hpp
+ *
+ * @brief NameIndex class header file
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace racon {
+
+/*!
+ * @brief Open addressing hash table which maps sequence names to their ids,
+ * separately as target and as query sequence. Names are interned into a
+ * single buffer so that lookups do not allocate.
+ */
+class NameIndex {
+public:
+    NameIndex();
+    ~NameIndex() = default;
+
+    uint64_t size() const {
+        return num_names_;
+    }
+
+    void insert(const std::string& name, bool is_target, uint64_t id);
+
+    // returns false if the name was not inserted with the same flag
+    bool find(const std::string& name, bool is_target, uint64_t& id) const;
+
+    void clear();
+
+private:
+    struct Slot {
+        uint64_t hash;
+        uint64_t begin;
+        uint32_t length;
+        uint64_t ids[2];
+    };
+
+    uint64_t find_slot(const char* name, uint32_t length, uint64_t hash) const;
+    void rehash(uint64_t num_slots);
+
+    std::string names_;
+    std::vector<Slot> slots_;
+    uint64_t num_names_;
+};
+
+}
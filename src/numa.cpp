@@ -0,0 +1,104 @@
+/*!
+ * @file numa.cpp
+ *
+ * @brief NUMA topology and thread placement source file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "numa.hpp"
+
+namespace racon {
+
+// parses lists like 0-3,8-11
+std::vector<uint32_t> parseCpuList(const char* list) {
+
+    std::vector<uint32_t> dst;
+    const char* it = list;
+    while (*it != '\0' && *it != '\n') {
+        char* end = nullptr;
+        uint32_t begin = strtoul(it, &end, 10);
+        if (end == it) {
+            break;
+        }
+        uint32_t last = begin;
+        if (*end == '-') {
+            it = end + 1;
+            last = strtoul(it, &end, 10);
+        }
+        for (uint32_t i = begin; i <= last; ++i) {
+            dst.emplace_back(i);
+        }
+        it = *end == ',' ? end + 1 : end;
+    }
+    return dst;
+}
+
+std::vector<std::vector<uint32_t>> numaNodes() {
+
+    std::vector<std::pair<uint32_t, std::vector<uint32_t>>> nodes;
+
+    DIR* dir = opendir("/sys/devices/system/node");
+    if (dir == nullptr) {
+        return std::vector<std::vector<uint32_t>>();
+    }
+    struct dirent* entry = nullptr;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (strncmp(entry->d_name, "node", 4) != 0 ||
+            entry->d_name[4] < '0' || entry->d_name[4] > '9') {
+            continue;
+        }
+        std::string path = std::string("/sys/devices/system/node/") +
+            entry->d_name + "/cpulist";
+        FILE* file = fopen(path.c_str(), "r");
+        if (file == nullptr) {
+            continue;
+        }
+        char line[4096];
+        if (fgets(line, sizeof(line), file) != nullptr) {
+            auto cpus = parseCpuList(line);
+            if (!cpus.empty()) {
+                nodes.emplace_back(atoi(entry->d_name + 4), cpus);
+            }
+        }
+        fclose(file);
+    }
+    closedir(dir);
+
+    std::sort(nodes.begin(), nodes.end());
+
+    std::vector<std::vector<uint32_t>> dst;
+    for (auto& it: nodes) {
+        dst.emplace_back(std::move(it.second));
+    }
+    return dst;
+}
+
+bool pinThread(const std::vector<uint32_t>& cpus) {
+
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const auto& it: cpus) {
+        if (it < CPU_SETSIZE) {
+            CPU_SET(it, &set);
+        }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void) cpus;
+    return false;
+#endif
+}
+
+}
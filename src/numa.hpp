@@ -0,0 +1,22 @@
+/*!
+ * @file numa.hpp
+ *
+ * @brief NUMA topology and thread placement header file
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+namespace racon {
+
+// CPUs of each NUMA node as listed in /sys/devices/system/node (nodes
+// without CPUs are skipped), empty if the topology is not available
+std::vector<std::vector<uint32_t>> numaNodes();
+
+// restricts the calling thread to the given CPUs, memory it touches first is
+// then placed on their node by the default kernel policy
+bool pinThread(const std::vector<uint32_t>& cpus);
+
+}
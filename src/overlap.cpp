@@ -6,12 +6,52 @@
 
 #include <algorithm>
 
+#include "arena.hpp"
 #include "sequence.hpp"
+#include "name_index.hpp"
+#include "aligner.hpp"
 #include "overlap.hpp"
-#include "edlib.h"
 
 namespace racon {
 
+Arena& overlap_arena() {
+    static Arena arena(sizeof(Overlap), 4096);
+    return arena;
+}
+
+void* Overlap::operator new(std::size_t size) {
+    if (size != sizeof(Overlap)) {
+        return ::operator new(size);
+    }
+    return overlap_arena().allocate();
+}
+
+void Overlap::operator delete(void* ptr, std::size_t size) {
+    if (size != sizeof(Overlap)) {
+        ::operator delete(ptr);
+        return;
+    }
+    overlap_arena().deallocate(ptr);
+}
+
+std::unique_ptr<Overlap> createOverlap(uint64_t q_id, uint32_t q_begin,
+    uint32_t q_end, uint32_t q_length, bool strand, uint64_t t_id,
+    uint32_t t_begin, uint32_t t_end, uint32_t t_length,
+    const std::string& cigar) {
+
+    if (q_begin >= q_end || q_end > q_length || t_begin >= t_end ||
+        t_end > t_length) {
+        fprintf(stderr, "[racon::createOverlap] error: invalid overlap!\n");
+        exit(1);
+    }
+
+    // ids are 1-based as in MHAP
+    std::unique_ptr<Overlap> overlap(new Overlap(q_id + 1, t_id + 1, 0, 0,
+        strand, q_begin, q_end, q_length, 0, t_begin, t_end, t_length));
+    overlap->cigar_ = cigar;
+    return overlap;
+}
+
 Overlap::Overlap(uint64_t a_id, uint64_t b_id, double, uint32_t,
     uint32_t a_rc, uint32_t a_begin, uint32_t a_end, uint32_t a_length,
     uint32_t b_rc, uint32_t b_begin, uint32_t b_end, uint32_t b_length)
@@ -111,7 +151,7 @@ Overlap::Overlap()
         : q_name_(), q_id_(), q_begin_(), q_end_(), q_length_(), t_name_(),
         t_id_(), t_begin_(), t_end_(), t_length_(), strand_(), length_(),
         error_(), cigar_(), is_valid_(true), is_transmuted_(true),
-        breaking_points_(), dual_breaking_points_() {
+        breaking_points_() {
 }
 
 template<typename T>
@@ -127,7 +167,7 @@ bool transmuteId(const std::unordered_map<T, uint64_t>& t_to_id, const T& t,
 }
 
 void Overlap::transmute(const std::vector<std::unique_ptr<Sequence>>& sequences,
-    const std::unordered_map<std::string, uint64_t>& name_to_id,
+    const NameIndex& name_to_id,
     const std::unordered_map<uint64_t, uint64_t>& id_to_id) {
 
     if (!is_valid_ || is_transmuted_) {
@@ -135,7 +175,7 @@ void Overlap::transmute(const std::vector<std::unique_ptr<Sequence>>& sequences,
     }
 
     if (!q_name_.empty()) {
-        if (!transmuteId(name_to_id, q_name_ + "q", q_id_)) {
+        if (!name_to_id.find(q_name_, false, q_id_)) {
             is_valid_ = false;
             return;
         }
@@ -145,7 +185,7 @@ void Overlap::transmute(const std::vector<std::unique_ptr<Sequence>>& sequences,
         return;
     }
 
-    if (q_length_ != sequences[q_id_]->data().size()) {
+    if (q_length_ != sequences[q_id_]->length()) {
         fprintf(stderr, "[racon::Overlap::transmute] error: "
             "unequal lengths in sequence and overlap file for sequence %s!\n",
             sequences[q_id_]->name().c_str());
@@ -153,7 +193,7 @@ void Overlap::transmute(const std::vector<std::unique_ptr<Sequence>>& sequences,
     }
 
     if (!t_name_.empty()) {
-        if (!transmuteId(name_to_id, t_name_ + "t", t_id_)) {
+        if (!name_to_id.find(t_name_, true, t_id_)) {
             is_valid_ = false;
             return;
         }
@@ -163,7 +203,7 @@ void Overlap::transmute(const std::vector<std::unique_ptr<Sequence>>& sequences,
         return;
     }
 
-    if (t_length_ != 0 && t_length_ != sequences[t_id_]->data().size()) {
+    if (t_length_ != 0 && t_length_ != sequences[t_id_]->length()) {
         fprintf(stderr, "[racon::Overlap::transmute] error: "
             "unequal lengths in target and overlap file for target %s!\n",
             sequences[t_id_]->name().c_str());
@@ -171,13 +211,77 @@ void Overlap::transmute(const std::vector<std::unique_ptr<Sequence>>& sequences,
     }
 
     // for SAM input
-    t_length_ = sequences[t_id_]->data().size();
+    t_length_ = sequences[t_id_]->length();
 
     is_transmuted_ = true;
 }
 
+bool Overlap::is_reciprocal(const Overlap& other) const {
+
+    if (q_id_ != other.t_id_ || t_id_ != other.q_id_ || strand_ != other.strand_) {
+        return false;
+    }
+    auto is_close = [](uint32_t lhs, uint32_t rhs, uint32_t tolerance) -> bool {
+        return (lhs > rhs ? lhs - rhs : rhs - lhs) <= tolerance;
+    };
+    uint32_t q_tolerance = 0.01 * std::max(q_end_ - q_begin_, other.t_end_ - other.t_begin_);
+    uint32_t t_tolerance = 0.01 * std::max(t_end_ - t_begin_, other.q_end_ - other.q_begin_);
+    return is_close(q_begin_, other.t_begin_, q_tolerance) &&
+        is_close(q_end_, other.t_end_, q_tolerance) &&
+        is_close(t_begin_, other.q_begin_, t_tolerance) &&
+        is_close(t_end_, other.q_end_, t_tolerance);
+}
+
+void Overlap::clear_alignment() {
+    std::string().swap(cigar_);
+    breaking_points_.clear();
+}
+
+void Overlap::lift(const std::vector<std::pair<uint32_t, uint32_t>>& anchors,
+    const std::vector<std::pair<uint32_t, uint32_t>>& unchanged_spans) {
+
+    if (anchors.empty()) {
+        is_valid_ = false;
+        return;
+    }
+
+    // the alignment depends only on the target span and window boundaries,
+    // neither of which moves inside an unchanged span
+    auto span = std::upper_bound(unchanged_spans.begin(), unchanged_spans.end(),
+        t_begin_, [](uint32_t lhs, const std::pair<uint32_t, uint32_t>& rhs) -> bool {
+            return lhs < rhs.first; });
+    bool is_unchanged = span != unchanged_spans.begin() &&
+        (span - 1)->first <= t_begin_ && t_end_ <= (span - 1)->second;
+
+    auto lift_position = [&](uint32_t position) -> uint32_t {
+        auto next = std::upper_bound(anchors.begin(), anchors.end(), position,
+            [](uint32_t lhs, const std::pair<uint32_t, uint32_t>& rhs) -> bool {
+                return lhs < rhs.first; });
+        if (next == anchors.begin()) {
+            return anchors.front().second;
+        }
+        if (next == anchors.end()) {
+            return anchors.back().second;
+        }
+        auto prev = next - 1;
+        return prev->second + static_cast<uint64_t>(position - prev->first) *
+            (next->second - prev->second) / (next->first - prev->first);
+    };
+
+    t_begin_ = lift_position(t_begin_);
+    t_end_ = lift_position(t_end_);
+    t_length_ = anchors.back().second;
+
+    if (t_begin_ >= t_end_) {
+        is_valid_ = false;
+    }
+    if (!is_unchanged) {
+        clear_alignment();
+    }
+}
+
 void Overlap::find_breaking_points(const std::vector<std::unique_ptr<Sequence>> &sequences, uint32_t window_length,
-                                   double p) {
+                                   double p, const Aligner& aligner, Overlap* reciprocal) {
 
     if (!is_transmuted_) {
         fprintf(stderr, "[racon::Overlap::find_breaking_points] error: "
@@ -189,42 +293,137 @@ void Overlap::find_breaking_points(const std::vector<std::unique_ptr<Sequence>>
         return;
     }
 
+    // runs of operations are kept only if they are needed for reciprocal
+    std::vector<std::pair<char, uint32_t>> runs;
+
     if (cigar_.empty()) {
-        const char* q = !strand_ ? &(sequences[q_id_]->data()[q_begin_]) :
-            &(sequences[q_id_]->reverse_complement()[q_length_ - q_end_]);
+        std::string buffer;
+        const char* q = sequences[q_id_]->data(strand_, !strand_ ? q_begin_ :
+            q_length_ - q_end_, q_end_ - q_begin_, buffer);
         const char* t = &(sequences[t_id_]->data()[t_begin_]);
 
-        align_overlaps(q, q_end_ - q_begin_, t, t_end_ - t_begin_);
+        std::vector<uint8_t> ops;
+        align_overlaps(aligner, q, q_end_ - q_begin_, t, t_end_ - t_begin_, ops);
+
+        // operations are grouped into runs as they are consumed
+        const char* op_to_cigar = "MIDM";
+        uint64_t i = 0;
+        find_breaking_points_from_ops(window_length, p,
+            [&](char& op, uint32_t& num_bases) -> bool {
+                if (i == ops.size()) {
+                    return false;
+                }
+                op = op_to_cigar[ops[i]];
+                for (num_bases = 0; i < ops.size() && op_to_cigar[ops[i]] == op; ++i) {
+                    ++num_bases;
+                }
+                if (reciprocal != nullptr) {
+                    runs.emplace_back(op, num_bases);
+                }
+                return true;
+            });
+    } else if (reciprocal != nullptr) {
+        uint32_t num_bases = 0;
+        for (const auto& it: cigar_) {
+            if (isdigit(it)) {
+                num_bases = num_bases * 10 + (it - '0');
+            } else {
+                runs.emplace_back(it, num_bases);
+                num_bases = 0;
+            }
+        }
+        uint64_t i = 0;
+        find_breaking_points_from_ops(window_length, p,
+            [&](char& op, uint32_t& num_bases) -> bool {
+                if (i == runs.size()) {
+                    return false;
+                }
+                op = runs[i].first;
+                num_bases = runs[i++].second;
+                return true;
+            });
+        std::string().swap(cigar_);
+    } else {
+        find_breaking_points_from_cigar(window_length, p);
+        std::string().swap(cigar_);
     }
 
-    find_breaking_points_from_cigar(window_length, p);
+    if (reciprocal != nullptr) {
+        reciprocal->find_reciprocal_breaking_points(*this, runs, window_length, p);
+    }
+}
 
+void Overlap::find_reciprocal_breaking_points(const Overlap& overlap,
+    std::vector<std::pair<char, uint32_t>>& runs, uint32_t window_length,
+    double p) {
+
+    q_begin_ = overlap.t_begin_;
+    q_end_ = overlap.t_end_;
+    q_length_ = overlap.t_length_;
+    t_begin_ = overlap.q_begin_;
+    t_end_ = overlap.q_end_;
+    t_length_ = overlap.q_length_;
+    strand_ = overlap.strand_;
+    length_ = overlap.length_;
+    error_ = overlap.error_;
     std::string().swap(cigar_);
+
+    // insertions become deletions and vice versa, if the query was reverse
+    // complemented the whole alignment is, which reverses it
+    for (auto& it: runs) {
+        if (it.first == 'I') {
+            it.first = 'D';
+        } else if (it.first == 'D' || it.first == 'N') {
+            it.first = 'I';
+        }
+    }
+    if (strand_) {
+        std::reverse(runs.begin(), runs.end());
+    }
+
+    uint64_t i = 0;
+    find_breaking_points_from_ops(window_length, p,
+        [&](char& op, uint32_t& num_bases) -> bool {
+            if (i == runs.size()) {
+                return false;
+            }
+            op = runs[i].first;
+            num_bases = runs[i++].second;
+            return true;
+        });
 }
 
-void Overlap::align_overlaps(const char* q, uint32_t q_length, const char* t, uint32_t t_length)
+void Overlap::align_overlaps(const Aligner& aligner, const char* q, uint32_t q_length,
+    const char* t, uint32_t t_length, std::vector<uint8_t>& ops)
 {
-    // align overlaps with edlib
-    EdlibAlignResult result = edlibAlign(q, q_length, t, t_length,
-            edlibNewAlignConfig(-1, EDLIB_MODE_NW, EDLIB_TASK_PATH,
-                nullptr, 0));
-
-    if (result.status == EDLIB_STATUS_OK) {
-        char* cigar = edlibAlignmentToCigar(result.alignment,
-                result.alignmentLength, EDLIB_CIGAR_STANDARD);
-        cigar_ = cigar;
-        free(cigar);
-    } else {
+    if (!aligner.align(q, q_length, t, t_length, error_, ops)) {
         fprintf(stderr, "[racon::Overlap::find_breaking_points] error: "
                 "edlib unable to align pair (%zu x %zu)!\n", q_id_, t_id_);
         exit(1);
     }
-
-    edlibFreeAlignResult(result);
 }
 
 void Overlap::find_breaking_points_from_cigar(uint32_t window_length, double p) {
-    // find breaking points from cigar
+
+    // run-length decoded, operations are consumed as they are parsed
+    uint32_t i = 0;
+    find_breaking_points_from_ops(window_length, p,
+        [&](char& op, uint32_t& num_bases) -> bool {
+            num_bases = 0;
+            for (; i < cigar_.size() && isdigit(cigar_[i]); ++i) {
+                num_bases = num_bases * 10 + (cigar_[i] - '0');
+            }
+            if (i == cigar_.size()) {
+                return false;
+            }
+            op = cigar_[i++];
+            return true;
+        });
+}
+
+void Overlap::find_breaking_points_from_ops(uint32_t window_length, double p,
+    const std::function<bool(char&, uint32_t&)>& next_op) {
+
     std::vector<int32_t> window_starts;
     std::vector<int32_t> window_ends;
     int32_t offset = window_length * p;
@@ -250,9 +449,11 @@ void Overlap::find_breaking_points_from_cigar(uint32_t window_length, double p)
     int32_t q_ptr = (strand_ ? (q_length_ - q_end_) : q_begin_) - 1;
     int32_t t_ptr = t_begin_ - 1;
 
-    for (uint32_t i = 0, j = 0; i < cigar_.size(); ++i) {
-        if (cigar_[i] == 'M' || cigar_[i] == '=' || cigar_[i] == 'X') {
-            uint32_t k = 0, num_bases = atoi(&cigar_[j]);
+    char op;
+    uint32_t num_bases;
+    while (next_op(op, num_bases)) {
+        if (op == 'M' || op == '=' || op == 'X') {
+            uint32_t k = 0;
             while (k < num_bases) {
                 ++q_ptr;
                 ++t_ptr;
@@ -270,8 +471,8 @@ void Overlap::find_breaking_points_from_cigar(uint32_t window_length, double p)
                 last_match.first = t_ptr + 1;
                 last_match.second = q_ptr + 1;
                 if (t_ptr == window_ends[w]) {
-                    breaking_points_.emplace_back(first_match);
-                    breaking_points_.emplace_back(last_match);
+                    breaking_points_.push_back(first_match.first, first_match.second);
+                    breaking_points_.push_back(last_match.first, last_match.second);
                     if (found_first_match_n) {
                         first_match = first_match_n;
                         found_first_match = found_first_match_n;
@@ -284,18 +485,16 @@ void Overlap::find_breaking_points_from_cigar(uint32_t window_length, double p)
 
                 ++k;
             }
-            j = i + 1;
-        } else if (cigar_[i] == 'I') {
-            q_ptr += atoi(&cigar_[j]);
-            j = i + 1;
-        } else if (cigar_[i] == 'D' || cigar_[i] == 'N') {
-            uint32_t k = 0, num_bases = atoi(&cigar_[j]);
+        } else if (op == 'I') {
+            q_ptr += num_bases;
+        } else if (op == 'D' || op == 'N') {
+            uint32_t k = 0;
             while (k < num_bases) {
                 ++t_ptr;
                 if (t_ptr == window_ends[w]) {
                     if (found_first_match) {
-                        breaking_points_.emplace_back(first_match);
-                        breaking_points_.emplace_back(last_match);
+                        breaking_points_.push_back(first_match.first, first_match.second);
+                        breaking_points_.push_back(last_match.first, last_match.second);
                     }
                     if (found_first_match_n) {
                         first_match = first_match_n;
@@ -308,10 +507,8 @@ void Overlap::find_breaking_points_from_cigar(uint32_t window_length, double p)
                 }
                 ++k;
             }
-            j = i + 1;
-        } else if (cigar_[i] == 'S' || cigar_[i] == 'H' || cigar_[i] == 'P') {
-            j = i + 1;
         }
+        // S, H and P consume neither sequence
     }
 }
 
@@ -8,12 +8,16 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <cstddef>
 #include <memory>
 #include <vector>
 #include <string>
 #include <utility>
+#include <functional>
 #include <unordered_map>
 
+#include "breaking_points.hpp"
+
 namespace bioparser {
     template<class T>
     class MhapParser;
@@ -28,11 +32,27 @@ namespace bioparser {
 namespace racon {
 
 class Sequence;
+class NameIndex;
+class Aligner;
+
+class Overlap;
+// q_id and t_id are indices of the read and the target sequence in the order
+// in which they are given to the polisher, positions are 0-based on forward
+// strands and the optional CIGAR string aligns [q_begin, q_end) of the read
+// (reverse complemented if strand is set) to [t_begin, t_end) of the target
+std::unique_ptr<Overlap> createOverlap(uint64_t q_id, uint32_t q_begin,
+    uint32_t q_end, uint32_t q_length, bool strand, uint64_t t_id,
+    uint32_t t_begin, uint32_t t_end, uint32_t t_length,
+    const std::string& cigar = "");
 
 class Overlap {
 public:
     ~Overlap() = default;
 
+    // objects are allocated from a chunked arena shared by all overlaps
+    static void* operator new(std::size_t size);
+    static void operator delete(void* ptr, std::size_t size);
+
     uint32_t q_id() const {
         return q_id_;
     }
@@ -50,7 +70,7 @@ public:
     }
 
     void transmute(const std::vector<std::unique_ptr<Sequence>>& sequences,
-        const std::unordered_map<std::string, uint64_t>& name_to_id,
+        const NameIndex& name_to_id,
         const std::unordered_map<uint64_t, uint64_t>& id_to_id);
 
     uint32_t length() const {
@@ -61,17 +81,57 @@ public:
         return error_;
     }
 
-    const std::vector<std::pair<uint32_t, uint32_t>>& breaking_points() const {
+    const BreakingPoints& breaking_points() const {
         return breaking_points_;
     }
 
+    // true if the overlap has a CIGAR string or breaking points
+    bool has_alignment() const {
+        return !cigar_.empty() || !breaking_points_.empty();
+    }
+
+    bool has_cigar() const {
+        return !cigar_.empty();
+    }
+
+    // true if other is the overlap of the same pair of sequences and strand
+    // with swapped roles whose ranges match the swapped ones of this overlap
+    // up to 1% of their lengths
+    bool is_reciprocal(const Overlap& other) const;
+
+    // drops breaking points and the CIGAR string so that the overlap can be
+    // aligned again once its target changes
+    void clear_alignment();
+
+    // maps target coordinates onto a new version of the target given pairs
+    // of corresponding old and new positions sorted by both (interpolated
+    // linearly between pairs), invalidates the overlap if it vanishes;
+    // breaking points are kept if the target span lies inside one of
+    // unchanged_spans (sorted spans [begin, end) with equal content at equal
+    // positions in both versions), otherwise the alignment is cleared
+    void lift(const std::vector<std::pair<uint32_t, uint32_t>>& anchors,
+        const std::vector<std::pair<uint32_t, uint32_t>>& unchanged_spans =
+            std::vector<std::pair<uint32_t, uint32_t>>());
+
+    // aligner is used only if the overlap has no CIGAR string, breaking
+    // points of reciprocal (the overlap of the same pair of sequences with
+    // swapped roles, its coordinates and CIGAR string are replaced by the
+    // swapped ones) are derived from the same alignment
     void find_breaking_points(const std::vector<std::unique_ptr<Sequence>> &sequences, uint32_t window_length,
-                              double p);
+                              double p, const Aligner& aligner, Overlap* reciprocal = nullptr);
 
     friend bioparser::MhapParser<Overlap>;
     friend bioparser::PafParser<Overlap>;
     friend bioparser::SamParser<Overlap>;
 
+    friend std::unique_ptr<Overlap> createOverlap(uint64_t q_id,
+        uint32_t q_begin, uint32_t q_end, uint32_t q_length, bool strand,
+        uint64_t t_id, uint32_t t_begin, uint32_t t_end, uint32_t t_length,
+        const std::string& cigar);
+
+    friend class OverlapCache;
+    friend class IndexedOverlapSource;
+
 #ifdef CUDA_ENABLED
     friend class CUDABatchAligner;
 #endif
@@ -94,7 +154,17 @@ private:
     Overlap(const Overlap&) = delete;
     const Overlap& operator=(const Overlap&) = delete;
     virtual void find_breaking_points_from_cigar(uint32_t window_length, double p);
-    virtual void align_overlaps(const char* q, uint32_t q_len, const char* t, uint32_t t_len);
+    virtual void align_overlaps(const Aligner& aligner, const char* q, uint32_t q_len,
+        const char* t, uint32_t t_len, std::vector<uint8_t>& ops);
+    // walks runs of CIGAR operations returned by next_op until it returns
+    // false, breaking points are found without storing the whole alignment
+    void find_breaking_points_from_ops(uint32_t window_length, double p,
+        const std::function<bool(char&, uint32_t&)>& next_op);
+    // runs of CIGAR operations of overlap which aligns q to t are turned
+    // into the alignment of t to q
+    void find_reciprocal_breaking_points(const Overlap& overlap,
+        std::vector<std::pair<char, uint32_t>>& runs, uint32_t window_length,
+        double p);
 
     std::string q_name_;
     uint64_t q_id_;
@@ -115,8 +185,7 @@ private:
 
     bool is_valid_;
     bool is_transmuted_;
-    std::vector<std::pair<uint32_t, uint32_t>> breaking_points_;
-    std::vector<std::pair<uint32_t, uint32_t>> dual_breaking_points_;
+    BreakingPoints breaking_points_;
 };
 
 }
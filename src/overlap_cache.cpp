@@ -0,0 +1,237 @@
+/*!
+ * @file overlap_cache.cpp
+ *
+ * @brief OverlapCache class source file
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "overlap.hpp"
+#include "overlap_cache.hpp"
+
+namespace racon {
+
+constexpr char kCacheMagic[8] = { 'R', 'A', 'C', 'O', 'N', 'O', 'C', 2 };
+// key, number of overlaps, targets begin and end
+constexpr uint64_t kCacheHeaderSize = sizeof(kCacheMagic) + 4 * sizeof(uint64_t);
+constexpr uint32_t kFingerprintSize = 1024 * 1024; // 1MB
+// q_id, q_begin, q_end, q_length, t_id, t_begin, t_end, t_length, strand
+constexpr uint32_t kNumRecordFields = 9;
+
+void hashBytes(const char* data, uint64_t length, uint64_t& hash) {
+    // FNV-1a
+    for (uint64_t i = 0; i < length; ++i) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+}
+
+uint64_t overlapCacheKey(const std::vector<std::string>& paths,
+    const std::string& parameters) {
+
+    uint64_t hash = 14695981039346656037ULL;
+    hashBytes(parameters.c_str(), parameters.size(), hash);
+
+    std::vector<char> buffer(kFingerprintSize);
+    for (const auto& it: paths) {
+        struct stat info;
+        if (stat(it.c_str(), &info) != 0) {
+            fprintf(stderr, "[racon::overlapCacheKey] error: "
+                "unable to access file %s!\n", it.c_str());
+            exit(1);
+        }
+        uint64_t size = info.st_size, time = info.st_mtime;
+        hashBytes(reinterpret_cast<const char*>(&size), sizeof(size), hash);
+        hashBytes(reinterpret_cast<const char*>(&time), sizeof(time), hash);
+
+        FILE* file = fopen(it.c_str(), "rb");
+        if (file == nullptr) {
+            fprintf(stderr, "[racon::overlapCacheKey] error: "
+                "unable to open file %s!\n", it.c_str());
+            exit(1);
+        }
+        uint64_t length = fread(buffer.data(), 1, buffer.size(), file);
+        hashBytes(buffer.data(), length, hash);
+        if (size > kFingerprintSize && fseek(file, -static_cast<int64_t>(
+            kFingerprintSize), SEEK_END) == 0) {
+
+            length = fread(buffer.data(), 1, buffer.size(), file);
+            hashBytes(buffer.data(), length, hash);
+        }
+        fclose(file);
+    }
+
+    return hash;
+}
+
+OverlapCache::OverlapCache(const std::string& path, uint64_t key)
+        : path_(path), key_(key), file_(nullptr), num_overlaps_(0),
+        is_written_(true), mutex_() {
+}
+
+OverlapCache::~OverlapCache() {
+    if (file_ != nullptr) {
+        fclose(file_);
+        remove((path_ + ".tmp").c_str());
+    }
+}
+
+bool OverlapCache::load(std::vector<std::unique_ptr<Overlap>>& dst,
+    uint64_t& targets_begin, uint64_t& targets_end) const {
+
+    int fd = open(path_.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<uint64_t>(info.st_size) < kCacheHeaderSize) {
+        close(fd);
+        return false;
+    }
+    uint64_t size = info.st_size;
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    const char* data = static_cast<const char*>(map);
+    uint64_t header[4] = { 0 };
+    memcpy(header, data + sizeof(kCacheMagic), sizeof(header));
+    uint64_t num_overlaps = header[1];
+    if (memcmp(data, kCacheMagic, sizeof(kCacheMagic)) != 0 || header[0] != key_) {
+        munmap(map, size);
+        return false;
+    }
+
+    // records are written in completion order
+    std::vector<std::unique_ptr<Overlap>> overlaps(num_overlaps);
+    uint64_t offset = kCacheHeaderSize;
+    uint32_t fields[kNumRecordFields + 1];
+    bool is_valid = true;
+    for (uint64_t n = 0; n < num_overlaps; ++n) {
+        uint64_t i = 0;
+        if (offset + sizeof(i) + sizeof(fields) > size) {
+            is_valid = false;
+            break;
+        }
+        memcpy(&i, data + offset, sizeof(i));
+        memcpy(fields, data + offset + sizeof(i), sizeof(fields));
+        offset += sizeof(i) + sizeof(fields);
+
+        uint64_t num_breaking_points = fields[kNumRecordFields];
+        if (i >= num_overlaps || overlaps[i] != nullptr || offset +
+            num_breaking_points * 2 * sizeof(uint32_t) > size) {
+            is_valid = false;
+            break;
+        }
+
+        std::unique_ptr<Overlap> overlap(new Overlap());
+        overlap->q_id_ = fields[0];
+        overlap->q_begin_ = fields[1];
+        overlap->q_end_ = fields[2];
+        overlap->q_length_ = fields[3];
+        overlap->t_id_ = fields[4];
+        overlap->t_begin_ = fields[5];
+        overlap->t_end_ = fields[6];
+        overlap->t_length_ = fields[7];
+        overlap->strand_ = fields[8];
+        for (uint64_t j = 0; j < num_breaking_points; ++j) {
+            uint32_t t_position = 0, q_position = 0;
+            memcpy(&t_position, data + offset, sizeof(uint32_t));
+            memcpy(&q_position, data + offset + sizeof(uint32_t), sizeof(uint32_t));
+            overlap->breaking_points_.push_back(t_position, q_position);
+            offset += 2 * sizeof(uint32_t);
+        }
+        overlaps[i] = std::move(overlap);
+    }
+    munmap(map, size);
+
+    if (!is_valid) {
+        fprintf(stderr, "[racon::OverlapCache::load] warning: "
+            "file %s is corrupted, ignoring it\n", path_.c_str());
+        return false;
+    }
+
+    for (auto& it: overlaps) {
+        dst.emplace_back(std::move(it));
+    }
+    targets_begin = header[2];
+    targets_end = header[3];
+    return true;
+}
+
+void OverlapCache::store(uint64_t i, const Overlap& overlap) {
+
+    uint32_t fields[kNumRecordFields + 1] = {
+        static_cast<uint32_t>(overlap.q_id_), overlap.q_begin_, overlap.q_end_,
+        overlap.q_length_, static_cast<uint32_t>(overlap.t_id_), overlap.t_begin_,
+        overlap.t_end_, overlap.t_length_, overlap.strand_,
+        static_cast<uint32_t>(overlap.breaking_points_.size())
+    };
+
+    auto breaking_points = overlap.breaking_points_.decode();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    create_file();
+
+    if (!is_written_) {
+        return;
+    }
+
+    is_written_ &= fwrite(&i, sizeof(i), 1, file_) == 1;
+    is_written_ &= fwrite(fields, sizeof(fields), 1, file_) == 1;
+    for (const auto& it: breaking_points) {
+        is_written_ &= fwrite(&it.first, sizeof(it.first), 1, file_) == 1;
+        is_written_ &= fwrite(&it.second, sizeof(it.second), 1, file_) == 1;
+    }
+    ++num_overlaps_;
+}
+
+void OverlapCache::create_file() {
+
+    if (file_ != nullptr) {
+        return;
+    }
+
+    file_ = fopen((path_ + ".tmp").c_str(), "wb");
+    if (file_ == nullptr) {
+        fprintf(stderr, "[racon::OverlapCache::create_file] error: "
+            "unable to create file %s.tmp!\n", path_.c_str());
+        exit(1);
+    }
+    uint64_t header[4] = { key_, 0, 0, 0 };
+    is_written_ &= fwrite(kCacheMagic, sizeof(kCacheMagic), 1, file_) == 1;
+    is_written_ &= fwrite(header, sizeof(header), 1, file_) == 1;
+}
+
+void OverlapCache::finish(uint64_t targets_begin, uint64_t targets_end) {
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    create_file();
+
+    // the number of overlaps marks the cache as complete
+    uint64_t header[3] = { num_overlaps_, targets_begin, targets_end };
+    if (is_written_) {
+        is_written_ &= fseek(file_, sizeof(kCacheMagic) + sizeof(key_), SEEK_SET) == 0;
+        is_written_ &= fwrite(header, sizeof(header), 1, file_) == 1;
+    }
+    is_written_ &= fclose(file_) == 0;
+    file_ = nullptr;
+
+    // an incomplete cache never replaces the old one, polishing itself is
+    // not affected by it
+    if (!is_written_ || rename((path_ + ".tmp").c_str(), path_.c_str()) != 0) {
+        remove((path_ + ".tmp").c_str());
+        fprintf(stderr, "[racon::OverlapCache::finish] warning: "
+            "unable to write file %s, overlaps are not cached\n", path_.c_str());
+    }
+}
+
+}
@@ -0,0 +1,66 @@
+/*!
+ * @file overlap_cache.hpp
+ *
+ * @brief OverlapCache class header file
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace racon {
+
+class Overlap;
+
+// returns the key under which aligned overlaps of given input files are
+// cached, files are fingerprinted by size, modification time and contents of
+// their first and last MB, parameters are those which affect breaking points
+uint64_t overlapCacheKey(const std::vector<std::string>& paths,
+    const std::string& parameters);
+
+/*!
+ * @brief Binary file holding transmuted overlaps (numeric ids, strand and
+ * coordinates) with their breaking points, so that overlaps do not have to be
+ * parsed, filtered and aligned again in later runs on the same input. Cache
+ * is read through a memory map and written to a temporary file which replaces
+ * the old one only once it is complete.
+ */
+class OverlapCache {
+public:
+    OverlapCache(const std::string& path, uint64_t key);
+    ~OverlapCache();
+
+    // returns false if the cache does not exist or was built for a
+    // different key, overlaps are stored in the same order they were in and
+    // belong to targets in [targets_begin, targets_end)
+    bool load(std::vector<std::unique_ptr<Overlap>>& dst,
+        uint64_t& targets_begin, uint64_t& targets_end) const;
+
+    // thread safe, i is the position of the overlap in the overlap set
+    void store(uint64_t i, const Overlap& overlap);
+
+    // completes the cache of overlaps of targets in [targets_begin,
+    // targets_end)
+    void finish(uint64_t targets_begin, uint64_t targets_end);
+
+private:
+    OverlapCache(const OverlapCache&) = delete;
+    const OverlapCache& operator=(const OverlapCache&) = delete;
+
+    void create_file();
+
+    std::string path_;
+    uint64_t key_;
+    FILE* file_;
+    uint64_t num_overlaps_;
+    // cleared on the first failed write, the cache is dropped in finish()
+    bool is_written_;
+    std::mutex mutex_;
+};
+
+}
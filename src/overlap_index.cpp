@@ -0,0 +1,621 @@
+/*!
+ * @file overlap_index.cpp
+ *
+ * @brief OverlapIndex class source file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <algorithm>
+#include <future>
+#include <unordered_set>
+
+#include "overlap.hpp"
+#include "overlap_cache.hpp"
+#include "overlap_index.hpp"
+#include "source.hpp"
+
+#include "zlib.h"
+
+namespace racon {
+
+constexpr char kIndexMagic[8] = { 'R', 'A', 'C', 'O', 'N', 'O', 'I', 2 };
+constexpr uint64_t kMaxRangeSize = 4 * 1024 * 1024; // 4MB
+constexpr uint32_t kReadBufferSize = 4 * 1024 * 1024; // 4MB
+constexpr uint32_t kBgzfHeaderSize = 18;
+constexpr uint32_t kBgzfFooterSize = 8;
+
+// checks the extra field of the first gzip member
+bool isBgzf(const std::string& path) {
+
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    uint8_t header[kBgzfHeaderSize];
+    bool is_bgzf = fread(header, 1, kBgzfHeaderSize, file) == kBgzfHeaderSize &&
+        header[0] == 31 && header[1] == 139 && header[2] == 8 &&
+        (header[3] & 4) && header[10] == 6 && header[12] == 'B' && header[13] == 'C';
+    fclose(file);
+    return is_bgzf;
+}
+
+// appends the block at the current position of file decompressed to dst,
+// returns the compressed size of the block (0 at the end of file)
+uint32_t readBgzfBlock(FILE* file, std::string& dst, std::string& buffer) {
+
+    uint8_t header[kBgzfHeaderSize];
+    uint64_t length = fread(header, 1, kBgzfHeaderSize, file);
+    if (length == 0) {
+        return 0;
+    }
+    if (length != kBgzfHeaderSize || header[0] != 31 || header[1] != 139 ||
+        header[12] != 'B' || header[13] != 'C') {
+        fprintf(stderr, "[racon::readBgzfBlock] error: invalid BGZF block!\n");
+        exit(1);
+    }
+
+    uint32_t block_size = (header[16] | header[17] << 8) + 1;
+    if (block_size < kBgzfHeaderSize + kBgzfFooterSize) {
+        fprintf(stderr, "[racon::readBgzfBlock] error: invalid BGZF block!\n");
+        exit(1);
+    }
+    buffer.resize(block_size - kBgzfHeaderSize);
+    if (fread(&buffer[0], 1, buffer.size(), file) != buffer.size()) {
+        fprintf(stderr, "[racon::readBgzfBlock] error: truncated BGZF block!\n");
+        exit(1);
+    }
+
+    const uint8_t* footer = reinterpret_cast<const uint8_t*>(buffer.data()) +
+        buffer.size() - 4;
+    uint32_t data_length = footer[0] | footer[1] << 8 | footer[2] << 16 |
+        static_cast<uint32_t>(footer[3]) << 24;
+    if (data_length == 0) {
+        return block_size;
+    }
+
+    uint64_t begin = dst.size();
+    dst.resize(begin + data_length);
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    stream.next_in = reinterpret_cast<Bytef*>(&buffer[0]);
+    stream.avail_in = buffer.size() - kBgzfFooterSize;
+    stream.next_out = reinterpret_cast<Bytef*>(&dst[begin]);
+    stream.avail_out = data_length;
+    if (inflateInit2(&stream, -15) != Z_OK ||
+        inflate(&stream, Z_FINISH) != Z_STREAM_END) {
+
+        inflateEnd(&stream);
+        fprintf(stderr, "[racon::readBgzfBlock] error: "
+            "unable to decompress BGZF block!\n");
+        exit(1);
+    }
+    inflateEnd(&stream);
+
+    return block_size;
+}
+
+// splits a line into at most max_fields tab separated fields, returns their
+// number
+uint32_t splitFields(const char* line, uint32_t length, uint32_t max_fields,
+    std::vector<std::pair<const char*, uint32_t>>& fields) {
+
+    fields.clear();
+    uint32_t begin = 0;
+    for (uint32_t i = 0; i <= length && fields.size() < max_fields; ++i) {
+        if (i == length || line[i] == '\t') {
+            fields.emplace_back(line + begin, i - begin);
+            begin = i + 1;
+        }
+    }
+    return fields.size();
+}
+
+/*!
+ * @brief Parses records of selected ranges of an indexed overlap file,
+ * ranges of one chunk are split between threads which read them through
+ * their own file handles
+ */
+class IndexedOverlapSource: public Source<Overlap> {
+public:
+    IndexedOverlapSource(const std::string& path, bool is_sam, bool is_bgzf,
+        std::vector<std::pair<uint64_t, uint64_t>>&& ranges,
+        std::vector<uint64_t>&& sizes, uint32_t num_threads)
+            : Source<Overlap>(), path_(path), is_sam_(is_sam), is_bgzf_(is_bgzf),
+            ranges_(std::move(ranges)), sizes_(std::move(sizes)),
+            num_threads_(std::max(num_threads, 1U)), next_(0) {
+    }
+    ~IndexedOverlapSource() override = default;
+
+    void reset() override {
+        next_ = 0;
+    }
+
+    bool parse(std::vector<std::unique_ptr<Overlap>>& dst, uint64_t max_bytes) override {
+
+        uint64_t begin = next_, num_bytes = 0;
+        while (next_ < ranges_.size() && (next_ == begin || num_bytes < max_bytes)) {
+            num_bytes += sizes_[next_++];
+        }
+
+        // consecutive ranges of about equal size per thread
+        std::vector<uint64_t> splits(1, begin);
+        for (uint64_t i = begin, size = 0; i < next_; ++i) {
+            size += sizes_[i];
+            if (size * num_threads_ >= num_bytes * splits.size() || i + 1 == next_) {
+                splits.emplace_back(i + 1);
+            }
+        }
+
+        std::vector<std::future<std::vector<std::unique_ptr<Overlap>>>> thread_futures;
+        for (uint32_t i = 0; i + 1 < splits.size(); ++i) {
+            thread_futures.emplace_back(std::async(std::launch::async,
+                [&](uint64_t first, uint64_t last) -> std::vector<std::unique_ptr<Overlap>> {
+                    return parse_ranges(first, last);
+                }, splits[i], splits[i + 1]));
+        }
+        for (auto& it: thread_futures) {
+            for (auto& jt: it.get()) {
+                dst.emplace_back(std::move(jt));
+            }
+        }
+
+        return next_ < ranges_.size();
+    }
+
+private:
+    std::vector<std::unique_ptr<Overlap>> parse_ranges(uint64_t first,
+        uint64_t last) const {
+
+        FILE* file = fopen(path_.c_str(), "rb");
+        if (file == nullptr) {
+            fprintf(stderr, "[racon::IndexedOverlapSource::parse] error: "
+                "unable to open file %s!\n", path_.c_str());
+            exit(1);
+        }
+
+        std::vector<std::unique_ptr<Overlap>> dst;
+        std::string data, buffer;
+        std::vector<std::pair<const char*, uint32_t>> fields;
+        for (uint64_t i = first; i < last; ++i) {
+            data.clear();
+            read_range(file, ranges_[i].first, ranges_[i].second, data, buffer);
+
+            for (uint64_t begin = 0, end = 0; begin < data.size(); begin = end + 1) {
+                end = data.find('\n', begin);
+                if (end == std::string::npos) {
+                    end = data.size();
+                }
+                uint32_t length = end - begin;
+                if (length > 0 && data[begin + length - 1] == '\r') {
+                    --length;
+                }
+                if (length == 0 || (is_sam_ && data[begin] == '@')) {
+                    continue;
+                }
+                dst.emplace_back(create_overlap(&data[begin], length, fields));
+            }
+        }
+
+        fclose(file);
+        return dst;
+    }
+
+    void read_range(FILE* file, uint64_t begin, uint64_t end, std::string& dst,
+        std::string& buffer) const {
+
+        if (!is_bgzf_) {
+            dst.resize(end - begin);
+            if (fseeko(file, begin, SEEK_SET) != 0 ||
+                fread(&dst[0], 1, dst.size(), file) != dst.size()) {
+
+                fprintf(stderr, "[racon::IndexedOverlapSource::parse] error: "
+                    "unable to read file %s (index is out of date)!\n", path_.c_str());
+                exit(1);
+            }
+            return;
+        }
+
+        uint64_t block_begin = begin >> 16, block_end = end >> 16;
+        if (fseeko(file, block_begin, SEEK_SET) != 0) {
+            fprintf(stderr, "[racon::IndexedOverlapSource::parse] error: "
+                "unable to read file %s (index is out of date)!\n", path_.c_str());
+            exit(1);
+        }
+        std::string block;
+        for (uint64_t offset = block_begin; offset < block_end ||
+            (offset == block_end && (end & 0xffff) != 0);) {
+
+            block.clear();
+            uint32_t block_size = readBgzfBlock(file, block, buffer);
+            if (block_size == 0) {
+                fprintf(stderr, "[racon::IndexedOverlapSource::parse] error: "
+                    "unable to read file %s (index is out of date)!\n", path_.c_str());
+                exit(1);
+            }
+            uint64_t first = offset == block_begin ? begin & 0xffff : 0;
+            uint64_t last = offset == block_end ? end & 0xffff : block.size();
+            dst.append(block, first, last - first);
+            offset += block_size;
+        }
+    }
+
+    std::unique_ptr<Overlap> create_overlap(const char* line, uint32_t length,
+        std::vector<std::pair<const char*, uint32_t>>& fields) const {
+
+        auto number = [&](uint32_t i) -> uint32_t {
+            return strtol(fields[i].first, nullptr, 10);
+        };
+
+        if (is_sam_) {
+            if (splitFields(line, length, 11, fields) < 11) {
+                fprintf(stderr, "[racon::IndexedOverlapSource::parse] error: "
+                    "invalid SAM record in file %s!\n", path_.c_str());
+                exit(1);
+            }
+            return std::unique_ptr<Overlap>(new Overlap(fields[0].first,
+                fields[0].second, number(1), fields[2].first, fields[2].second,
+                number(3), number(4), fields[5].first, fields[5].second,
+                fields[6].first, fields[6].second, number(7), number(8),
+                fields[9].first, fields[9].second, fields[10].first,
+                fields[10].second));
+        }
+
+        if (splitFields(line, length, 12, fields) < 12) {
+            fprintf(stderr, "[racon::IndexedOverlapSource::parse] error: "
+                "invalid PAF record in file %s!\n", path_.c_str());
+            exit(1);
+        }
+        return std::unique_ptr<Overlap>(new Overlap(fields[0].first,
+            fields[0].second, number(1), number(2), number(3), fields[4].first[0],
+            fields[5].first, fields[5].second, number(6), number(7), number(8),
+            number(9), number(10), number(11)));
+    }
+
+    std::string path_;
+    bool is_sam_;
+    bool is_bgzf_;
+    std::vector<std::pair<uint64_t, uint64_t>> ranges_;
+    std::vector<uint64_t> sizes_;
+    uint32_t num_threads_;
+    uint64_t next_;
+};
+
+std::unique_ptr<OverlapIndex> createOverlapIndex(const std::string& overlaps_path) {
+
+    auto is_suffix = [](const std::string& src, const std::string& suffix) -> bool {
+        return src.size() >= suffix.size() &&
+            src.compare(src.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+
+    bool is_sam = false;
+    if (is_suffix(overlaps_path, ".sam") || is_suffix(overlaps_path, ".sam.gz")) {
+        is_sam = true;
+    } else if (!is_suffix(overlaps_path, ".paf") && !is_suffix(overlaps_path, ".paf.gz")) {
+        fprintf(stderr, "[racon::createOverlapIndex] warning: "
+            "only PAF and SAM files can be indexed, reading %s sequentially\n",
+            overlaps_path.c_str());
+        return nullptr;
+    }
+
+    bool is_bgzf = is_suffix(overlaps_path, ".gz");
+    if (is_bgzf && !isBgzf(overlaps_path)) {
+        fprintf(stderr, "[racon::createOverlapIndex] warning: "
+            "file %s is not BGZF compressed (see bgzip) and can not be indexed, "
+            "reading it sequentially\n", overlaps_path.c_str());
+        return nullptr;
+    }
+
+    std::unique_ptr<OverlapIndex> index(new OverlapIndex(overlaps_path, is_sam,
+        is_bgzf));
+
+    std::string index_path = overlaps_path + ".ridx";
+    uint64_t key = overlapCacheKey({ overlaps_path }, "overlap index");
+    if (!index->load(index_path, key)) {
+        index->build();
+        index->store(index_path, key);
+        fprintf(stderr, "[racon::createOverlapIndex] built index of %s "
+            "(%zu targets, %zu ranges)\n", overlaps_path.c_str(),
+            index->targets_.size(), index->ranges_.size());
+    }
+
+    // records of a target spread over the file would be read in a different
+    // order than without the index, which changes filtering per query
+    if (!index->is_sorted_) {
+        fprintf(stderr, "[racon::createOverlapIndex] warning: "
+            "file %s is not sorted by target sequences, reading it "
+            "sequentially\n", overlaps_path.c_str());
+        return nullptr;
+    }
+
+    return index;
+}
+
+OverlapIndex::OverlapIndex(const std::string& path, bool is_sam, bool is_bgzf)
+        : path_(path), is_sam_(is_sam), is_bgzf_(is_bgzf), is_sorted_(true),
+        targets_(), target_to_id_(), targets_num_bytes_(), targets_queries_(),
+        ranges_() {
+}
+
+uint64_t OverlapIndex::num_bytes(const std::string& target) const {
+    auto it = target_to_id_.find(target);
+    return it == target_to_id_.end() ? 0 : targets_num_bytes_[it->second];
+}
+
+bool OverlapIndex::splits_queries(const std::vector<std::string>& targets,
+    const std::vector<std::string>& selected) const {
+
+    // 0 - unknown, 1 - other, 2 - selected
+    std::vector<uint8_t> states(targets_.size(), 0);
+    for (const auto& it: { std::make_pair(&targets, 1), std::make_pair(&selected, 2) }) {
+        for (const auto& jt: *it.first) {
+            auto kt = target_to_id_.find(jt);
+            if (kt != target_to_id_.end()) {
+                states[kt->second] = it.second;
+            }
+        }
+    }
+
+    // targets have one block each, records of unknown targets are invalid and
+    // do not separate records of one query
+    uint32_t prev = targets_.size();
+    for (uint64_t i = 0; i < ranges_.size(); ++i) {
+        uint32_t next = ranges_[i].target;
+        if (next == prev || states[next] == 0) {
+            continue;
+        }
+        if (prev != targets_.size() && states[prev] != states[next] &&
+            targets_queries_[prev].second == targets_queries_[next].first) {
+            return true;
+        }
+        prev = next;
+    }
+    return false;
+}
+
+std::unique_ptr<Source<Overlap>> OverlapIndex::select(
+    const std::vector<std::string>& targets, uint32_t num_threads) const {
+
+    std::unordered_set<uint32_t> ids;
+    for (const auto& it: targets) {
+        auto jt = target_to_id_.find(it);
+        if (jt != target_to_id_.end()) {
+            ids.emplace(jt->second);
+        }
+    }
+
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    std::vector<uint64_t> sizes;
+    for (const auto& it: ranges_) {
+        if (ids.count(it.target) != 0) {
+            ranges.emplace_back(it.begin, it.end);
+            sizes.emplace_back(it.num_bytes);
+        }
+    }
+
+    return std::unique_ptr<Source<Overlap>>(new IndexedOverlapSource(path_,
+        is_sam_, is_bgzf_, std::move(ranges), std::move(sizes), num_threads));
+}
+
+void OverlapIndex::add_record(const char* target, uint32_t target_length,
+    const char* query, uint32_t query_length, uint64_t begin, uint64_t end,
+    uint64_t num_bytes) {
+
+    if (!ranges_.empty()) {
+        auto& last = ranges_.back();
+        const auto& name = targets_[last.target];
+        if (name.size() == target_length &&
+            memcmp(name.data(), target, target_length) == 0) {
+
+            if (last.end == begin && last.num_bytes < kMaxRangeSize) {
+                last.end = end;
+                last.num_bytes += num_bytes;
+            } else {
+                ranges_.push_back({ last.target, begin, end, num_bytes });
+            }
+            targets_num_bytes_[last.target] += num_bytes;
+            targets_queries_[last.target].second.assign(query, query_length);
+            return;
+        }
+    }
+
+    std::string name(target, target_length);
+    auto it = target_to_id_.find(name);
+    if (it == target_to_id_.end()) {
+        it = target_to_id_.emplace(name, targets_.size()).first;
+        targets_.emplace_back(name);
+        targets_num_bytes_.emplace_back(0);
+        targets_queries_.emplace_back(std::string(query, query_length),
+            std::string(query, query_length));
+    } else {
+        // the target already has a block before the last one
+        is_sorted_ = false;
+        targets_queries_[it->second].second.assign(query, query_length);
+    }
+    ranges_.push_back({ it->second, begin, end, num_bytes });
+    targets_num_bytes_[it->second] += num_bytes;
+}
+
+void OverlapIndex::build() {
+
+    FILE* file = fopen(path_.c_str(), "rb");
+    if (file == nullptr) {
+        fprintf(stderr, "[racon::OverlapIndex::build] error: "
+            "unable to open file %s!\n", path_.c_str());
+        exit(1);
+    }
+
+    // lines are collected across reads, offsets are those of their first
+    // byte and of the byte after their end
+    uint32_t target_field = is_sam_ ? 2 : 5;
+    std::string line;
+    uint64_t line_begin = 0;
+    std::vector<std::pair<const char*, uint32_t>> fields;
+    auto add_line = [&](uint64_t line_end) -> void {
+        uint64_t num_bytes = line.size() + 1;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!line.empty() && !(is_sam_ && line[0] == '@')) {
+            if (splitFields(line.data(), line.size(), target_field + 1, fields) <=
+                target_field) {
+
+                fprintf(stderr, "[racon::OverlapIndex::build] error: "
+                    "invalid record in file %s!\n", path_.c_str());
+                exit(1);
+            }
+            add_record(fields[target_field].first, fields[target_field].second,
+                fields[0].first, fields[0].second, line_begin, line_end, num_bytes);
+        }
+        line.clear();
+        line_begin = line_end;
+    };
+
+    std::string data, buffer;
+    uint64_t offset = 0;
+    while (true) {
+        data.clear();
+        uint64_t length = 0;
+        if (is_bgzf_) {
+            length = readBgzfBlock(file, data, buffer);
+        } else {
+            data.resize(kReadBufferSize);
+            length = fread(&data[0], 1, data.size(), file);
+            data.resize(length);
+        }
+        if (length == 0) {
+            break;
+        }
+
+        for (uint64_t begin = 0; begin < data.size();) {
+            uint64_t end = data.find('\n', begin);
+            if (end == std::string::npos) {
+                line.append(data, begin, std::string::npos);
+                break;
+            }
+            line.append(data, begin, end - begin);
+            // offset right after the newline, which is the start of the next
+            // block if it ends one
+            uint64_t line_end = is_bgzf_ ? (end + 1 == data.size() ?
+                (offset + length) << 16 : offset << 16 | (end + 1)) :
+                offset + end + 1;
+            add_line(line_end);
+            begin = end + 1;
+        }
+        if (is_bgzf_ && line.empty()) {
+            line_begin = (offset + length) << 16;
+        }
+        offset += length;
+    }
+    if (!line.empty()) {
+        add_line(is_bgzf_ ? offset << 16 : offset);
+    }
+
+    fclose(file);
+}
+
+bool OverlapIndex::load(const std::string& path, uint64_t key) {
+
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+
+    char magic[sizeof(kIndexMagic)];
+    uint64_t header[4] = { 0 };
+    bool is_valid = fread(magic, sizeof(magic), 1, file) == 1 &&
+        memcmp(magic, kIndexMagic, sizeof(kIndexMagic)) == 0 &&
+        fread(header, sizeof(header), 1, file) == 1 && header[0] == key;
+
+    // names of targets followed by their first and last query
+    auto read_name = [&](std::string& dst) -> bool {
+        uint32_t length = 0;
+        if (fread(&length, sizeof(length), 1, file) != 1) {
+            return false;
+        }
+        dst.resize(length);
+        return length == 0 || fread(&dst[0], 1, length, file) == length;
+    };
+    for (uint64_t i = 0; is_valid && i < header[1]; ++i) {
+        std::string name, first, last;
+        is_valid = read_name(name) && read_name(first) && read_name(last);
+        if (is_valid) {
+            target_to_id_.emplace(name, targets_.size());
+            targets_.emplace_back(name);
+            targets_queries_.emplace_back(first, last);
+        }
+    }
+    for (uint64_t i = 0; is_valid && i < header[2]; ++i) {
+        Range range;
+        is_valid = fread(&range.target, sizeof(range.target), 1, file) == 1 &&
+            fread(&range.begin, sizeof(range.begin), 1, file) == 1 &&
+            fread(&range.end, sizeof(range.end), 1, file) == 1 &&
+            fread(&range.num_bytes, sizeof(range.num_bytes), 1, file) == 1 &&
+            range.target < targets_.size();
+        if (is_valid) {
+            ranges_.emplace_back(range);
+        }
+    }
+    fclose(file);
+
+    if (!is_valid) {
+        targets_.clear();
+        target_to_id_.clear();
+        targets_queries_.clear();
+        ranges_.clear();
+        return false;
+    }
+
+    is_sorted_ = header[3] != 0;
+
+    targets_num_bytes_.assign(targets_.size(), 0);
+    for (const auto& it: ranges_) {
+        targets_num_bytes_[it.target] += it.num_bytes;
+    }
+    return true;
+}
+
+void OverlapIndex::store(const std::string& path, uint64_t key) const {
+
+    // an index which can not be stored (e.g. in a read-only directory) is
+    // only used for this run
+    std::string tmp_path = path + ".tmp";
+    FILE* file = fopen(tmp_path.c_str(), "wb");
+    if (file == nullptr) {
+        fprintf(stderr, "[racon::OverlapIndex::store] warning: "
+            "unable to create file %s!\n", tmp_path.c_str());
+        return;
+    }
+
+    uint64_t header[4] = { key, targets_.size(), ranges_.size(), is_sorted_ };
+    bool is_written = fwrite(kIndexMagic, sizeof(kIndexMagic), 1, file) == 1 &&
+        fwrite(header, sizeof(header), 1, file) == 1;
+    auto write_name = [&](const std::string& src) -> bool {
+        uint32_t length = src.size();
+        return fwrite(&length, sizeof(length), 1, file) == 1 &&
+            fwrite(src.data(), 1, length, file) == length;
+    };
+    for (uint64_t i = 0; i < targets_.size(); ++i) {
+        is_written &= write_name(targets_[i]) &&
+            write_name(targets_queries_[i].first) &&
+            write_name(targets_queries_[i].second);
+    }
+    for (const auto& it: ranges_) {
+        is_written &= fwrite(&it.target, sizeof(it.target), 1, file) == 1 &&
+            fwrite(&it.begin, sizeof(it.begin), 1, file) == 1 &&
+            fwrite(&it.end, sizeof(it.end), 1, file) == 1 &&
+            fwrite(&it.num_bytes, sizeof(it.num_bytes), 1, file) == 1;
+    }
+    is_written &= fclose(file) == 0;
+
+    if (!is_written || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "[racon::OverlapIndex::store] warning: "
+            "unable to write file %s!\n", path.c_str());
+        remove(tmp_path.c_str());
+    }
+}
+
+}
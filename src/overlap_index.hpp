@@ -0,0 +1,93 @@
+/*!
+ * @file overlap_index.hpp
+ *
+ * @brief OverlapIndex class header file
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace racon {
+
+class Overlap;
+
+template<class T>
+class Source;
+
+class OverlapIndex;
+// loads the index of a PAF or SAM file (plain or BGZF compressed) from
+// overlaps_path + ".ridx", or builds and stores it if it is missing or the
+// file has changed since, returns nullptr for files which can not be indexed
+// or are not sorted by target sequences
+std::unique_ptr<OverlapIndex> createOverlapIndex(const std::string& overlaps_path);
+
+/*!
+ * @brief Sidecar index of an overlap file which maps names of target
+ * sequences to ranges of their records. Ranges are byte offsets into plain
+ * files and BGZF virtual offsets (compressed offset of the block << 16 |
+ * offset inside it) into compressed ones, consecutive records of one target
+ * are split into ranges of at most a few MB so that they can be parsed in
+ * parallel. Target sorted files have few ranges per target.
+ */
+class OverlapIndex {
+public:
+    ~OverlapIndex() = default;
+
+    // uncompressed size of records of the target
+    uint64_t num_bytes(const std::string& target) const;
+
+    // true if records of one query continue from a selected target into
+    // another one of targets (records of the rest are invalid) with no other
+    // query in between, reading only the selected targets then filters such
+    // queries (see PolisherType::kC) differently than reading the whole file
+    bool splits_queries(const std::vector<std::string>& targets,
+        const std::vector<std::string>& selected) const;
+
+    // reads only records of given targets in file order, ranges of a chunk
+    // are parsed on num_threads threads
+    std::unique_ptr<Source<Overlap>> select(const std::vector<std::string>& targets,
+        uint32_t num_threads) const;
+
+    friend std::unique_ptr<OverlapIndex> createOverlapIndex(const std::string& overlaps_path);
+
+private:
+    OverlapIndex(const std::string& path, bool is_sam, bool is_bgzf);
+    OverlapIndex(const OverlapIndex&) = delete;
+    const OverlapIndex& operator=(const OverlapIndex&) = delete;
+
+    struct Range {
+        uint32_t target;
+        uint64_t begin;
+        uint64_t end;
+        uint64_t num_bytes;
+    };
+
+    void build();
+    bool load(const std::string& path, uint64_t key);
+    void store(const std::string& path, uint64_t key) const;
+
+    // record spans [begin, end), a new range is started unless it directly
+    // follows the last range of the same target which is not full yet
+    void add_record(const char* target, uint32_t target_length,
+        const char* query, uint32_t query_length, uint64_t begin, uint64_t end,
+        uint64_t num_bytes);
+
+    std::string path_;
+    bool is_sam_;
+    bool is_bgzf_;
+    // records of each target are consecutive
+    bool is_sorted_;
+    std::vector<std::string> targets_;
+    std::unordered_map<std::string, uint32_t> target_to_id_;
+    std::vector<uint64_t> targets_num_bytes_;
+    // queries of the first and the last record of each target
+    std::vector<std::pair<std::string, std::string>> targets_queries_;
+    std::vector<Range> ranges_;
+};
+
+}
@@ -4,14 +4,28 @@
  * @brief Polisher class source file
  */
 
+#include <string.h>
 #include <algorithm>
 #include <unordered_set>
 #include <iostream>
+#include <future>
+#include <tuple>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 
 #include "overlap.hpp"
+#include "overlap_cache.hpp"
+#include "overlap_index.hpp"
+#include "read_store.hpp"
+#include "sink.hpp"
+#include "source.hpp"
 #include "sequence.hpp"
 #include "window.hpp"
 #include "logger.hpp"
+#include "numa.hpp"
+#include "stats.hpp"
 #include "polisher.hpp"
 #ifdef CUDA_ENABLED
 #include "cuda/cudapolisher.hpp"
@@ -24,6 +38,8 @@
 namespace racon {
 
 constexpr uint32_t kChunkSize = 1024 * 1024 * 1024; // ~ 1GB
+constexpr uint32_t kStreamChunkSize = 64 * 1024 * 1024; // ~ 64MB
+constexpr uint64_t kNumReportedWindows = 10;
 
 template<class T>
 uint64_t shrinkToFit(std::vector<std::unique_ptr<T>>& src, uint64_t begin) {
@@ -52,23 +68,185 @@ uint64_t shrinkToFit(std::vector<std::unique_ptr<T>>& src, uint64_t begin) {
     return num_deletions;
 }
 
-std::unique_ptr<Polisher> createPolisher(const std::string& sequences_path,
-    const std::string& overlaps_path, const std::string& target_path,
-    PolisherType type, uint32_t window_length, double overlap_percentage, double quality_threshold,
-    double error_threshold, bool trim, int8_t match, int8_t mismatch, int8_t gap,
-    uint32_t num_threads, uint32_t cudapoa_batches, bool cuda_banded_alignment,
-    uint32_t cudaaligner_batches) {
+// returns for each overlap the index of the overlap of the same pair of
+// sequences with swapped roles and matching ranges (overlaps.size() if there
+// is none, see Overlap::is_reciprocal()), overlaps which already have
+// breaking points are not paired
+std::vector<uint64_t> findReciprocalOverlaps(
+    const std::vector<std::unique_ptr<Overlap>>& overlaps) {
+
+    std::vector<uint64_t> reciprocals(overlaps.size(), overlaps.size());
+
+    std::vector<uint64_t> order;
+    for (uint64_t i = 0; i < overlaps.size(); ++i) {
+        if (overlaps[i] != nullptr && overlaps[i]->breaking_points().empty()) {
+            order.emplace_back(i);
+        }
+    }
+    // groups of the same pair and strand, each split by the query
+    auto key = [&](uint64_t i) -> std::tuple<uint64_t, uint64_t, uint32_t, uint64_t, uint64_t> {
+        const auto& it = overlaps[i];
+        return std::make_tuple(std::min(it->q_id(), it->t_id()),
+            std::max(it->q_id(), it->t_id()), it->strand(), it->q_id(), i);
+    };
+    std::sort(order.begin(), order.end(), [&](uint64_t lhs, uint64_t rhs) -> bool {
+        return key(lhs) < key(rhs);
+    });
+
+    for (uint64_t i = 0, j = 0; i < order.size(); i = j) {
+        const auto& first = overlaps[order[i]];
+        uint64_t m = i;
+        for (j = i; j < order.size(); ++j) {
+            const auto& it = overlaps[order[j]];
+            if (std::min(it->q_id(), it->t_id()) != std::min(first->q_id(), first->t_id()) ||
+                std::max(it->q_id(), it->t_id()) != std::max(first->q_id(), first->t_id()) ||
+                it->strand() != first->strand()) {
+                break;
+            }
+            if (it->q_id() == first->q_id()) {
+                m = j + 1;
+            }
+        }
+        // overlaps with the smaller query id in [i, m), the rest in [m, j),
+        // pairs of reads with several overlaps (repeats, split alignments)
+        // are paired by their ranges, the rest is aligned on its own
+        for (uint64_t k = i; k < m; ++k) {
+            for (uint64_t r = m; r < j; ++r) {
+                if (reciprocals[order[r]] == overlaps.size() &&
+                    overlaps[order[k]]->is_reciprocal(*overlaps[order[r]])) {
+                    reciprocals[order[k]] = order[r];
+                    reciprocals[order[r]] = order[k];
+                    break;
+                }
+            }
+        }
+    }
+
+    return reciprocals;
+}
+
+double secondsBetween(std::chrono::steady_clock::time_point begin,
+    std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration_cast<std::chrono::duration<double>>(
+        end - begin).count();
+}
+
+// returns SIMD extensions supported by the running CPU, widest first, used
+// for logging only
+std::string cpuFeatures() {
+
+    std::string features;
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) {
+        features += " avx512bw";
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        features += " avx2";
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        features += " sse4.1";
+    }
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+    features += " neon";
+#endif
+    return features.empty() ? " none" : features;
+}
+
+template<class T>
+class ParserSource: public Source<T> {
+public:
+    ParserSource(std::unique_ptr<bioparser::Parser<T>> parser)
+            : Source<T>(), parser_(std::move(parser)) {
+    }
+    ~ParserSource() override = default;
+
+    void reset() override {
+        parser_->reset();
+    }
+
+    bool parse(std::vector<std::unique_ptr<T>>& dst, uint64_t max_bytes) override {
+        return parser_->parse(dst, max_bytes);
+    }
+
+private:
+    std::unique_ptr<bioparser::Parser<T>> parser_;
+};
+
+template<class T>
+std::unique_ptr<Source<T>> createParserSource(
+    std::unique_ptr<bioparser::Parser<T>> parser) {
+    return std::unique_ptr<Source<T>>(new ParserSource<T>(std::move(parser)));
+}
+
+// shared by both versions of createPolisher() so that invalid parameters
+// are reported before the input is touched
+void checkParameters(const PolisherOptions& options) {
+
+    PolisherType type = options.type;
+    bool stream = options.stream;
+    int8_t gap = options.gap, gap_extend = options.gap_extend;
+    GapModel gap_model = options.gap_model;
+    uint32_t num_rounds = options.num_rounds, shard = options.shard,
+        num_shards = options.num_shards;
 
     if (type != PolisherType::kC && type != PolisherType::kF) {
         fprintf(stderr, "[racon::createPolisher] error: invalid polisher type!\n");
         exit(1);
     }
 
-    if (window_length == 0) {
+    if (options.window_length == 0) {
         fprintf(stderr, "[racon::createPolisher] error: invalid window length!\n");
         exit(1);
     }
 
+    if (num_shards == 0 || shard >= num_shards) {
+        fprintf(stderr, "[racon::createPolisher] error: invalid shard!\n");
+        exit(1);
+    }
+    if (num_shards > 1 && stream) {
+        fprintf(stderr, "[racon::createPolisher] error: "
+            "sharding is not supported with streaming!\n");
+        exit(1);
+    }
+
+    if (num_rounds == 0) {
+        fprintf(stderr, "[racon::createPolisher] error: invalid number of rounds!\n");
+        exit(1);
+    }
+    if (!options.pack_reads && !options.read_store_path.empty()) {
+        fprintf(stderr, "[racon::createPolisher] error: "
+            "read store needs packed reads!\n");
+        exit(1);
+    }
+    if (num_rounds > 1 && (stream || type == PolisherType::kF)) {
+        fprintf(stderr, "[racon::createPolisher] error: "
+            "multiple rounds are supported only for contig polishing without "
+            "streaming!\n");
+        exit(1);
+    }
+
+    // spoa deduces the model from the penalties, make sure it matches
+    if (gap_model != GapModel::kLinear && (gap_extend > 0 || gap >= gap_extend)) {
+        fprintf(stderr, "[racon::createPolisher] error: "
+            "gap extend penalty has to be in (gap, 0]!\n");
+        exit(1);
+    }
+    if (gap_model == GapModel::kConvex && (options.gap_extend_2 > 0 ||
+        options.gap_open_2 >= gap || gap_extend >= options.gap_extend_2)) {
+        fprintf(stderr, "[racon::createPolisher] error: "
+            "second gap open penalty has to be lower than gap and second "
+            "gap extend penalty has to be in (gap extend, 0]!\n");
+        exit(1);
+    }
+}
+
+std::unique_ptr<Polisher> createPolisher(const std::string& sequences_path,
+    const std::string& overlaps_path, const std::string& target_path,
+    const PolisherOptions& options) {
+
+    checkParameters(options);
+
     std::unique_ptr<bioparser::Parser<Sequence>> sparser = nullptr,
         tparser = nullptr;
     std::unique_ptr<bioparser::Parser<Overlap>> oparser = nullptr;
@@ -132,14 +310,115 @@ std::unique_ptr<Polisher> createPolisher(const std::string& sequences_path,
         exit(1);
     }
 
-    if (cudapoa_batches > 0 || cudaaligner_batches > 0)
+    if (!options.cache_path.empty()) {
+        if (options.cuda_batches > 0 || options.cudaaligner_batches > 0) {
+            fprintf(stderr, "[racon::createPolisher] error: "
+                "overlap cache is not supported with CUDA!\n");
+            exit(1);
+        }
+        if (options.stream) {
+            fprintf(stderr, "[racon::createPolisher] error: "
+                "overlap cache is not supported with streaming!\n");
+            exit(1);
+        }
+    }
+
+    // both need the overlap file and are set up here
+    PolisherOptions source_options = options;
+    source_options.cache_path.clear();
+    source_options.overlap_index = false;
+
+    auto polisher = createPolisher(createParserSource(std::move(sparser)),
+        createParserSource(std::move(oparser)), createParserSource(std::move(tparser)),
+        source_options);
+
+    if (options.overlap_index) {
+        polisher->overlap_index_ = createOverlapIndex(overlaps_path);
+    }
+
+    // cached overlaps are tied to the input files
+    if (!options.cache_path.empty()) {
+        // parameters which change breaking points of overlaps
+        std::string parameters = std::to_string(static_cast<uint32_t>(options.type)) +
+            " " + std::to_string(options.window_length) + " " +
+            std::to_string(options.overlap_percentage) + " " +
+            std::to_string(options.error_threshold) + " " +
+            std::to_string(static_cast<uint32_t>(options.aligner_type)) + " " +
+            std::to_string(options.shard) + "/" + std::to_string(options.num_shards) +
+            (polisher->overlap_index_ != nullptr ? " indexed" : "");
+        std::vector<std::string> paths = { sequences_path, overlaps_path, target_path };
+        if (!options.targets_path.empty()) {
+            paths.emplace_back(options.targets_path);
+        }
+        polisher->overlap_cache_.reset(new OverlapCache(options.cache_path,
+            overlapCacheKey(paths, parameters)));
+    }
+
+    return polisher;
+}
+
+std::unique_ptr<Polisher> createPolisher(std::unique_ptr<Source<Sequence>> sequences,
+    std::unique_ptr<Source<Overlap>> overlaps, std::unique_ptr<Source<Sequence>> targets,
+    const PolisherOptions& options) {
+
+    checkParameters(options);
+
+    if (sequences == nullptr || overlaps == nullptr || targets == nullptr) {
+        fprintf(stderr, "[racon::createPolisher] error: missing input!\n");
+        exit(1);
+    }
+    if (!options.cache_path.empty() || options.overlap_index) {
+        fprintf(stderr, "[racon::createPolisher] error: "
+            "overlap cache and index are not supported with in-memory input!\n");
+        exit(1);
+    }
+
+    // one name per line, anything after the first whitespace is ignored
+    std::vector<std::string> target_names;
+    if (!options.targets_path.empty()) {
+        FILE* file = fopen(options.targets_path.c_str(), "r");
+        if (file == nullptr) {
+            fprintf(stderr, "[racon::createPolisher] error: "
+                "unable to open file %s!\n", options.targets_path.c_str());
+            exit(1);
+        }
+        char line[4096];
+        while (fgets(line, sizeof(line), file) != nullptr) {
+            uint32_t length = strcspn(line, " \t\r\n");
+            if (length > 0) {
+                target_names.emplace_back(line, length);
+            }
+        }
+        fclose(file);
+        if (target_names.empty()) {
+            fprintf(stderr, "[racon::createPolisher] error: "
+                "file %s contains no target names!\n", options.targets_path.c_str());
+            exit(1);
+        }
+    }
+
+    std::unique_ptr<Polisher> polisher;
+    if (options.cuda_batches > 0 || options.cudaaligner_batches > 0)
     {
+        if (options.stream) {
+            fprintf(stderr, "[racon::createPolisher] error: "
+                "streaming is not supported with CUDA!\n");
+            exit(1);
+        }
+        if (options.num_rounds > 1) {
+            fprintf(stderr, "[racon::createPolisher] error: "
+                "multiple rounds are not supported with CUDA!\n");
+            exit(1);
+        }
+        if (options.numa) {
+            fprintf(stderr, "[racon::createPolisher] error: "
+                "NUMA placement is not supported with CUDA!\n");
+            exit(1);
+        }
 #ifdef CUDA_ENABLED
         // If CUDA is enabled, return an instance of the CUDAPolisher object.
-        return std::unique_ptr<Polisher>(new CUDAPolisher(std::move(sparser),
-                    std::move(oparser), std::move(tparser), type, window_length,
-                    quality_threshold, error_threshold, trim, match, mismatch, gap,
-                    num_threads, cudapoa_batches, cuda_banded_alignment, cudaaligner_batches));
+        polisher.reset(new CUDAPolisher(std::move(sequences), std::move(overlaps),
+            std::move(targets), options));
 #else
         fprintf(stderr, "[racon::createPolisher] error: "
                 "Attemping to use CUDA when CUDA support is not available.\n"
@@ -150,48 +429,158 @@ std::unique_ptr<Polisher> createPolisher(const std::string& sequences_path,
     }
     else
     {
-        (void) cuda_banded_alignment;
-        return std::unique_ptr<Polisher>(new Polisher(std::move(sparser),
-                    std::move(oparser), std::move(tparser), type, window_length, 
-                    overlap_percentage, quality_threshold, error_threshold, 
-                    trim, match, mismatch, gap, num_threads));
+        polisher.reset(new Polisher(std::move(sequences), std::move(overlaps),
+            std::move(targets), options));
     }
+
+    if (!options.read_store_path.empty()) {
+        polisher->read_store_.reset(new ReadStore(options.read_store_path));
+    }
+    polisher->stats_path_ = options.stats_path;
+    polisher->target_names_.swap(target_names);
+    return polisher;
 }
 
-Polisher::Polisher(std::unique_ptr<bioparser::Parser<Sequence>> sparser,
-    std::unique_ptr<bioparser::Parser<Overlap>> oparser,
-    std::unique_ptr<bioparser::Parser<Sequence>> tparser,
-    PolisherType type, uint32_t window_length, double overlap_percentage, 
-    double quality_threshold, double error_threshold, 
-    bool trim, int8_t match, int8_t mismatch, int8_t gap, uint32_t num_threads)
+Polisher::Polisher(std::unique_ptr<Source<Sequence>> sparser,
+    std::unique_ptr<Source<Overlap>> oparser,
+    std::unique_ptr<Source<Sequence>> tparser,
+    const PolisherOptions& options)
         : sparser_(std::move(sparser)), oparser_(std::move(oparser)),
-        tparser_(std::move(tparser)), type_(type), quality_threshold_(
-        quality_threshold), error_threshold_(error_threshold), trim_(trim),
-        alignment_engines_(), sequences_(), dummy_quality_(window_length * 2, '!'),
-        window_length_(window_length), overlap_percentage_(overlap_percentage), windows_(),
-        thread_pool_(thread_pool::createThreadPool(num_threads)),
-        thread_to_id_(), logger_(new Logger()),
-        match_(match), mismatch_(mismatch), gap_(gap) {
+        tparser_(std::move(tparser)), type_(options.type), quality_threshold_(
+        options.quality_threshold), error_threshold_(options.error_threshold),
+        trim_(options.trim), stream_(options.stream),
+        unordered_output_(options.unordered_output),
+        pack_reads_(options.pack_reads), alignment_engines_(),
+        graphs_(), aligner_(createAligner(options.aligner_type)), read_store_(),
+        sequences_(), targets_size_(0), shard_(options.shard),
+        num_shards_(options.num_shards), targets_begin_(0), targets_end_(0),
+        last_targets_(), name_to_id_(), id_to_id_(), overlaps_(), num_rounds_(options.num_rounds),
+        round_(0), next_overlaps_(),
+        next_overlaps_status_(), overlap_cache_(), overlap_index_(),
+        target_names_(), is_selected_target_(), sink_(nullptr),
+        dummy_quality_(options.window_length * 2, '!'),
+        window_length_(options.window_length),
+        overlap_percentage_(options.overlap_percentage),
+        window_type_(WindowType::kTGS), max_window_depth_(options.max_window_depth),
+        windows_(), windows_targets_begin_(0),
+        id_to_first_window_id_(), total_windows_cost_(0),
+        total_windows_time_(0), heaviest_windows_(),
+        thread_pool_(thread_pool::createThreadPool(options.num_threads)),
+        thread_to_id_(), num_nodes_(0), thread_to_node_(), logger_(new Logger()),
+        stats_(new Stats(options.num_threads)), stats_path_(),
+        match_(options.match), mismatch_(options.mismatch), gap_(options.gap) {
+
+    uint32_t num_threads = options.num_threads;
+    int8_t match = options.match, mismatch = options.mismatch, gap = options.gap;
 
     uint32_t id = 0;
     for (const auto& it: thread_pool_->thread_identifiers()) {
         thread_to_id_[it] = id++;
     }
 
+    auto create_engine = [&]() -> std::shared_ptr<spoa::AlignmentEngine> {
+        std::shared_ptr<spoa::AlignmentEngine> engine;
+        switch (options.gap_model) {
+            case GapModel::kAffine:
+                engine = spoa::createAlignmentEngine(spoa::AlignmentType::kNW,
+                    match, mismatch, gap, options.gap_extend);
+                break;
+            case GapModel::kConvex:
+                engine = spoa::createAlignmentEngine(spoa::AlignmentType::kNW,
+                    match, mismatch, gap, options.gap_extend, options.gap_open_2,
+                    options.gap_extend_2);
+                break;
+            case GapModel::kLinear:
+            default:
+                engine = spoa::createAlignmentEngine(spoa::AlignmentType::kNW,
+                    match, mismatch, gap);
+                break;
+        }
+        engine->prealloc(window_length_, 5);
+        return engine;
+    };
+
+    std::vector<std::vector<uint32_t>> nodes;
+    if (options.numa) {
+        nodes = numaNodes();
+        if (nodes.size() < 2) {
+            fprintf(stderr, "[racon::Polisher::Polisher] warning: "
+                "less than two NUMA nodes found, threads are not pinned!\n");
+            nodes.clear();
+        }
+    }
+
+    if (nodes.empty()) {
+        for (uint32_t i = 0; i < num_threads; ++i) {
+            alignment_engines_.emplace_back(create_engine());
+            graphs_.emplace_back(spoa::createGraph());
+        }
+        return;
+    }
+
+    // threads are split between nodes proportionally to their CPUs
+    num_nodes_ = nodes.size();
+    std::vector<uint64_t> first_cpus(1, 0);
+    for (const auto& it: nodes) {
+        first_cpus.emplace_back(first_cpus.back() + it.size());
+    }
+    for (uint64_t i = 0; i < num_threads; ++i) {
+        uint64_t cpu = ((2 * i + 1) * first_cpus.back()) / (2 * num_threads);
+        thread_to_node_.emplace_back(std::upper_bound(first_cpus.begin(),
+            first_cpus.end(), cpu) - first_cpus.begin() - 1);
+    }
+
+    // each thread pins itself and then allocates its engine and graph so that
+    // their memory is placed on its node, tasks wait for each other so that
+    // every thread runs exactly one of them
+    alignment_engines_.resize(num_threads);
+    graphs_.resize(num_threads);
+    std::atomic<uint32_t> num_started(0);
+    std::atomic<uint32_t> num_failed(0);
+    std::vector<std::future<void>> thread_futures;
     for (uint32_t i = 0; i < num_threads; ++i) {
-        alignment_engines_.emplace_back(spoa::createAlignmentEngine(
-            spoa::AlignmentType::kNW, match, mismatch, gap));
-        alignment_engines_.back()->prealloc(window_length_, 5);
+        thread_futures.emplace_back(thread_pool_->submit(
+            [&]() -> void {
+                ++num_started;
+                while (num_started < num_threads) {
+                    std::this_thread::yield();
+                }
+                auto it = thread_to_id_.find(std::this_thread::get_id());
+                if (it == thread_to_id_.end()) {
+                    fprintf(stderr, "[racon::Polisher::Polisher] error: "
+                        "thread identifier not present!\n");
+                    exit(1);
+                }
+                if (!pinThread(nodes[thread_to_node_[it->second]])) {
+                    ++num_failed;
+                }
+                alignment_engines_[it->second] = create_engine();
+                graphs_[it->second] = spoa::createGraph();
+            }));
     }
+    for (const auto& it: thread_futures) {
+        it.wait();
+    }
+
+    if (num_failed > 0) {
+        fprintf(stderr, "[racon::Polisher::Polisher] warning: "
+            "unable to pin %u threads!\n", num_failed.load());
+    }
+    fprintf(stderr, "[racon::Polisher::Polisher] pinned threads to %u NUMA "
+        "nodes\n", num_nodes_);
 }
 
 Polisher::~Polisher() {
     logger_->total("[racon::Polisher::] total =");
+    if (!stats_path_.empty()) {
+        stats_->end();
+        stats_->write(stats_path_);
+    }
 }
 
 void Polisher::initialize() {
 
-    if (!windows_.empty()) {
+    if (!sequences_.empty()) {
         fprintf(stderr, "[racon::Polisher::initialize] warning: "
             "object already initialized!\n");
         return;
@@ -199,30 +588,43 @@ void Polisher::initialize() {
 
     logger_->log();
 
+    // spoa picks its SIMD kernel at compile time and is not dispatched on
+    // these, logged only with statistics to spot builds which do not match
+    // the host
+    if (!stats_path_.empty()) {
+        logger_->log("[racon::Polisher::initialize] CPU SIMD support:" +
+            cpuFeatures() + " (the POA kernel is fixed when spoa is built)");
+    }
+
+    stats_->begin("target_load");
+
     tparser_->reset();
     tparser_->parse(sequences_, -1);
 
-    uint64_t targets_size = sequences_.size();
-    if (targets_size == 0) {
+    targets_size_ = sequences_.size();
+    if (targets_size_ == 0) {
         fprintf(stderr, "[racon::Polisher::initialize] error: "
             "empty target sequences set!\n");
         exit(1);
     }
+    targets_end_ = targets_size_;
 
-    std::unordered_map<std::string, uint64_t> name_to_id;
-    std::unordered_map<uint64_t, uint64_t> id_to_id;
-    for (uint64_t i = 0; i < targets_size; ++i) {
-        name_to_id[sequences_[i]->name() + "t"] = i;
-        id_to_id[i << 1 | 1] = i;
+    for (uint64_t i = 0; i < targets_size_; ++i) {
+        name_to_id_.insert(sequences_[i]->name(), true, i);
+        id_to_id_[i << 1 | 1] = i;
     }
 
-    std::vector<bool> has_name(targets_size, true);
-    std::vector<bool> has_data(targets_size, true);
-    std::vector<bool> has_reverse_data(targets_size, false);
+    select_targets();
+
+    std::vector<bool> has_name(targets_size_, true);
+    std::vector<bool> has_data(targets_size_, true);
+    std::vector<bool> has_reverse_data(targets_size_, false);
 
     logger_->log("[racon::Polisher::initialize] loaded target sequences");
     logger_->log();
 
+    stats_->begin("read_load");
+
     uint64_t sequences_size = 0, total_sequences_length = 0;
 
     sparser_->reset();
@@ -234,10 +636,10 @@ void Polisher::initialize() {
         for (uint64_t i = l; i < sequences_.size(); ++i, ++sequences_size) {
             total_sequences_length += sequences_[i]->data().size();
 
-            auto it = name_to_id.find(sequences_[i]->name() + "t");
-            if (it != name_to_id.end()) {
-                if (sequences_[i]->data().size() != sequences_[it->second]->data().size() ||
-                    sequences_[i]->quality().size() != sequences_[it->second]->quality().size()) {
+            uint64_t id;
+            if (name_to_id_.find(sequences_[i]->name(), true, id)) {
+                if (sequences_[i]->data().size() != sequences_[id]->data().size() ||
+                    sequences_[i]->quality().size() != sequences_[id]->quality().size()) {
 
                     fprintf(stderr, "[racon::Polisher::initialize] error: "
                         "duplicate sequence %s with unequal data\n",
@@ -245,19 +647,35 @@ void Polisher::initialize() {
                     exit(1);
                 }
 
-                name_to_id[sequences_[i]->name() + "q"] = it->second;
-                id_to_id[sequences_size << 1 | 0] = it->second;
+                name_to_id_.insert(sequences_[i]->name(), false, id);
+                id_to_id_[sequences_size << 1 | 0] = id;
 
                 sequences_[i].reset();
                 ++n;
             } else {
-                name_to_id[sequences_[i]->name() + "q"] = i - n;
-                id_to_id[sequences_size << 1 | 0] = i - n;
+                name_to_id_.insert(sequences_[i]->name(), false, i - n);
+                id_to_id_[sequences_size << 1 | 0] = i - n;
             }
         }
 
         shrinkToFit(sequences_, l);
 
+        if (read_store_ != nullptr) {
+            // reads are packed and moved out of memory chunk by chunk, unused
+            // ones are dropped once overlaps are loaded
+            std::vector<std::future<void>> thread_futures;
+            for (uint64_t i = l; i < sequences_.size(); ++i) {
+                thread_futures.emplace_back(thread_pool_->submit(
+                    [&](uint64_t j) -> void {
+                        sequences_[j]->transmute(true, true, false, true);
+                    }, i));
+            }
+            for (const auto& it: thread_futures) {
+                it.wait();
+            }
+            read_store_->store(sequences_, l, sequences_.size());
+        }
+
         if (!status) {
             break;
         }
@@ -269,258 +687,740 @@ void Polisher::initialize() {
         exit(1);
     }
 
-    has_name.resize(sequences_.size(), false);
-    has_data.resize(sequences_.size(), false);
-    has_reverse_data.resize(sequences_.size(), false);
-
-    WindowType window_type = static_cast<double>(total_sequences_length) /
+    window_type_ = static_cast<double>(total_sequences_length) /
         sequences_size <= 1000 ? WindowType::kNGS : WindowType::kTGS;
 
+    targets_coverages_.resize(targets_size_, 0);
+
     logger_->log("[racon::Polisher::initialize] loaded sequences");
     logger_->log();
 
-    std::vector<std::unique_ptr<Overlap>> overlaps;
-
-    auto remove_invalid_overlaps = [&](uint64_t begin, uint64_t end) -> void {
-        for (uint64_t i = begin; i < end; ++i) {
-            if (overlaps[i] == nullptr) {
-                continue;
-            }
-            if (overlaps[i]->error() > error_threshold_ ||
-                overlaps[i]->q_id() == overlaps[i]->t_id()) {
-                overlaps[i].reset();
-                continue;
+    if (stream_) {
+        // overlaps are polished in polish() while they are parsed, here they
+        // are only scanned for the data of reads they use and for the last
+        // target of each read, after which the read is released; overlaps
+        // which can be parsed only once are not scanned and all reads are
+        // kept until the end
+        has_name.resize(sequences_.size(), false);
+        has_data.resize(sequences_.size(), !oparser_->can_reset());
+        has_reverse_data.resize(sequences_.size(), false);
+
+        if (oparser_->can_reset()) {
+            stats_->begin("overlap_scan");
+
+            std::vector<uint32_t> last_targets(sequences_.size(), 0);
+            for (uint64_t i = 0; i < targets_size_; ++i) {
+                last_targets[i] = i;
             }
-            if (type_ == PolisherType::kC) {
-                for (uint64_t j = i + 1; j < end; ++j) {
-                    if (overlaps[j] == nullptr) {
-                        continue;
-                    }
-                    if (overlaps[i]->length() > overlaps[j]->length()) {
-                        overlaps[j].reset();
-                    } else {
-                        overlaps[i].reset();
-                        break;
-                    }
+
+            std::vector<std::unique_ptr<Overlap>> overlaps;
+            oparser_->reset();
+            uint64_t l = 0;
+            bool status = true;
+            while (status) {
+                status = load_overlaps(overlaps, l, has_data, has_reverse_data);
+                for (uint64_t i = 0; i < l; ++i) {
+                    auto& it = last_targets[overlaps[i]->q_id()];
+                    it = std::max(it, overlaps[i]->t_id());
+                    overlaps[i].reset();
                 }
+                shrinkToFit(overlaps, 0);
+                l = 0;
             }
-        }
-    };
 
-    oparser_->reset();
-    uint64_t l = 0;
-    while (true) {
-        auto status = oparser_->parse(overlaps, kChunkSize);
+            for (uint64_t i = 0; i < sequences_.size(); ++i) {
+                if (has_data[i] || has_reverse_data[i]) {
+                    last_targets_.emplace_back(last_targets[i], i);
+                }
+            }
+            std::sort(last_targets_.begin(), last_targets_.end());
 
-        uint64_t c = l;
-        for (uint64_t i = l; i < overlaps.size(); ++i) {
-            overlaps[i]->transmute(sequences_, name_to_id, id_to_id);
+            logger_->log("[racon::Polisher::initialize] scanned overlaps");
+            logger_->log();
+        }
 
-            if (!overlaps[i]->is_valid()) {
-                overlaps[i].reset();
-                continue;
-            }
+        stats_->begin("transmute");
 
-            while (overlaps[c] == nullptr) {
-                ++c;
-            }
-            if (overlaps[c]->q_id() != overlaps[i]->q_id()) {
-                remove_invalid_overlaps(c, i);
-                c = i;
-            }
+        // reverse strands are created per block
+        std::vector<std::future<void>> thread_futures;
+        for (uint64_t i = 0; i < sequences_.size(); ++i) {
+            thread_futures.emplace_back(thread_pool_->submit(
+                [&](uint64_t j) -> void {
+                    sequences_[j]->transmute(has_name[j], has_data[j] ||
+                        has_reverse_data[j], false, pack_reads_ && j >= targets_size_);
+                }, i));
         }
-        if (!status) {
-            remove_invalid_overlaps(c, overlaps.size());
-            c = overlaps.size();
+        for (const auto& it: thread_futures) {
+            it.wait();
         }
+        log_sequences_memory();
 
-        for (uint64_t i = l; i < c; ++i) {
-            if (overlaps[i] == nullptr) {
-                continue;
-            }
+        stats_->end();
+        logger_->log("[racon::Polisher::initialize] prepared sequences for streaming");
+        return;
+    }
+
+    has_name.resize(sequences_.size(), false);
+    has_data.resize(sequences_.size(), false);
+    has_reverse_data.resize(sequences_.size(), false);
+
+    std::vector<std::unique_ptr<Overlap>> overlaps;
+
+    stats_->begin("overlap_parse");
 
-            if (overlaps[i]->strand()) {
-                has_reverse_data[overlaps[i]->q_id()] = true;
+    if (overlap_cache_ != nullptr && overlap_cache_->load(overlaps,
+        targets_begin_, targets_end_)) {
+
+        if (targets_begin_ > targets_end_ || targets_end_ > targets_size_) {
+            fprintf(stderr, "[racon::Polisher::initialize] error: "
+                "overlap cache does not match the input!\n");
+            exit(1);
+        }
+        for (const auto& it: overlaps) {
+            if (it->q_id() >= sequences_.size() || it->t_id() >= targets_size_) {
+                fprintf(stderr, "[racon::Polisher::initialize] error: "
+                    "overlap cache does not match the input!\n");
+                exit(1);
+            }
+            if (it->strand()) {
+                has_reverse_data[it->q_id()] = true;
             } else {
-                has_data[overlaps[i]->q_id()] = true;
+                has_data[it->q_id()] = true;
             }
         }
+        // cached overlaps are already aligned
+        overlap_cache_.reset();
+    } else {
+        oparser_->reset();
+        uint64_t l = 0;
+        while (load_overlaps(overlaps, l, has_data, has_reverse_data)) {
+        }
 
-        uint64_t n = shrinkToFit(overlaps, l);
-        l = c - n;
+        if (overlaps.empty()) {
+            fprintf(stderr, "[racon::Polisher::initialize] error: "
+                "empty overlap set!\n");
+            exit(1);
+        }
 
-        if (!status) {
-            break;
+        // shards of indexed overlaps are known before they are parsed
+        if (num_shards_ > 1 && overlap_index_ == nullptr) {
+            find_shard_targets(overlaps, has_data, has_reverse_data);
         }
     }
 
-    std::unordered_map<std::string, uint64_t>().swap(name_to_id);
-    std::unordered_map<uint64_t, uint64_t>().swap(id_to_id);
-
-    if (overlaps.empty()) {
-        fprintf(stderr, "[racon::Polisher::initialize] error: "
-            "empty overlap set!\n");
-        exit(1);
-    }
+    name_to_id_.clear();
+    std::unordered_map<uint64_t, uint64_t>().swap(id_to_id_);
 
     logger_->log("[racon::Polisher::initialize] loaded overlaps");
     logger_->log();
 
+    if (num_shards_ > 1) {
+        fprintf(stderr, "[racon::Polisher::initialize] shard %u/%u polishes "
+            "target sequences [%lu, %lu)\n", shard_, num_shards_,
+            targets_begin_, targets_end_);
+    }
+
+    stats_->begin("transmute");
+
     std::vector<std::future<void>> thread_futures;
     for (uint64_t i = 0; i < sequences_.size(); ++i) {
         thread_futures.emplace_back(thread_pool_->submit(
             [&](uint64_t j) -> void {
-                sequences_[j]->transmute(has_name[j], has_data[j], has_reverse_data[j]);
+                sequences_[j]->transmute(has_name[j], has_data[j],
+                    has_reverse_data[j], pack_reads_ && j >= targets_size_);
             }, i));
     }
     for (const auto& it: thread_futures) {
         it.wait();
     }
-
-    find_overlap_breaking_points(overlaps);
+    log_sequences_memory();
 
     logger_->log();
 
-    uint32_t offset = window_length_ * overlap_percentage_;
-
-    std::vector<uint64_t> id_to_first_window_id(targets_size + 1, 0);
-    for (uint64_t i = 0; i < targets_size; ++i) {
-        uint32_t k = 0;
-        for (uint32_t j = 0; j < sequences_[i]->data().size(); j += window_length_, ++k) {
-
-            uint32_t start = j, expansion = offset;
-            if (j > 0) {
-                start -= offset;
-                expansion += offset;
-            }
-            uint32_t length = std::min(start + window_length_ + expansion,
-                static_cast<uint32_t>(sequences_[i]->data().size())) - start;
+    stats_->begin("alignment");
 
-            windows_.emplace_back(createWindow(i, k, window_type, overlap_percentage_ != 0,
-                &(sequences_[i]->data()[start]), length,
-                sequences_[i]->quality().empty() ? &(dummy_quality_[0]) :
-                &(sequences_[i]->quality()[start]), length));
-        }
+    create_windows(overlaps, targets_begin_, targets_end_);
 
-        id_to_first_window_id[i + 1] = id_to_first_window_id[i] + k;
+    find_overlap_breaking_points(overlaps);
+    if (num_rounds_ > 1) {
+        overlaps_.swap(overlaps);
     }
 
-    targets_coverages_.resize(targets_size, 0);
+    stats_->end();
 
-    for (uint64_t i = 0; i < overlaps.size(); ++i) {
+    logger_->log("[racon::Polisher::initialize] transformed data into windows");
+}
 
-        ++targets_coverages_[overlaps[i]->t_id()];
+// a target belongs to the shard in which its cost begins
+void findShardRange(const std::vector<uint64_t>& costs, uint64_t total_cost,
+    uint32_t shard, uint32_t num_shards, uint64_t& begin, uint64_t& end) {
 
-        const auto& sequence = sequences_[overlaps[i]->q_id()];
-        const auto& breaking_points = overlaps[i]->breaking_points();
+    begin = end = costs.size();
+    for (uint64_t i = 0, cost = 0; i < costs.size(); cost += costs[i++]) {
+        uint64_t s = static_cast<double>(cost) / total_cost * num_shards;
+        if (s >= shard && begin == costs.size()) {
+            begin = i;
+        }
+        if (s > shard) {
+            end = i;
+            break;
+        }
+    }
+}
 
-        uint64_t prev_window_id = -1;
+void Polisher::select_targets() {
 
-        for (uint32_t j = 0; j < breaking_points.size(); j += 2) {
-            if (breaking_points[j + 1].second - breaking_points[j].second < 0.02 * window_length_) {
-//                fprintf(stderr, "too short skip\n");
+    if (!target_names_.empty()) {
+        is_selected_target_.assign(targets_size_, false);
+        uint64_t num_selected = 0;
+        for (const auto& it: target_names_) {
+            uint64_t id = 0;
+            if (!name_to_id_.find(it, true, id)) {
+                fprintf(stderr, "[racon::Polisher::initialize] warning: "
+                    "target sequence %s not found\n", it.c_str());
                 continue;
             }
+            if (!is_selected_target_[id]) {
+                is_selected_target_[id] = true;
+                ++num_selected;
+            }
+        }
+        if (num_selected == 0) {
+            fprintf(stderr, "[racon::Polisher::initialize] error: "
+                "none of the given target sequences found!\n");
+            exit(1);
+        }
+        fprintf(stderr, "[racon::Polisher::initialize] polishing %lu of %lu "
+            "target sequences\n", num_selected, targets_size_);
+    }
 
-            if (!sequence->quality().empty() ||
-                !sequence->reverse_quality().empty()) {
-
-                const auto& quality = overlaps[i]->strand() ?
-                    sequence->reverse_quality() : sequence->quality();
-                double average_quality = 0;
-                for (uint32_t k = breaking_points[j].second; k < breaking_points[j + 1].second; ++k) {
-                    average_quality += static_cast<uint32_t>(quality[k]) - 33;
-                }
-                average_quality /= breaking_points[j + 1].second - breaking_points[j].second;
-
-                if (average_quality < quality_threshold_) {
-                    uint64_t bpw1 = breaking_points[j].first / window_length_;
-                    uint64_t bpw2 = breaking_points[j + 1].first / window_length_;
-
-                    uint64_t prev_window_id_n = id_to_first_window_id[overlaps[i]->t_id()] + bpw1;
+    if (overlap_index_ == nullptr) {
+        return;
+    }
 
-                    if (bpw2 - bpw1 > 1) {
-                        prev_window_id_n++;
-                    } else if (prev_window_id_n == prev_window_id) {
-                        prev_window_id_n++;
-                    } else if (breaking_points[j].first < bpw1 * window_length_ + offset
-                               && (j + 2 < breaking_points.size() && breaking_points[j].first == breaking_points[j + 2].first)) {
-                        prev_window_id_n--;
-                    }
+    std::vector<uint64_t> costs(targets_size_);
+    uint64_t total_cost = 0;
+    for (uint64_t i = 0; i < targets_size_; ++i) {
+        costs[i] = sequences_[i]->length() +
+            overlap_index_->num_bytes(sequences_[i]->name());
+        total_cost += costs[i];
+    }
+    auto shard_names = [&](uint32_t shard, uint64_t& begin, uint64_t& end)
+        -> std::vector<std::string> {
 
-//                    fprintf(stderr, "prev_window: %lu\n", prev_window_id);
-                    prev_window_id = prev_window_id_n;
-/*                    fprintf(stderr, "low quality skip\n"
-                                    "bp: %lu - %lu, %lu - %lu | prev_window: %lu, prev_window_n: %lu\n",
-                            breaking_points[j].first, breaking_points[j + 1].first,
-                            breaking_points[j].second, breaking_points[j + 1].second,
-                            prev_window_id, prev_window_id_n);*/
-                    continue;
-                }
+        begin = 0;
+        end = targets_size_;
+        if (num_shards_ > 1) {
+            findShardRange(costs, total_cost, shard, num_shards_, begin, end);
+        }
+        std::vector<std::string> names;
+        for (uint64_t i = begin; i < end; ++i) {
+            if (is_selected_target_.empty() || is_selected_target_[i]) {
+                names.emplace_back(sequences_[i]->name());
             }
+        }
+        return names;
+    };
 
-            uint64_t bpw1 = breaking_points[j].first / window_length_;
-            uint64_t bpw2 = breaking_points[j + 1].first / window_length_;
-
-            uint64_t window_id = id_to_first_window_id[overlaps[i]->t_id()] + bpw1;
-            if (bpw2 - bpw1 > 1) {
-                window_id++;
-            } else if (window_id == prev_window_id) {
-                window_id++;
-            } else if (breaking_points[j].first < bpw1 * window_length_ + offset 
-                       && (j + 2 < breaking_points.size() && breaking_points[j].first == breaking_points[j + 2].first)) {
-                window_id--;
+    // every shard has to make the same choice so that shards do not overlap
+    if (type_ == PolisherType::kC) {
+        std::vector<std::string> names;
+        for (uint64_t i = 0; i < targets_size_; ++i) {
+            names.emplace_back(sequences_[i]->name());
+        }
+        for (uint32_t i = 0; i < num_shards_; ++i) {
+            uint64_t begin = 0, end = 0;
+            if (overlap_index_->splits_queries(names, shard_names(i, begin, end))) {
+                fprintf(stderr, "[racon::Polisher::initialize] warning: "
+                    "overlaps of some query sequences span selected and other "
+                    "target sequences, reading overlaps sequentially\n");
+                overlap_index_.reset();
+                return;
             }
-            prev_window_id = window_id;
+        }
+    }
 
-            uint32_t window_start = (window_id - id_to_first_window_id[overlaps[i]->t_id()]) * window_length_;
-            if (window_start > 0) {
-                window_start -= offset;
+    oparser_ = overlap_index_->select(shard_names(shard_, targets_begin_,
+        targets_end_), thread_to_id_.size());
+}
+
+void Polisher::find_shard_targets(std::vector<std::unique_ptr<Overlap>>& overlaps,
+    std::vector<bool>& has_data, std::vector<bool>& has_reverse_data) {
+
+    // every shard sees the same overlaps and computes the same ranges
+    std::vector<uint64_t> costs(targets_size_);
+    uint64_t total_cost = 0;
+    for (uint64_t i = 0; i < targets_size_; ++i) {
+        costs[i] = sequences_[i]->length();
+        total_cost += costs[i];
+    }
+    for (const auto& it: overlaps) {
+        costs[it->t_id()] += it->length();
+        total_cost += it->length();
+    }
+
+    findShardRange(costs, total_cost, shard_, num_shards_, targets_begin_,
+        targets_end_);
+
+    for (auto& it: overlaps) {
+        if (it->t_id() < targets_begin_ || it->t_id() >= targets_end_) {
+            it.reset();
+        }
+    }
+    shrinkToFit(overlaps, 0);
+
+    std::fill(has_data.begin() + targets_size_, has_data.end(), false);
+    std::fill(has_reverse_data.begin(), has_reverse_data.end(), false);
+    for (const auto& it: overlaps) {
+        if (it->strand()) {
+            has_reverse_data[it->q_id()] = true;
+        } else {
+            has_data[it->q_id()] = true;
+        }
+    }
+}
+
+bool Polisher::load_overlaps(std::vector<std::unique_ptr<Overlap>>& overlaps,
+    uint64_t& l, std::vector<bool>& has_data, std::vector<bool>& has_reverse_data) {
+
+    auto remove_invalid_overlaps = [&](uint64_t begin, uint64_t end) -> void {
+        for (uint64_t i = begin; i < end; ++i) {
+            if (overlaps[i] == nullptr) {
+                continue;
             }
+            if (overlaps[i]->error() > error_threshold_ ||
+                overlaps[i]->q_id() == overlaps[i]->t_id()) {
+                overlaps[i].reset();
+                continue;
+            }
+            if (type_ == PolisherType::kC) {
+                for (uint64_t j = i + 1; j < end; ++j) {
+                    if (overlaps[j] == nullptr) {
+                        continue;
+                    }
+                    if (overlaps[i]->length() > overlaps[j]->length()) {
+                        overlaps[j].reset();
+                    } else {
+                        overlaps[i].reset();
+                        break;
+                    }
+                }
+            }
+        }
+    };
 
-            const char* data = overlaps[i]->strand() ?
-                &(sequence->reverse_complement()[breaking_points[j].second]) :
-                &(sequence->data()[breaking_points[j].second]);
-            uint32_t data_length = breaking_points[j + 1].second -
-                breaking_points[j].second;
+    // the next chunk is parsed in the background while this one is processed
+    auto parse_next = [&]() -> void {
+        next_overlaps_status_ = std::async(std::launch::async, [&]() -> bool {
+            return oparser_->parse(next_overlaps_, stream_ ? kStreamChunkSize : kChunkSize);
+        });
+    };
 
-            const char* quality = overlaps[i]->strand() ?
-                (sequence->reverse_quality().empty() ?
-                    nullptr : &(sequence->reverse_quality()[breaking_points[j].second]))
-                :
-                (sequence->quality().empty() ?
-                    nullptr : &(sequence->quality()[breaking_points[j].second]));
-            uint32_t quality_length = quality == nullptr ? 0 : data_length;
+    if (!next_overlaps_status_.valid()) {
+        parse_next();
+    }
+    auto status = next_overlaps_status_.get();
+    uint64_t begin = overlaps.size();
+    for (auto& it: next_overlaps_) {
+        overlaps.emplace_back(std::move(it));
+    }
+    std::vector<std::unique_ptr<Overlap>>().swap(next_overlaps_);
+    if (status) {
+        parse_next();
+    }
 
-/*            fprintf(stderr, "id: %lu | bp: %lu - %lu, %lu - %lu | start: %u\n", 
-                    window_id, 
-                    breaking_points[j].first, breaking_points[j+1].first,
-                    breaking_points[j].second, breaking_points[j+1].second,
-                    window_start);*/
-            windows_[window_id]->add_layer(data, data_length,
-                quality, quality_length,
+    uint64_t num_threads = thread_to_id_.size();
+    uint64_t block_size = std::max(static_cast<uint64_t>(1),
+        (overlaps.size() - begin) / (num_threads * 4));
+
+    std::vector<std::future<void>> thread_futures;
+    for (uint64_t i = begin; i < overlaps.size(); i += block_size) {
+        thread_futures.emplace_back(thread_pool_->submit(
+            [&](uint64_t j) -> void {
+                uint64_t end = std::min(j + block_size, static_cast<uint64_t>(overlaps.size()));
+                for (; j < end; ++j) {
+                    overlaps[j]->transmute(sequences_, name_to_id_, id_to_id_);
+                    if (!overlaps[j]->is_valid()) {
+                        overlaps[j].reset();
+                    }
+                }
+            }, i));
+    }
+    for (const auto& it: thread_futures) {
+        it.wait();
+    }
+    thread_futures.clear();
+
+    // overlaps of one query are filtered together, hence blocks are split
+    // only between two queries (the last query might continue in the next
+    // chunk unless this is the last one)
+    std::vector<uint64_t> queries;
+    for (uint64_t i = l; i < overlaps.size(); ++i) {
+        if (overlaps[i] == nullptr) {
+            continue;
+        }
+        if (queries.empty() || overlaps[queries.back()]->q_id() != overlaps[i]->q_id()) {
+            queries.emplace_back(i);
+        }
+    }
+    uint64_t c = overlaps.size();
+    if (status && !queries.empty()) {
+        c = queries.back();
+        queries.pop_back();
+    }
+    queries.emplace_back(c);
+
+    for (uint64_t i = 0, j = 0; i + 1 < queries.size(); i = j) {
+        j = i + 1;
+        while (j + 1 < queries.size() && queries[j] - queries[i] < block_size) {
+            ++j;
+        }
+        thread_futures.emplace_back(thread_pool_->submit(
+            [&](uint64_t first, uint64_t last) -> void {
+                for (uint64_t k = first; k < last; ++k) {
+                    remove_invalid_overlaps(queries[k], queries[k + 1]);
+                }
+            }, i, j));
+    }
+    for (const auto& it: thread_futures) {
+        it.wait();
+    }
+
+    // overlaps of other targets are dropped only after filtering so that
+    // selected targets get the same overlaps as in a run without selection
+    uint64_t n = 0;
+    for (uint64_t i = l; i < c; ++i) {
+        if (overlaps[i] != nullptr && !is_selected_target_.empty() &&
+            !is_selected_target_[overlaps[i]->t_id()]) {
+            overlaps[i].reset();
+        }
+        if (overlaps[i] == nullptr) {
+            ++n;
+            continue;
+        }
+
+        if (overlaps[i]->strand()) {
+            has_reverse_data[overlaps[i]->q_id()] = true;
+        } else {
+            has_data[overlaps[i]->q_id()] = true;
+        }
+    }
+
+    // only removed overlaps before c shift the first pending one
+    shrinkToFit(overlaps, l);
+    l = c - n;
+
+    return status;
+}
+
+void Polisher::stream_overlaps(std::vector<std::unique_ptr<Sequence>>& dst,
+    bool drop_unpolished_sequences) {
+
+    // data usage is already known for every sequence, these are ignored
+    std::vector<bool> has_data(sequences_.size(), true);
+    std::vector<bool> has_reverse_data(sequences_.size(), false);
+
+    std::vector<std::unique_ptr<Overlap>> overlaps;
+    uint64_t l = 0, num_overlaps = 0, targets_begin = 0, num_released = 0;
+
+    oparser_->reset();
+
+    // parsing of the next chunk runs while the current block is polished
+    auto load_next = [&]() -> std::future<bool> {
+        return std::async(std::launch::async, [&]() -> bool {
+            return load_overlaps(overlaps, l, has_data, has_reverse_data);
+        });
+    };
+
+    auto loader = load_next();
+    while (true) {
+        auto status = loader.get();
+
+        // overlaps are sorted by target, thus all targets below the one of
+        // the first pending overlap are complete (all of them if at the end)
+        uint64_t targets_end = targets_size_;
+        if (status) {
+            targets_end = overlaps.empty() ? targets_begin : overlaps.back()->t_id();
+            for (uint64_t i = l; i < overlaps.size(); ++i) {
+                if (overlaps[i] != nullptr) {
+                    targets_end = std::min(targets_end,
+                        static_cast<uint64_t>(overlaps[i]->t_id()));
+                    break;
+                }
+            }
+            targets_end = std::max(targets_end, targets_begin);
+        }
+
+        std::vector<std::unique_ptr<Overlap>> block;
+        uint64_t n = 0;
+        for (uint64_t i = 0; i < l; ++i) {
+            if (overlaps[i]->t_id() < targets_begin) {
+                fprintf(stderr, "[racon::Polisher::polish] error: "
+                    "overlaps are not sorted by target sequences!\n");
+                exit(1);
+            }
+            if (overlaps[i]->t_id() < targets_end) {
+                block.emplace_back(std::move(overlaps[i]));
+                ++n;
+            }
+        }
+        shrinkToFit(overlaps, 0);
+        l -= n;
+
+        if (status) {
+            loader = load_next();
+        }
+
+        num_overlaps += block.size();
+
+        // packed reads decode their reverse strand on demand
+        std::vector<uint64_t> reverse_ids;
+        for (const auto& it: block) {
+            if (it->strand() && !sequences_[it->q_id()]->is_packed()) {
+                reverse_ids.emplace_back(it->q_id());
+            }
+        }
+        std::sort(reverse_ids.begin(), reverse_ids.end());
+        reverse_ids.erase(std::unique(reverse_ids.begin(), reverse_ids.end()),
+            reverse_ids.end());
+
+        std::vector<std::future<void>> thread_futures;
+        for (const auto& it: reverse_ids) {
+            thread_futures.emplace_back(thread_pool_->submit(
+                [&](uint64_t j) -> void {
+                    sequences_[j]->create_reverse_complement();
+                }, it));
+        }
+        for (const auto& it: thread_futures) {
+            it.wait();
+        }
+
+        if (targets_end > targets_begin) {
+            create_windows(block, targets_begin, targets_end);
+            find_overlap_breaking_points(block);
+            polish_windows(dst, drop_unpolished_sequences);
+
+            logger_->log("[racon::Polisher::polish] polished " +
+                std::to_string(targets_end) + "/" + std::to_string(targets_size_) +
+                " target sequences");
+        }
+        targets_begin = targets_end;
+
+        // overlaps of later blocks do not use these, names are kept
+        for (; num_released < last_targets_.size() &&
+            last_targets_[num_released].first < targets_end; ++num_released) {
+            sequences_[last_targets_[num_released].second]->release();
+        }
+
+        if (!status) {
+            break;
+        }
+    }
+
+    name_to_id_.clear();
+    std::unordered_map<uint64_t, uint64_t>().swap(id_to_id_);
+
+    if (num_overlaps == 0) {
+        fprintf(stderr, "[racon::Polisher::polish] error: "
+            "empty overlap set!\n");
+        exit(1);
+    }
+}
+
+void Polisher::create_windows(std::vector<std::unique_ptr<Overlap>>& overlaps,
+    uint64_t targets_begin, uint64_t targets_end) {
+
+    uint32_t offset = window_length_ * overlap_percentage_;
+
+    windows_targets_begin_ = targets_begin;
+    std::vector<uint64_t>(targets_end - targets_begin + 1, 0).swap(id_to_first_window_id_);
+    for (uint64_t i = targets_begin; i < targets_end; ++i) {
+        uint32_t k = 0;
+        for (uint32_t j = 0; j < sequences_[i]->data().size(); j += window_length_, ++k) {
+
+            uint32_t start = j, expansion = offset;
+            if (j > 0) {
+                start -= offset;
+                expansion += offset;
+            }
+            uint32_t length = std::min(start + window_length_ + expansion,
+                static_cast<uint32_t>(sequences_[i]->data().size())) - start;
+
+            windows_.emplace_back(createWindow(i, k, window_type_, overlap_percentage_ != 0,
+                &(sequences_[i]->data()[start]), length,
+                sequences_[i]->quality().empty() ? &(dummy_quality_[0]) :
+                &(sequences_[i]->quality()[start]), length));
+        }
+
+        id_to_first_window_id_[i - targets_begin + 1] =
+            id_to_first_window_id_[i - targets_begin] + k;
+    }
+
+    for (const auto& it: overlaps) {
+        ++targets_coverages_[it->t_id()];
+    }
+}
+
+void Polisher::add_layers(const Overlap& overlap, uint64_t key) {
+
+    uint32_t offset = window_length_ * overlap_percentage_;
+
+    const auto& sequence = sequences_[overlap.q_id()];
+    auto breaking_points = overlap.breaking_points().decode();
+
+    uint64_t prev_window_id = -1;
+
+    for (uint32_t j = 0; j < breaking_points.size(); j += 2) {
+        if (breaking_points[j + 1].second - breaking_points[j].second < 0.02 * window_length_) {
+//                fprintf(stderr, "too short skip\n");
+            continue;
+        }
+
+        // decided from the quality index of the read without touching its
+        // qualities in most cases
+        if (sequence->has_quality()) {
+
+            if (sequence->is_low_quality(overlap.strand(),
+                breaking_points[j].second, breaking_points[j + 1].second,
+                quality_threshold_)) {
+                uint64_t bpw1 = breaking_points[j].first / window_length_;
+                uint64_t bpw2 = breaking_points[j + 1].first / window_length_;
+
+                uint64_t prev_window_id_n = id_to_first_window_id_[overlap.t_id() - windows_targets_begin_] + bpw1;
+
+                if (bpw2 - bpw1 > 1) {
+                    prev_window_id_n++;
+                } else if (prev_window_id_n == prev_window_id) {
+                    prev_window_id_n++;
+                } else if (breaking_points[j].first < bpw1 * window_length_ + offset
+                           && (j + 2 < breaking_points.size() && breaking_points[j].first == breaking_points[j + 2].first)) {
+                    prev_window_id_n--;
+                }
+
+//                    fprintf(stderr, "prev_window: %lu\n", prev_window_id);
+                prev_window_id = prev_window_id_n;
+/*                    fprintf(stderr, "low quality skip\n"
+                                "bp: %lu - %lu, %lu - %lu | prev_window: %lu, prev_window_n: %lu\n",
+                        breaking_points[j].first, breaking_points[j + 1].first,
+                        breaking_points[j].second, breaking_points[j + 1].second,
+                        prev_window_id, prev_window_id_n);*/
+                continue;
+            }
+        }
+
+        uint64_t bpw1 = breaking_points[j].first / window_length_;
+        uint64_t bpw2 = breaking_points[j + 1].first / window_length_;
+
+        uint64_t window_id = id_to_first_window_id_[overlap.t_id() - windows_targets_begin_] + bpw1;
+        if (bpw2 - bpw1 > 1) {
+            window_id++;
+        } else if (window_id == prev_window_id) {
+            window_id++;
+        } else if (breaking_points[j].first < bpw1 * window_length_ + offset 
+                   && (j + 2 < breaking_points.size() && breaking_points[j].first == breaking_points[j + 2].first)) {
+            window_id--;
+        }
+        prev_window_id = window_id;
+
+        uint32_t window_start = (window_id - id_to_first_window_id_[overlap.t_id() - windows_targets_begin_]) * window_length_;
+        if (window_start > 0) {
+            window_start -= offset;
+        }
+
+        uint32_t data_length = breaking_points[j + 1].second -
+            breaking_points[j].second;
+
+        // layers of packed sequences are decoded by the window when needed
+        if (sequence->is_packed()) {
+            windows_[window_id]->add_layer(sequence.get(), overlap.strand(),
+                breaking_points[j].second, data_length,
                 breaking_points[j].first - window_start,
                 breaking_points[j + 1].first - window_start - 1,
-                overlaps[i]->q_id());
+                overlap.q_id(), key);
+            continue;
         }
 
-        overlaps[i].reset();
-    }
+        // plain sequences are accessed directly and the buffers stay empty
+        std::string data_buffer, quality_buffer;
+        const char* data = sequence->data(overlap.strand(),
+            breaking_points[j].second, data_length, data_buffer);
+        const char* quality = sequence->quality(overlap.strand(),
+            breaking_points[j].second, data_length, quality_buffer);
+        uint32_t quality_length = quality == nullptr ? 0 : data_length;
 
-    logger_->log("[racon::Polisher::initialize] transformed data into windows");
+/*            fprintf(stderr, "id: %lu | bp: %lu - %lu, %lu - %lu | start: %u\n", 
+                window_id, 
+                breaking_points[j].first, breaking_points[j+1].first,
+                breaking_points[j].second, breaking_points[j+1].second,
+                window_start);*/
+        // the average quality is taken from the quality index of the read
+        // so that windows do not scan layer qualities when subsampled
+        windows_[window_id]->add_layer(data, data_length,
+            quality, quality_length,
+            breaking_points[j].first - window_start,
+            breaking_points[j + 1].first - window_start - 1,
+            overlap.q_id(), key, sequence->average_quality(overlap.strand(),
+                breaking_points[j].second, breaking_points[j + 1].second));
+    }
 }
 
 void Polisher::find_overlap_breaking_points(std::vector<std::unique_ptr<Overlap>>& overlaps)
 {
+    // all-vs-all overlaps usually list each pair of reads in both directions,
+    // only the first of the two is aligned
+    std::vector<uint64_t> reciprocals;
+    if (type_ == PolisherType::kF) {
+        reciprocals = findReciprocalOverlaps(overlaps);
+    }
+
     std::vector<std::future<void>> thread_futures;
     for (uint64_t i = 0; i < overlaps.size(); ++i) {
+        if (!reciprocals.empty() && reciprocals[i] < i) {
+            continue;
+        }
         thread_futures.emplace_back(thread_pool_->submit(
             [&](uint64_t j) -> void {
-                overlaps[j]->find_breaking_points(sequences_, window_length_, overlap_percentage_);
+                uint64_t r = reciprocals.empty() ? overlaps.size() : reciprocals[j];
+                // a CIGAR string of either of the two spares the alignment
+                if (r < overlaps.size() && !overlaps[j]->has_cigar() &&
+                    overlaps[r]->has_cigar()) {
+                    std::swap(j, r);
+                }
+                Overlap* reciprocal = r < overlaps.size() ? overlaps[r].get() : nullptr;
+
+                auto begin = std::chrono::steady_clock::now();
+                overlaps[j]->find_breaking_points(sequences_, window_length_,
+                    overlap_percentage_, *aligner_, reciprocal);
+                if (overlap_cache_ != nullptr) {
+                    overlap_cache_->store(j, *overlaps[j]);
+                    if (reciprocal != nullptr) {
+                        overlap_cache_->store(r, *reciprocal);
+                    }
+                }
+                auto aligned = std::chrono::steady_clock::now();
+                // layers are binned right away so that breaking points of
+                // all overlaps are never kept at once
+                add_layers(*overlaps[j], j);
+                if (reciprocal != nullptr) {
+                    add_layers(*reciprocal, r);
+                }
+                stats_->add(StatsTask::kAlignment, secondsBetween(begin, aligned));
+                stats_->add(StatsTask::kBinning, secondsBetween(aligned,
+                    std::chrono::steady_clock::now()));
+                for (uint64_t k: { j, r }) {
+                    if (k >= overlaps.size()) {
+                        continue;
+                    }
+                    // breaking points are kept for the next round, overlaps
+                    // on unchanged parts of targets are not aligned again
+                    if (round_ + 1 == num_rounds_) {
+                        overlaps[k].reset();
+                    }
+                }
             }, i));
     }
 
-    uint32_t logger_step = thread_futures.size() / 20;
+    uint32_t logger_step = stream_ ? 0 : thread_futures.size() / 20;
     for (uint64_t i = 0; i < thread_futures.size(); ++i) {
         thread_futures[i].wait();
         if (logger_step != 0 && (i + 1) % logger_step == 0 && (i + 1) / logger_step < 20) {
@@ -529,223 +1429,640 @@ void Polisher::find_overlap_breaking_points(std::vector<std::unique_ptr<Overlap>
     }
     if (logger_step != 0) {
         logger_->bar("[racon::Polisher::initialize] aligning overlaps");
-    } else {
+    } else if (!stream_) {
         logger_->log("[racon::Polisher::initialize] aligned overlaps");
     }
-}
-
-void Polisher::polish(std::vector<std::unique_ptr<Sequence>>& dst,
-    bool drop_unpolished_sequences) {
 
-    logger_->log();
+    if (overlap_cache_ != nullptr) {
+        overlap_cache_->finish(targets_begin_, targets_end_);
+        overlap_cache_.reset();
+    }
 
-    std::vector<std::future<bool>> thread_futures;
+    // restore the order in which layers would be added sequentially and
+    // cap window depths
+    std::atomic<uint64_t> num_subsampled_windows(0);
+    thread_futures.clear();
     for (uint64_t i = 0; i < windows_.size(); ++i) {
         thread_futures.emplace_back(thread_pool_->submit(
-            [&](uint64_t j) -> bool {
-                auto it = thread_to_id_.find(std::this_thread::get_id());
-                if (it == thread_to_id_.end()) {
-                    fprintf(stderr, "[racon::Polisher::polish] error: "
-                        "thread identifier not present!\n");
-                    exit(1);
+            [&](uint64_t j) -> void {
+                windows_[j]->sort_layers();
+                if (windows_[j]->subsample_layers(max_window_depth_)) {
+                    ++num_subsampled_windows;
                 }
-                return windows_[j]->generate_consensus(
-                    alignment_engines_[it->second], overlap_percentage_ == 0 ? trim_ : false);
             }, i));
     }
+    for (const auto& it: thread_futures) {
+        it.wait();
+    }
 
-    std::string polished_data = "";
-    uint32_t num_polished_windows = 0;
+    if (num_subsampled_windows > 0) {
+        fprintf(stderr, "[racon::Polisher::find_overlap_breaking_points] "
+            "subsampled %lu windows to %u layers\n",
+            num_subsampled_windows.load(), max_window_depth_);
+    }
+}
 
-    uint64_t logger_step = thread_futures.size() / 20;
+void Polisher::polish(std::vector<std::unique_ptr<Sequence>>& dst,
+    bool drop_unpolished_sequences) {
 
     if (overlap_percentage_ == 0) {
         fprintf(stderr, "[racon::Polisher::polish] default mode\n");
-        for (uint64_t i = 0; i < thread_futures.size(); ++i) {
-            thread_futures[i].wait();
-
-            num_polished_windows += thread_futures[i].get() == true ? 1 : 0;
-            polished_data += windows_[i]->consensus();
-
-            if (i == windows_.size() - 1 || windows_[i + 1]->rank() == 0) {
-                double polished_ratio = num_polished_windows /
-                                        static_cast<double>(windows_[i]->rank() + 1);
-
-                if (!drop_unpolished_sequences || polished_ratio > 0) {
-                    std::string tags = type_ == PolisherType::kF ? "r" : "";
-                    tags += " LN:i:" + std::to_string(polished_data.size());
-                    tags += " RC:i:" + std::to_string(targets_coverages_[windows_[i]->id()]);
-                    tags += " XC:f:" + std::to_string(polished_ratio);
-                    dst.emplace_back(createSequence(sequences_[windows_[i]->id()]->name() +
-                                                    tags, polished_data));
-                }
+    } else {
+        fprintf(stderr, "[racon::Polisher::polish] overlap mode\n");
+    }
 
-                num_polished_windows = 0;
-                polished_data.clear();
-            }
-            windows_[i].reset();
+    logger_->log();
 
-            if (logger_step != 0 && (i + 1) % logger_step == 0 && (i + 1) / logger_step < 20) {
-                logger_->bar("[racon::Polisher::polish] generating consensus");
-            }
-        }
+    if (stream_) {
+        // parsing, alignment and consensus of blocks overlap in time
+        stats_->begin("streaming");
+        stream_overlaps(dst, drop_unpolished_sequences);
+        logger_->log("[racon::Polisher::polish] generated consensus");
     } else {
-        fprintf(stderr, "[racon::Polisher::polish] overlap mode\n");
-        double total_overlap = 2 * overlap_percentage_;
-        auto overlap_alignment_engine = spoa::createAlignmentEngine(spoa::AlignmentType::kOV, 3, -5, -6);
-        overlap_alignment_engine->prealloc((1 + total_overlap) * window_length_ * total_overlap * 1.2, 5);
-        auto graph = spoa::createGraph();
+        while (round_ + 1 < num_rounds_) {
+            next_round();
+        }
+        stats_->begin("consensus");
+        polish_windows(dst, drop_unpolished_sequences);
+    }
+    stats_->end();
+
+    log_windows_cost();
+
+    std::vector<std::shared_ptr<Window>>().swap(windows_);
+    std::vector<std::unique_ptr<Sequence>>().swap(sequences_);
+}
+
+void Polisher::polish(Sink& dst, bool drop_unpolished_sequences) {
+
+    if (dst.has_quality() && overlap_percentage_ != 0) {
+        fprintf(stderr, "[racon::Polisher::polish] error: "
+            "consensus qualities are not available in overlap mode!\n");
+        exit(1);
+    }
+
+    // sequences which are not pushed while polishing (i.e. polished on GPUs)
+    // are pushed once all are done
+    std::vector<std::unique_ptr<Sequence>> polished;
+    sink_ = &dst;
+    polish(polished, drop_unpolished_sequences);
+    sink_ = nullptr;
+
+    auto begin = std::chrono::steady_clock::now();
+    for (auto& it: polished) {
+        dst.write(std::move(it));
+    }
+    if (!polished.empty()) {
+        stats_->add(StatsTask::kOutput, secondsBetween(begin,
+            std::chrono::steady_clock::now()));
+    }
+}
 
-        uint32_t gap_count = 0;
+void Polisher::next_round() {
 
-        for (uint64_t i = 0; i < thread_futures.size(); ++i) {
-            thread_futures[i].wait();
+    std::vector<std::unique_ptr<Sequence>> polished;
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> anchors;
+    stats_->begin("consensus");
+    polish_windows(polished, false, &anchors);
 
-            num_polished_windows += thread_futures[i].get() == true ? 1 : 0;
+    std::vector<std::shared_ptr<Window>>().swap(windows_);
+    ++round_;
+
+    logger_->log("[racon::Polisher::polish] finished round " +
+        std::to_string(round_) + "/" + std::to_string(num_rounds_));
+    logger_->log();
 
-            if (windows_[i]->rank() == 0) {
-                auto& consensus = windows_[i]->consensus();
-                polished_data += consensus.substr(0, consensus.size() - total_overlap * consensus.size());
+    // read data stays in memory, only targets are replaced; spans between
+    // anchors which did not move and whose content did not change are kept
+    // so that alignments of overlaps inside them can be reused
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> unchanged_spans(targets_size_);
+    for (uint64_t i = 0; i < targets_size_; ++i) {
+        if (polished[i] == nullptr || polished[i]->data().empty()) {
+            anchors[i] = { {0, 0}, {sequences_[i]->length(), sequences_[i]->length()} };
+            unchanged_spans[i].emplace_back(0, sequences_[i]->length());
+            continue;
+        }
+        const auto& data = sequences_[i]->data();
+        const auto& polished_data = polished[i]->data();
+        for (uint64_t j = 1; j < anchors[i].size(); ++j) {
+            const auto& prev = anchors[i][j - 1];
+            const auto& next = anchors[i][j];
+            if (prev.first != prev.second || next.first != next.second ||
+                next.first <= prev.first || data.compare(prev.first,
+                    next.first - prev.first, polished_data, prev.second,
+                    next.second - prev.second) != 0) {
+                continue;
+            }
+            if (!unchanged_spans[i].empty() && unchanged_spans[i].back().second == prev.first) {
+                unchanged_spans[i].back().second = next.first;
             } else {
-                auto& consensus_l = windows_[i - 1]->consensus();
-                auto& summary_l = windows_[i - 1]->summary();
-                auto& coder_l = windows_[i - 1]->coder();
-                uint32_t gap_line_l = summary_l.size() / consensus_l.size() - 1;
-                uint32_t len_l = consensus_l.size() * total_overlap;
-                uint32_t start_l = consensus_l.size() - len_l;
-
-                auto& consensus_r = windows_[i]->consensus();
-                auto& summary_r = windows_[i]->summary();
-                auto& coder_r = windows_[i]->coder();
-                uint32_t gap_line_r = summary_r.size() / consensus_r.size() - 1;
-                uint32_t len_r = consensus_r.size() * total_overlap;
-                // TODO see how to best avoid using the whole window for last alignment
-                if (i == windows_.size() - 1 || windows_[i + 1]->rank() == 0) {
-                    len_r = consensus_r.size();
+                unchanged_spans[i].emplace_back(prev.first, next.first);
+            }
+        }
+        sequences_[i] = createSequence(sequences_[i]->name(), polished_data);
+        polished[i].reset();
+    }
+
+    stats_->begin("alignment");
+
+    // overlaps of queries which are targets themselves can not be lifted
+    std::vector<std::future<void>> thread_futures;
+    for (uint64_t i = 0; i < overlaps_.size(); ++i) {
+        thread_futures.emplace_back(thread_pool_->submit(
+            [&](uint64_t j) -> void {
+                overlaps_[j]->lift(anchors[overlaps_[j]->t_id()],
+                    unchanged_spans[overlaps_[j]->t_id()]);
+                if (!overlaps_[j]->is_valid() || overlaps_[j]->q_id() < targets_size_) {
+                    overlaps_[j].reset();
                 }
+            }, i));
+    }
+    for (const auto& it: thread_futures) {
+        it.wait();
+    }
+    shrinkToFit(overlaps_, 0);
 
-                graph->add_alignment(spoa::Alignment(), &(consensus_l[start_l]), len_l);
-                spoa::Alignment alignment = overlap_alignment_engine->align(&(consensus_r[0]), len_r, graph);
-                graph->add_alignment(alignment, &(consensus_r[0]), len_r);
+    std::fill(targets_coverages_.begin(), targets_coverages_.end(), 0);
 
-                std::vector<std::string> msa;
-                graph->generate_multiple_sequence_alignment(msa);
+    uint64_t num_kept_overlaps = 0;
+    for (const auto& it: overlaps_) {
+        if (it->has_alignment()) {
+            ++num_kept_overlaps;
+        }
+    }
+    if (num_kept_overlaps > 0) {
+        fprintf(stderr, "[racon::Polisher::polish] kept breaking points of "
+            "%lu/%zu overlaps on unchanged target spans\n",
+            num_kept_overlaps, overlaps_.size());
+    }
 
-                std::string overlap = "";
+    create_windows(overlaps_, targets_begin_, targets_end_);
 
-                uint32_t len_msa = msa[0].size();
-                uint32_t first_match_pos = -1;
-                uint32_t last_match_pos = -1;
-                uint32_t l_pos = start_l;
-                uint32_t r_pos = 0;
-                std::string right = "";
-                for (uint32_t j = 0; j < len_msa; ++j) {
-                    if (msa[0][j] == msa[1][j]) {
-                        first_match_pos = j;
-                        break;
-                    }
-                    if (msa[0][j] != '-') {
-                        overlap += msa[0][j];
-                        l_pos++;
-                    } else {
-                        gap_count++;
-                    }
-                    if (msa[1][j] != '-') {
-                        r_pos++;
-                    }
+    // overlaps have no CIGAR strings from now on, only those whose breaking
+    // points were cleared are aligned anew
+    find_overlap_breaking_points(overlaps_);
+    if (round_ + 1 == num_rounds_) {
+        std::vector<std::unique_ptr<Overlap>>().swap(overlaps_);
+    }
+
+    logger_->log("[racon::Polisher::polish] lifted overlaps onto polished "
+        "target sequences");
+}
+
+void Polisher::polish_windows(std::vector<std::unique_ptr<Sequence>>& dst,
+    bool drop_unpolished_sequences,
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>>* anchors) {
+
+    // windows of one target sequence are consecutive, a target sequence is
+    // stitched as soon as all of its windows are done regardless of others
+    std::vector<std::pair<uint64_t, uint64_t>> targets;
+    for (uint64_t i = 0; i < windows_.size(); ++i) {
+        if (windows_[i]->rank() == 0) {
+            targets.emplace_back(i, i);
+        }
+        ++targets.back().second;
+    }
+
+    // in overlap mode neighbouring windows are joined by the worker which
+    // finishes the latter of the two, joins[i] is the join of windows i - 1
+    // and i and a target is done once all of its windows and joins are
+    bool is_overlap_mode = overlap_percentage_ != 0;
+    std::vector<std::string> joins(is_overlap_mode ? windows_.size() : 0);
+    std::vector<std::atomic<uint8_t>> num_pending_joins(joins.size());
+    std::vector<std::vector<int32_t>> matrices(is_overlap_mode ? thread_to_id_.size() : 0);
+
+    std::vector<uint64_t> window_to_target(windows_.size());
+    std::vector<uint64_t> target_ids(targets.size());
+    std::vector<std::atomic<uint32_t>> num_pending_windows(targets.size());
+    for (uint64_t i = 0; i < targets.size(); ++i) {
+        uint64_t num_windows = targets[i].second - targets[i].first;
+        target_ids[i] = windows_[targets[i].first]->id();
+        num_pending_windows[i] = is_overlap_mode ? 2 * num_windows - 1 : num_windows;
+        for (uint64_t j = targets[i].first; j < targets[i].second; ++j) {
+            window_to_target[j] = i;
+            if (is_overlap_mode) {
+                num_pending_joins[j] = j == targets[i].first ? 0 : 2;
+            }
+        }
+    }
+
+    // done targets wait here until all before them are output, unless the
+    // output is unordered
+    std::vector<uint64_t> done_targets;
+    done_targets.reserve(targets.size());
+    std::vector<uint8_t> is_done_target(targets.size(), 0);
+    std::mutex done_targets_mutex;
+    std::condition_variable done_targets_condition;
+
+    // consensus qualities are needed only by sinks which output them
+    bool has_quality = anchors == nullptr && sink_ != nullptr && sink_->has_quality();
+
+    // windows are dispatched longest (estimated) processing time first so
+    // that the heaviest ones are not left for the end of the run
+    std::vector<uint64_t> costs(windows_.size());
+    std::vector<uint64_t> order(windows_.size());
+    for (uint64_t i = 0; i < order.size(); ++i) {
+        costs[i] = windows_[i]->cost();
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint64_t lhs, uint64_t rhs) {
+        return costs[lhs] > costs[rhs];
+    });
+
+    std::vector<double> times(windows_.size(), 0);
+    std::vector<uint8_t> is_polished(windows_.size(), 0);
+    auto polish_window = [&](uint64_t j) -> void {
+        auto it = thread_to_id_.find(std::this_thread::get_id());
+        if (it == thread_to_id_.end()) {
+            fprintf(stderr, "[racon::Polisher::polish] error: "
+                "thread identifier not present!\n");
+            exit(1);
+        }
+        uint32_t num_layers = windows_[j]->q_ids().size();
+        auto begin = std::chrono::steady_clock::now();
+        is_polished[j] = windows_[j]->generate_consensus(
+            alignment_engines_[it->second], graphs_[it->second],
+            overlap_percentage_ == 0 ? trim_ : false, has_quality);
+        times[j] = std::chrono::duration_cast<std::chrono::duration<double>>(
+            std::chrono::steady_clock::now() - begin).count();
+        stats_->add(StatsTask::kConsensus, times[j], num_layers);
+
+        uint64_t t = window_to_target[j];
+        auto finish = [&]() -> void {
+            if (--num_pending_windows[t] == 0) {
+                std::lock_guard<std::mutex> lock(done_targets_mutex);
+                done_targets.emplace_back(t);
+                is_done_target[t] = 1;
+                done_targets_condition.notify_one();
+            }
+        };
+
+        if (is_overlap_mode) {
+            for (uint64_t k = j; k <= j + 1 && k < targets[t].second; ++k) {
+                if (k != targets[t].first && --num_pending_joins[k] == 0) {
+                    auto stitch_begin = std::chrono::steady_clock::now();
+                    joins[k] = stitch_windows(k, k + 1 == targets[t].second,
+                        matrices[it->second]);
+                    stats_->add(StatsTask::kStitching, secondsBetween(
+                        stitch_begin, std::chrono::steady_clock::now()));
+                    finish();
                 }
-                for (uint32_t j = len_msa - 1; j > 0; --j) {
-                    if (msa[0][j] == msa[1][j]) {
-                        last_match_pos = j;
-                        break;
-                    }
-                    if (msa[1][j] != '-') {
-                        right += msa[1][j];
-                    } else {
-                        gap_count++;
+            }
+        }
+        finish();
+    };
+
+    std::vector<std::future<void>> thread_futures;
+    if (num_nodes_ == 0) {
+        for (const auto& it: order) {
+            thread_futures.emplace_back(thread_pool_->submit(polish_window, it));
+        }
+    } else {
+        // targets are split into consecutive blocks of about equal cost, one
+        // per node, whose windows are queued on that node in the same order,
+        // threads take windows of other nodes once their own queue is empty
+        uint64_t total_cost = 0;
+        for (const auto& it: costs) {
+            total_cost += it;
+        }
+        std::vector<uint32_t> target_to_node(targets.size());
+        uint64_t cost = 0;
+        for (uint64_t i = 0; i < targets.size(); ++i) {
+            uint64_t target_cost = 0;
+            for (uint64_t j = targets[i].first; j < targets[i].second; ++j) {
+                target_cost += costs[j];
+            }
+            target_to_node[i] = std::min<uint64_t>(num_nodes_ - 1,
+                ((cost + target_cost / 2) * num_nodes_) / std::max<uint64_t>(total_cost, 1));
+            cost += target_cost;
+        }
+
+        std::vector<std::vector<uint64_t>> queues(num_nodes_);
+        for (const auto& it: order) {
+            queues[target_to_node[window_to_target[it]]].emplace_back(it);
+        }
+        std::vector<std::atomic<uint64_t>> queue_heads(num_nodes_);
+        for (auto& it: queue_heads) {
+            it = 0;
+        }
+
+        for (uint32_t i = 0; i < thread_to_id_.size(); ++i) {
+            thread_futures.emplace_back(thread_pool_->submit(
+                [&]() -> void {
+                    auto it = thread_to_id_.find(std::this_thread::get_id());
+                    if (it == thread_to_id_.end()) {
+                        fprintf(stderr, "[racon::Polisher::polish] error: "
+                            "thread identifier not present!\n");
+                        exit(1);
                     }
-                }
-                if (first_match_pos == -1 || last_match_pos == -1) {
-                    overlap = consensus_l.substr(start_l, len_l);
-                    right = consensus_r.substr(0, len_r);
-                } else {
-                    for (uint32_t j = first_match_pos; j <= last_match_pos; ++j) {
-                        if (msa[0][j] == msa[1][j]) {
-                            overlap += msa[0][j];
-                            l_pos++;
-                            r_pos++;
-                        } else if (msa[0][j] == '-') {
-                            r_pos++;
-                        } else if (msa[1][j] == '-') {
-                            l_pos++;
-                        } else if (msa[0][j] != '-' && msa[1][j] != '-') {
-                            uint32_t gaps = 0;
-                            uint32_t l = 0;
-                            uint32_t r = 0;
-                            if (summary_l.size() && msa[0][j] != '-') {
-                                gaps += summary_l[gap_line_l * consensus_l.size() + l_pos];
-                                l = summary_l[coder_l[msa[0][j]] * consensus_l.size() + l_pos];
-                            }
-                            if (summary_r.size() && msa[1][j] != '-') {
-                                gaps += summary_r[gap_line_r * consensus_r.size() + r_pos];
-                                r = summary_r[coder_r[msa[1][j]] * consensus_r.size() + r_pos];
-                            }
-                            if (std::max({gaps, l, r}) == gaps) {
-                                continue;
-                            }
-                            overlap += msa[l > r ? 0 : 1][j];
-                            if (msa[0][j] == '-') {
-                                r_pos++;
-                            }
-                            if (msa[1][j] == '-') {
-                                l_pos++;
-                            }
-                        }                    
+                    uint32_t node = thread_to_node_[it->second];
+                    for (uint32_t k = 0; k < num_nodes_; ++k) {
+                        uint32_t n = (node + k) % num_nodes_;
+                        uint64_t head;
+                        while ((head = queue_heads[n]++) < queues[n].size()) {
+                            polish_window(queues[n][head]);
+                        }
                     }
-                    std::reverse(right.begin(), right.end());
-                }
+                }));
+        }
+    }
 
-                polished_data += overlap + right + consensus_r.substr(len_r, consensus_r.size() - 2 * len_r);
+    uint64_t num_done_targets = 0;
+    auto next_target = [&]() -> std::pair<uint64_t, uint64_t> {
+        std::unique_lock<std::mutex> lock(done_targets_mutex);
+        done_targets_condition.wait(lock, [&]() -> bool {
+            return unordered_output_ ? done_targets.size() > num_done_targets :
+                is_done_target[num_done_targets] == 1;
+        });
+        uint64_t t = unordered_output_ ? done_targets[num_done_targets] :
+            num_done_targets;
+        ++num_done_targets;
+        return targets[t];
+    };
 
-                graph->clear();
-                windows_[i - 1].reset();
-            }
-            if (i == windows_.size() - 1 || windows_[i + 1]->rank() == 0) {
-                auto& consensus = windows_[i]->consensus();
-                polished_data += consensus.substr(consensus.size() - consensus.size() * total_overlap);
-                double polished_ratio = num_polished_windows /
-                                        static_cast<double>(windows_[i]->rank() + 1);
+    std::string polished_data = "";
+    std::string polished_quality = "";
+    uint32_t num_polished_windows = 0;
 
-                if (!drop_unpolished_sequences || polished_ratio > 0) {
-                    std::string tags = type_ == PolisherType::kF ? "r" : "";
-                    tags += " LN:i:" + std::to_string(polished_data.size());
-                    tags += " RC:i:" + std::to_string(targets_coverages_[windows_[i]->id()]);
-                    tags += " XC:f:" + std::to_string(polished_ratio);
-                    dst.emplace_back(createSequence(sequences_[windows_[i]->id()]->name() +
-                                                    tags, polished_data));
+    if (anchors != nullptr) {
+        dst.resize(targets_size_);
+        anchors->assign(targets_size_, std::vector<std::pair<uint32_t, uint32_t>>());
+    }
+    auto add_anchor = [&](uint64_t id, uint32_t position) -> void {
+        if (anchors != nullptr) {
+            (*anchors)[id].emplace_back(position, polished_data.size());
+        }
+    };
+    auto add_sequence = [&](uint64_t id, double polished_ratio) -> void {
+        if (drop_unpolished_sequences && polished_ratio == 0) {
+            return;
+        }
+        std::string tags = type_ == PolisherType::kF ? "r" : "";
+        tags += " LN:i:" + std::to_string(polished_data.size());
+        tags += " RC:i:" + std::to_string(targets_coverages_[id]);
+        tags += " XC:f:" + std::to_string(polished_ratio);
+        auto sequence = has_quality ?
+            createSequence(sequences_[id]->name() + tags, polished_data, polished_quality) :
+            createSequence(sequences_[id]->name() + tags, polished_data);
+        if (anchors != nullptr) {
+            dst[id] = std::move(sequence);
+        } else if (sink_ != nullptr) {
+            auto begin = std::chrono::steady_clock::now();
+            sink_->write(std::move(sequence));
+            stats_->add(StatsTask::kOutput, secondsBetween(begin,
+                std::chrono::steady_clock::now()));
+        } else {
+            dst.emplace_back(std::move(sequence));
+        }
+    };
+
+    // streamed blocks are reported once they are done
+    uint64_t logger_step = stream_ ? 0 : windows_.size() / 20;
+    uint64_t num_done_windows = 0, num_bars = 0;
+    auto log_progress = [&](uint64_t num_windows) -> void {
+        num_done_windows += num_windows;
+        while (logger_step != 0 && num_bars + 1 < 20 &&
+            num_done_windows / logger_step > num_bars) {
+            logger_->bar("[racon::Polisher::polish] generating consensus");
+            ++num_bars;
+        }
+    };
+
+    if (overlap_percentage_ == 0) {
+        while (num_done_targets < targets.size()) {
+            uint64_t begin, end;
+            std::tie(begin, end) = next_target();
+
+            for (uint64_t i = begin; i < end; ++i) {
+                num_polished_windows += is_polished[i];
+                add_anchor(windows_[i]->id(), windows_[i]->rank() * window_length_);
+                polished_data += windows_[i]->consensus();
+                if (has_quality) {
+                    polished_quality += windows_[i]->consensus_quality();
                 }
 
-                num_polished_windows = 0;
-                polished_data.clear();
+                if (i + 1 == end) {
+                    double polished_ratio = num_polished_windows /
+                                            static_cast<double>(windows_[i]->rank() + 1);
+
+                    add_anchor(windows_[i]->id(), sequences_[windows_[i]->id()]->length());
+                    add_sequence(windows_[i]->id(), polished_ratio);
+
+                    num_polished_windows = 0;
+                    polished_data.clear();
+                    polished_quality.clear();
+                }
                 windows_[i].reset();
             }
 
-            if (logger_step != 0 && (i + 1) % logger_step == 0 && (i + 1) / logger_step < 20) {
-                logger_->bar("[racon::Polisher::polish] generating consensus");
+            log_progress(end - begin);
+        }
+    } else {
+        double total_overlap = 2 * overlap_percentage_;
+        uint32_t offset = window_length_ * overlap_percentage_;
+
+        while (num_done_targets < targets.size()) {
+            uint64_t begin, end;
+            std::tie(begin, end) = next_target();
+
+            for (uint64_t i = begin; i < end; ++i) {
+                num_polished_windows += is_polished[i];
+
+                if (windows_[i]->rank() == 0) {
+                    add_anchor(windows_[i]->id(), 0);
+                    auto& consensus = windows_[i]->consensus();
+                    polished_data += consensus.substr(0, consensus.size() - total_overlap * consensus.size());
+                } else {
+                    // joins start around the beginning of the expanded window
+                    add_anchor(windows_[i]->id(), windows_[i]->rank() * window_length_ - offset);
+                    polished_data += joins[i];
+                    std::string().swap(joins[i]);
+                    windows_[i - 1].reset();
+                }
+                if (i + 1 == end) {
+                    auto& consensus = windows_[i]->consensus();
+                    polished_data += consensus.substr(consensus.size() - consensus.size() * total_overlap);
+                    double polished_ratio = num_polished_windows /
+                                            static_cast<double>(windows_[i]->rank() + 1);
+
+                    add_anchor(windows_[i]->id(), sequences_[windows_[i]->id()]->length());
+                    add_sequence(windows_[i]->id(), polished_ratio);
+
+                    num_polished_windows = 0;
+                    polished_data.clear();
+                    windows_[i].reset();
+                }
             }
+
+            log_progress(end - begin);
         }
-//        fprintf(stderr, "\nTotal gaps in alignment: %u\n\n", gap_count);
     }
 
+    for (const auto& it: thread_futures) {
+        it.wait();
+    }
 
     if (logger_step != 0) {
         logger_->bar("[racon::Polisher::polish] generating consensus");
-    } else {
+    } else if (!stream_) {
         logger_->log("[racon::Polisher::polish] generated consensus");
     }
 
-    std::vector<std::shared_ptr<Window>>().swap(windows_);
-    std::vector<std::unique_ptr<Sequence>>().swap(sequences_);
+    // the heaviest windows are kept for comparison of estimated and measured
+    // processing times
+    for (uint64_t i = 0; i < order.size(); ++i) {
+        uint64_t j = order[i];
+        total_windows_cost_ += costs[j];
+        total_windows_time_ += times[j];
+        if (i < kNumReportedWindows) {
+            uint64_t t = window_to_target[j];
+            heaviest_windows_.emplace_back(costs[j], times[j], target_ids[t],
+                j - targets[t].first);
+        }
+    }
+    std::stable_sort(heaviest_windows_.begin(), heaviest_windows_.end(),
+        [](const std::tuple<uint64_t, double, uint64_t, uint32_t>& lhs,
+           const std::tuple<uint64_t, double, uint64_t, uint32_t>& rhs) {
+            return std::get<0>(lhs) > std::get<0>(rhs);
+        });
+    if (heaviest_windows_.size() > kNumReportedWindows) {
+        heaviest_windows_.resize(kNumReportedWindows);
+    }
+
+    windows_.clear();
+}
+
+std::string Polisher::stitch_windows(uint64_t i, bool is_last,
+    std::vector<int32_t>& matrix) const {
+
+    double total_overlap = 2 * overlap_percentage_;
+
+    auto& consensus_l = windows_[i - 1]->consensus();
+    auto& summary_l = windows_[i - 1]->summary();
+    auto& coder_l = windows_[i - 1]->coder();
+    uint32_t gap_line_l = summary_l.size() / consensus_l.size() - 1;
+    uint32_t len_l = consensus_l.size() * total_overlap;
+    uint32_t start_l = consensus_l.size() - len_l;
+
+    auto& consensus_r = windows_[i]->consensus();
+    auto& summary_r = windows_[i]->summary();
+    auto& coder_r = windows_[i]->coder();
+    uint32_t gap_line_r = summary_r.size() / consensus_r.size() - 1;
+    uint32_t len_r = consensus_r.size() * total_overlap;
+    // the last window can be shorter than the rest, the part of it which
+    // overlaps the left window is about as long as len_l, the remainder is
+    // appended as is
+    if (is_last) {
+        len_r = std::min<uint32_t>(consensus_r.size(), len_l + len_l / 4);
+    }
+
+    std::vector<std::string> msa(2);
+    alignOverlap(&(consensus_l[start_l]), len_l, &(consensus_r[0]),
+        len_r, msa[0], msa[1], matrix);
+
+    std::string overlap = "";
+
+    uint32_t len_msa = msa[0].size();
+    uint32_t first_match_pos = -1;
+    uint32_t last_match_pos = -1;
+    uint32_t l_pos = start_l;
+    uint32_t r_pos = 0;
+    std::string right = "";
+    for (uint32_t j = 0; j < len_msa; ++j) {
+        if (msa[0][j] == msa[1][j]) {
+            first_match_pos = j;
+            break;
+        }
+        if (msa[0][j] != '-') {
+            overlap += msa[0][j];
+            l_pos++;
+        }
+        if (msa[1][j] != '-') {
+            r_pos++;
+        }
+    }
+    for (uint32_t j = len_msa - 1; j > 0; --j) {
+        if (msa[0][j] == msa[1][j]) {
+            last_match_pos = j;
+            break;
+        }
+        if (msa[1][j] != '-') {
+            right += msa[1][j];
+        }
+    }
+    if (first_match_pos == -1 || last_match_pos == -1) {
+        overlap = consensus_l.substr(start_l, len_l);
+        right = consensus_r.substr(0, len_r);
+    } else {
+        for (uint32_t j = first_match_pos; j <= last_match_pos; ++j) {
+            if (msa[0][j] == msa[1][j]) {
+                overlap += msa[0][j];
+                l_pos++;
+                r_pos++;
+            } else if (msa[0][j] == '-') {
+                r_pos++;
+            } else if (msa[1][j] == '-') {
+                l_pos++;
+            } else if (msa[0][j] != '-' && msa[1][j] != '-') {
+                uint32_t gaps = 0;
+                uint32_t l = 0;
+                uint32_t r = 0;
+                if (summary_l.size() && msa[0][j] != '-') {
+                    gaps += summary_l[gap_line_l * consensus_l.size() + l_pos];
+                    l = summary_l[coder_l[msa[0][j]] * consensus_l.size() + l_pos];
+                }
+                if (summary_r.size() && msa[1][j] != '-') {
+                    gaps += summary_r[gap_line_r * consensus_r.size() + r_pos];
+                    r = summary_r[coder_r[msa[1][j]] * consensus_r.size() + r_pos];
+                }
+                if (std::max({gaps, l, r}) == gaps) {
+                    continue;
+                }
+                overlap += msa[l > r ? 0 : 1][j];
+                if (msa[0][j] == '-') {
+                    r_pos++;
+                }
+                if (msa[1][j] == '-') {
+                    l_pos++;
+                }
+            }
+        }
+        std::reverse(right.begin(), right.end());
+    }
+
+    if (is_last) {
+        return overlap + right + consensus_r.substr(len_r);
+    }
+    return overlap + right + consensus_r.substr(len_r, consensus_r.size() - 2 * len_r);
+}
+
+void Polisher::log_windows_cost() const {
+
+    if (total_windows_cost_ == 0) {
+        return;
+    }
+
+    fprintf(stderr, "[racon::Polisher::polish] estimated windows cost %lu "
+        "(%.3f ns per unit, %.3f s in total)\n", total_windows_cost_,
+        total_windows_time_ * 1e9 / total_windows_cost_, total_windows_time_);
+    for (const auto& it: heaviest_windows_) {
+        fprintf(stderr, "[racon::Polisher::polish] window %u of %s: "
+            "estimated cost %lu, measured time %.3f s\n", std::get<3>(it),
+            sequences_[std::get<2>(it)]->name().c_str(), std::get<0>(it),
+            std::get<1>(it));
+    }
+}
+
+void Polisher::log_sequences_memory() const {
+
+    uint64_t num_bytes = 0, num_packed = 0;
+    for (const auto& it: sequences_) {
+        num_bytes += it->num_bytes();
+        num_packed += it->is_packed();
+    }
+    fprintf(stderr, "[racon::Polisher::initialize] data of sequences takes "
+        "%.2f MB (%lu of %zu packed)\n", num_bytes / (1024. * 1024.),
+        num_packed, sequences_.size());
 }
 
 }
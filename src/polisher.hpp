@@ -7,15 +7,16 @@
 #pragma once
 
 #include <stdlib.h>
+#include <string>
 #include <vector>
 #include <memory>
 #include <unordered_map>
 #include <thread>
+#include <future>
+#include <tuple>
 
-namespace bioparser {
-    template<class T>
-    class Parser;
-}
+#include "name_index.hpp"
+#include "aligner.hpp"
 
 namespace thread_pool {
     class ThreadPool;
@@ -23,6 +24,7 @@ namespace thread_pool {
 
 namespace spoa {
     class AlignmentEngine;
+    class Graph;
 }
 
 
@@ -32,20 +34,83 @@ class Sequence;
 class Overlap;
 class Window;
 class Logger;
+class OverlapCache;
+class OverlapIndex;
+class ReadStore;
+class Sink;
+class Stats;
+
+template<class T>
+class Source;
+
+enum class WindowType;
 
 enum class PolisherType {
     kC, // Contig polishing
     kF // Fragment error correction
 };
 
+enum class GapModel {
+    kLinear, // gap
+    kAffine, // gap open + gap extend
+    kConvex // minimum of two affine functions
+};
+
+/*!
+ * @brief Parameters of createPolisher(), defaults are those of the racon
+ * executable (see README.md for details)
+ */
+struct PolisherOptions {
+    PolisherType type = PolisherType::kC;
+    uint32_t window_length = 500;
+    double overlap_percentage = 0;
+    double quality_threshold = 10;
+    double error_threshold = 0.3;
+    bool trim = true;
+    int8_t match = 3;
+    int8_t mismatch = -5;
+    int8_t gap = -4;
+    GapModel gap_model = GapModel::kLinear;
+    int8_t gap_extend = -2;
+    int8_t gap_open_2 = -24;
+    int8_t gap_extend_2 = -1;
+    uint32_t num_threads = 1;
+    // GPU batches (CUDA builds only)
+    uint32_t cuda_batches = 0;
+    bool cuda_banded_alignment = false;
+    uint32_t cudaaligner_batches = 0;
+    bool stream = false;
+    // targets are output as they are done instead of in input order
+    bool unordered_output = false;
+    AlignerType aligner_type = AlignerType::kEdlib;
+    // maximal number of layers per window (0 for no limit)
+    uint32_t max_window_depth = 0;
+    uint32_t num_rounds = 1;
+    // overlap cache and index need an overlap file
+    std::string cache_path = "";
+    bool overlap_index = false;
+    // reads are stored in 2 bits per base, a read store needs it
+    bool pack_reads = true;
+    std::string read_store_path = "";
+    uint32_t shard = 0;
+    uint32_t num_shards = 1;
+    std::string stats_path = "";
+    bool numa = false;
+    // file with names of target sequences to polish (all if empty)
+    std::string targets_path = "";
+};
+
 class Polisher;
 std::unique_ptr<Polisher> createPolisher(const std::string& sequences_path,
     const std::string& overlaps_path, const std::string& target_path,
-    PolisherType type, uint32_t window_length, double overlap_percentage, 
-    double quality_threshold, double error_threshold, bool trim, 
-    int8_t match, int8_t mismatch, int8_t gap, uint32_t num_threads, 
-    uint32_t cuda_batches = 0, bool cuda_banded_alignment = false, 
-    uint32_t cudaaligner_batches = 0);
+    const PolisherOptions& options);
+
+// in-memory input (see source.hpp and createOverlap()), overlaps can not be
+// cached or indexed as their origin is unknown, in stream mode they are parsed
+// once and all reads are kept until the end
+std::unique_ptr<Polisher> createPolisher(std::unique_ptr<Source<Sequence>> sequences,
+    std::unique_ptr<Source<Overlap>> overlaps, std::unique_ptr<Source<Sequence>> targets,
+    const PolisherOptions& options);
 
 class Polisher {
 public:
@@ -56,46 +121,145 @@ public:
     virtual void polish(std::vector<std::unique_ptr<Sequence>>& dst,
         bool drop_unpolished_sequences);
 
+    // pushes each polished sequence to dst as soon as it is done instead of
+    // collecting all of them (consensus qualities are not available in
+    // overlap mode)
+    void polish(Sink& dst, bool drop_unpolished_sequences);
+
     friend std::unique_ptr<Polisher> createPolisher(const std::string& sequences_path,
         const std::string& overlaps_path, const std::string& target_path,
-        PolisherType type, uint32_t window_length, double overlap_percentage, 
-        double quality_threshold, double error_threshold, bool trim, 
-        int8_t match, int8_t mismatch, int8_t gap, uint32_t num_threads, 
-        uint32_t cuda_batches, bool cuda_banded_alignment, uint32_t cudaaligner_batches);
+        const PolisherOptions& options);
+    friend std::unique_ptr<Polisher> createPolisher(std::unique_ptr<Source<Sequence>> sequences,
+        std::unique_ptr<Source<Overlap>> overlaps, std::unique_ptr<Source<Sequence>> targets,
+        const PolisherOptions& options);
 
 protected:
-    Polisher(std::unique_ptr<bioparser::Parser<Sequence>> sparser,
-        std::unique_ptr<bioparser::Parser<Overlap>> oparser,
-        std::unique_ptr<bioparser::Parser<Sequence>> tparser,
-        PolisherType type, uint32_t window_length, double overlap_percentage, 
-        double quality_threshold, double error_threshold, bool trim, 
-        int8_t match, int8_t mismatch, int8_t gap, uint32_t num_threads);
+    Polisher(std::unique_ptr<Source<Sequence>> sparser,
+        std::unique_ptr<Source<Overlap>> oparser,
+        std::unique_ptr<Source<Sequence>> tparser,
+        const PolisherOptions& options);
     Polisher(const Polisher&) = delete;
     const Polisher& operator=(const Polisher&) = delete;
     virtual void find_overlap_breaking_points(std::vector<std::unique_ptr<Overlap>>& overlaps);
 
-    std::unique_ptr<bioparser::Parser<Sequence>> sparser_;
-    std::unique_ptr<bioparser::Parser<Overlap>> oparser_;
-    std::unique_ptr<bioparser::Parser<Sequence>> tparser_;
+    // splits targets into num_shards_ consecutive ranges of similar cost
+    // (target length plus lengths of its overlaps), keeps only overlaps of
+    // targets in the range of shard_ and recomputes which reads are used
+    void find_shard_targets(std::vector<std::unique_ptr<Overlap>>& overlaps,
+        std::vector<bool>& has_data, std::vector<bool>& has_reverse_data);
+    // marks targets given by name (if any) and, if overlaps are indexed,
+    // replaces the overlap parser with one which reads only overlaps of
+    // selected targets of this shard (shards are then balanced by sizes of
+    // records of their targets as overlaps are not parsed yet)
+    void select_targets();
+
+    // parses, transmutes and filters the next chunk of overlaps, overlaps
+    // before l are final while the rest wait for the rest of their query
+    // (parsing runs one chunk ahead, transmute and filtering in parallel)
+    bool load_overlaps(std::vector<std::unique_ptr<Overlap>>& overlaps,
+        uint64_t& l, std::vector<bool>& has_data,
+        std::vector<bool>& has_reverse_data);
+    // polishes target sequences block by block as their overlaps are parsed
+    // (requires overlaps sorted by target sequences)
+    void stream_overlaps(std::vector<std::unique_ptr<Sequence>>& dst,
+        bool drop_unpolished_sequences);
+    // creates windows of targets in [targets_begin, targets_end) which are
+    // filled by add_layers() once the overlaps are aligned
+    void create_windows(std::vector<std::unique_ptr<Overlap>>& overlaps,
+        uint64_t targets_begin, uint64_t targets_end);
+    // bins layers of an aligned overlap into windows (thread safe), key
+    // determines the order of layers inside windows
+    void add_layers(const Overlap& overlap, uint64_t key);
+    // if anchors are given, dst[i] is the consensus of target i and
+    // (*anchors)[i] pairs positions of windows in target i with the
+    // corresponding ones in its consensus
+    void polish_windows(std::vector<std::unique_ptr<Sequence>>& dst,
+        bool drop_unpolished_sequences,
+        std::vector<std::vector<std::pair<uint32_t, uint32_t>>>* anchors = nullptr);
+    // replaces targets with their consensus, lifts kept overlaps onto them
+    // and fills windows of the next round
+    void next_round();
+    // returns the consensus part from the join of windows i - 1 and i up to
+    // the next join (matrix is a reusable alignment buffer)
+    std::string stitch_windows(uint64_t i, bool is_last,
+        std::vector<int32_t>& matrix) const;
+    void log_windows_cost() const;
+    // heap memory held by data of all sequences
+    void log_sequences_memory() const;
+
+    std::unique_ptr<Source<Sequence>> sparser_;
+    std::unique_ptr<Source<Overlap>> oparser_;
+    std::unique_ptr<Source<Sequence>> tparser_;
 
     PolisherType type_;
     double quality_threshold_;
     double error_threshold_;
     bool trim_;
+    bool stream_;
+    bool unordered_output_;
+    bool pack_reads_;
     std::vector<std::shared_ptr<spoa::AlignmentEngine>> alignment_engines_;
+    // reused between windows, one per thread
+    std::vector<std::unique_ptr<spoa::Graph>> graphs_;
+    std::unique_ptr<Aligner> aligner_;
 
+    // data of packed reads if they are kept on disk, declared before
+    // sequences_ so that it outlives them
+    std::unique_ptr<ReadStore> read_store_;
     std::vector<std::unique_ptr<Sequence>> sequences_;
+    uint64_t targets_size_;
+    // targets polished by this shard
+    uint32_t shard_;
+    uint32_t num_shards_;
+    uint64_t targets_begin_;
+    uint64_t targets_end_;
     std::vector<uint32_t> targets_coverages_;
+    // (last target, id) pairs of used sequences sorted by the last target of
+    // their overlaps in stream mode, sequences are released once it is done
+    std::vector<std::pair<uint32_t, uint64_t>> last_targets_;
+    NameIndex name_to_id_;
+    std::unordered_map<uint64_t, uint64_t> id_to_id_;
+    // overlaps kept in memory for rounds after the current one
+    std::vector<std::unique_ptr<Overlap>> overlaps_;
+    uint32_t num_rounds_;
+    uint32_t round_;
+    std::vector<std::unique_ptr<Overlap>> next_overlaps_;
+    std::future<bool> next_overlaps_status_;
+    // aligned overlaps are loaded from or stored into it while initializing
+    std::unique_ptr<OverlapCache> overlap_cache_;
+    // index of the overlap file if only some targets are read from it
+    std::unique_ptr<OverlapIndex> overlap_index_;
+    // names of targets to polish (all if empty) and their marks by id
+    std::vector<std::string> target_names_;
+    std::vector<bool> is_selected_target_;
+    // receives polished sequences instead of dst of polish_windows() if set
+    Sink* sink_;
     std::string dummy_quality_;
 
     uint32_t window_length_;
     double overlap_percentage_;
+    WindowType window_type_;
+    // maximal number of layers per window (0 for no limit)
+    uint32_t max_window_depth_;
     std::vector<std::shared_ptr<Window>> windows_;
+    uint64_t windows_targets_begin_;
+    std::vector<uint64_t> id_to_first_window_id_;
+    uint64_t total_windows_cost_;
+    double total_windows_time_;
+    // estimated cost, measured time, target id and rank of heaviest windows
+    std::vector<std::tuple<uint64_t, double, uint64_t, uint32_t>> heaviest_windows_;
 
     std::unique_ptr<thread_pool::ThreadPool> thread_pool_;
     std::unordered_map<std::thread::id, uint32_t> thread_to_id_;
+    // NUMA node of each thread by its id if threads are pinned (num_nodes_ is
+    // 0 otherwise)
+    uint32_t num_nodes_;
+    std::vector<uint32_t> thread_to_node_;
 
     std::unique_ptr<Logger> logger_;
+    // phases and task times, written to stats_path_ (if set) on destruction
+    std::unique_ptr<Stats> stats_;
+    std::string stats_path_;
 
     int8_t match_;
     int8_t mismatch_;
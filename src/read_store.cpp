@@ -0,0 +1,119 @@
+/*!
+ * @file read_store.cpp
+ *
+ * @brief ReadStore class source file
+ */
+
+#include <unistd.h>
+#include <algorithm>
+#include <sys/mman.h>
+
+#include "sequence.hpp"
+#include "read_store.hpp"
+
+namespace racon {
+
+constexpr uint64_t kNoOffset = -1;
+
+ReadStore::ReadStore(const std::string& path)
+        : path_(path), file_(fopen(path.c_str(), "w+b")), size_(0), maps_() {
+
+    if (file_ == nullptr) {
+        fprintf(stderr, "[racon::ReadStore::ReadStore] error: "
+            "unable to create file %s!\n", path_.c_str());
+        exit(1);
+    }
+}
+
+ReadStore::~ReadStore() {
+    for (const auto& it: maps_) {
+        munmap(it.first, it.second);
+    }
+    fclose(file_);
+    remove(path_.c_str());
+}
+
+void ReadStore::store(std::vector<std::unique_ptr<Sequence>>& sequences,
+    uint64_t begin, uint64_t end) {
+
+    // words and qualities of sequences are written back to back, starting at
+    // offsets divisible by 8 so that mapped words are aligned
+    auto pad = [&](uint64_t alignment) -> void {
+        static const char zeros[4096] = { 0 };
+        uint64_t length = (alignment - size_ % alignment) % alignment;
+        size_ += length;
+        while (length > 0) {
+            uint64_t n = std::min(length, static_cast<uint64_t>(sizeof(zeros)));
+            fwrite(zeros, 1, n, file_);
+            length -= n;
+        }
+    };
+
+    // mapped regions have to start at page boundaries
+    uint64_t page_size = sysconf(_SC_PAGESIZE);
+    uint64_t region_begin = size_;
+
+    bool is_written = true;
+    std::vector<std::pair<uint64_t, uint64_t>> offsets(end - begin,
+        std::make_pair(kNoOffset, kNoOffset));
+    for (uint64_t i = begin; i < end; ++i) {
+        const auto& it = sequences[i];
+        if (it == nullptr || !it->is_packed_ || it->packed_words_ == nullptr) {
+            continue;
+        }
+
+        uint64_t num_words = (it->length_ + 31) / 32;
+        offsets[i - begin].first = size_;
+        is_written &= fwrite(it->packed_words_, sizeof(uint64_t), num_words,
+            file_) == num_words;
+        size_ += num_words * sizeof(uint64_t);
+
+        if (it->packed_quality_ != nullptr) {
+            offsets[i - begin].second = size_;
+            is_written &= fwrite(it->packed_quality_, 1, it->length_, file_) ==
+                it->length_;
+            size_ += it->length_;
+            pad(sizeof(uint64_t));
+        }
+    }
+    if (size_ == region_begin) {
+        return;
+    }
+    pad(page_size);
+
+    if (!is_written || fflush(file_) != 0) {
+        fprintf(stderr, "[racon::ReadStore::store] error: "
+            "unable to write file %s!\n", path_.c_str());
+        exit(1);
+    }
+
+    uint64_t region_length = size_ - region_begin;
+    void* map = mmap(nullptr, region_length, PROT_READ, MAP_SHARED,
+        fileno(file_), region_begin);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "[racon::ReadStore::store] error: "
+            "unable to map file %s!\n", path_.c_str());
+        exit(1);
+    }
+    // windows access short slices of many reads
+    madvise(map, region_length, MADV_RANDOM);
+    maps_.emplace_back(map, region_length);
+
+    const char* data = static_cast<const char*>(map);
+    for (uint64_t i = begin; i < end; ++i) {
+        const auto& offset = offsets[i - begin];
+        if (offset.first == kNoOffset) {
+            continue;
+        }
+        auto& it = sequences[i];
+        it->packed_words_ = reinterpret_cast<const uint64_t*>(data +
+            offset.first - region_begin);
+        std::vector<uint64_t>().swap(it->packed_data_);
+        if (offset.second != kNoOffset) {
+            it->packed_quality_ = data + offset.second - region_begin;
+            std::string().swap(it->quality_);
+        }
+    }
+}
+
+}
@@ -0,0 +1,51 @@
+/*!
+ * @file read_store.hpp
+ *
+ * @brief ReadStore class header file
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace racon {
+
+class Sequence;
+
+/*!
+ * @brief Scratch file into which packed data and qualities of sequences are
+ * moved. The file is memory mapped, so the data is paged in only when it is
+ * accessed and can be evicted by the kernel instead of occupying the heap.
+ * The file is removed once the store is destroyed.
+ */
+class ReadStore {
+public:
+    ReadStore(const std::string& path);
+    ~ReadStore();
+
+    // moves data of packed sequences in [begin, end) into the store, their
+    // data is accessible only as long as the store exists
+    void store(std::vector<std::unique_ptr<Sequence>>& sequences,
+        uint64_t begin, uint64_t end);
+
+    uint64_t size() const {
+        return size_;
+    }
+
+private:
+    ReadStore(const ReadStore&) = delete;
+    const ReadStore& operator=(const ReadStore&) = delete;
+
+    std::string path_;
+    FILE* file_;
+    uint64_t size_;
+    // mapped regions, one per store() call
+    std::vector<std::pair<void*, uint64_t>> maps_;
+};
+
+}
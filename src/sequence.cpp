@@ -5,21 +5,65 @@
  */
 
 #include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
 
+#include "arena.hpp"
 #include "sequence.hpp"
 
 namespace racon {
 
+constexpr char kPackedBases[] = "ACGT";
+constexpr uint32_t kQualityBlock = 32;
+constexpr uint32_t kMaxQuality = '~' - '!';
+
+Arena& sequence_arena() {
+    static Arena arena(sizeof(Sequence), 4096);
+    return arena;
+}
+
+void* Sequence::operator new(std::size_t size) {
+    if (size != sizeof(Sequence)) {
+        return ::operator new(size);
+    }
+    return sequence_arena().allocate();
+}
+
+void Sequence::operator delete(void* ptr, std::size_t size) {
+    if (size != sizeof(Sequence)) {
+        ::operator delete(ptr);
+        return;
+    }
+    sequence_arena().deallocate(ptr);
+}
+
 std::unique_ptr<Sequence> createSequence(const std::string& name,
     const std::string& data) {
 
     return std::unique_ptr<Sequence>(new Sequence(name, data));
 }
 
+std::unique_ptr<Sequence> createSequence(const std::string& name,
+    const std::string& data, const std::string& quality) {
+
+    if (data.size() != quality.size()) {
+        fprintf(stderr, "[racon::createSequence] error: "
+            "unequal quality length!\n");
+        exit(1);
+    }
+
+    std::unique_ptr<Sequence> sequence(new Sequence(name, data));
+    sequence->quality_ = quality;
+    return sequence;
+}
+
 Sequence::Sequence(const char* name, uint32_t name_length, const char* data,
     uint32_t data_length)
         : name_(name, name_length), data_(), reverse_complement_(), quality_(),
-        reverse_quality_() {
+        reverse_quality_(), length_(data_length), is_packed_(false),
+        packed_data_(), packed_words_(nullptr), packed_quality_(nullptr),
+        exceptions_(), quality_sums_() {
 
     data_.reserve(data_length);
     for (uint32_t i = 0; i < data_length; ++i) {
@@ -43,7 +87,9 @@ Sequence::Sequence(const char* name, uint32_t name_length, const char* data,
 
 Sequence::Sequence(const std::string& name, const std::string& data)
     : name_(name), data_(data), reverse_complement_(), quality_(),
-    reverse_quality_() {
+    reverse_quality_(), length_(data.size()), is_packed_(false),
+    packed_data_(), packed_words_(nullptr), packed_quality_(nullptr),
+    exceptions_(), quality_sums_() {
 }
 
 void Sequence::create_reverse_complement() {
@@ -52,6 +98,17 @@ void Sequence::create_reverse_complement() {
         return;
     }
 
+    if (is_packed_) {
+        if (length_ == 0) {
+            return;
+        }
+        data(true, 0, length_, reverse_complement_);
+        if (packed_quality_ != nullptr) {
+            quality(true, 0, length_, reverse_quality_);
+        }
+        return;
+    }
+
     reverse_complement_.clear();
     reverse_complement_.reserve(data_.size());
 
@@ -83,12 +140,33 @@ void Sequence::create_reverse_complement() {
     }
 }
 
-void Sequence::transmute(bool has_name, bool has_data, bool has_reverse_data) {
+void Sequence::transmute(bool has_name, bool has_data, bool has_reverse_data,
+    bool pack) {
 
     if (!has_name) {
         std::string().swap(name_);
     }
 
+    if (pack) {
+        if (has_data || has_reverse_data) {
+            this->pack();
+            create_quality_index();
+        } else {
+            std::string().swap(data_);
+            std::string().swap(quality_);
+            std::vector<uint64_t>().swap(packed_data_);
+            std::vector<std::pair<uint32_t, char>>().swap(exceptions_);
+            std::vector<uint32_t>().swap(quality_sums_);
+            packed_words_ = nullptr;
+            packed_quality_ = nullptr;
+        }
+        return;
+    }
+
+    if (has_data || has_reverse_data) {
+        create_quality_index();
+    }
+
     if (has_reverse_data) {
         create_reverse_complement();
     }
@@ -97,6 +175,224 @@ void Sequence::transmute(bool has_name, bool has_data, bool has_reverse_data) {
         std::string().swap(data_);
         std::string().swap(quality_);
     }
+    if (!has_data && !has_reverse_data) {
+        std::vector<uint32_t>().swap(quality_sums_);
+    }
+}
+
+void Sequence::create_quality_index() {
+
+    const char* quality = is_packed_ ? packed_quality_ :
+        (quality_.empty() ? nullptr : quality_.c_str());
+    if (quality == nullptr || !quality_sums_.empty()) {
+        return;
+    }
+
+    quality_sums_.reserve(length_ / kQualityBlock + 1);
+    quality_sums_.emplace_back(0);
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < length_; ++i) {
+        sum += static_cast<uint32_t>(quality[i]) - 33;
+        if ((i + 1) % kQualityBlock == 0) {
+            quality_sums_.emplace_back(sum);
+        }
+    }
+}
+
+void Sequence::release() {
+
+    std::string().swap(data_);
+    std::string().swap(reverse_complement_);
+    std::string().swap(quality_);
+    std::string().swap(reverse_quality_);
+    std::vector<uint64_t>().swap(packed_data_);
+    std::vector<std::pair<uint32_t, char>>().swap(exceptions_);
+    std::vector<uint32_t>().swap(quality_sums_);
+    packed_words_ = nullptr;
+    packed_quality_ = nullptr;
+}
+
+uint64_t Sequence::num_bytes() const {
+
+    // short strings are stored inside the object
+    auto string_bytes = [](const std::string& src) -> uint64_t {
+        return src.capacity() > std::string().capacity() ? src.capacity() + 1 : 0;
+    };
+    uint64_t size = string_bytes(data_) + string_bytes(reverse_complement_) +
+        string_bytes(quality_) + string_bytes(reverse_quality_) +
+        quality_sums_.capacity() * sizeof(uint32_t);
+    if (is_packed_) {
+        size += packed_data_.capacity() * sizeof(uint64_t) +
+            exceptions_.capacity() * sizeof(std::pair<uint32_t, char>);
+    }
+    return size;
+}
+
+uint64_t Sequence::quality_sum(uint32_t begin, uint32_t end) const {
+
+    uint64_t sum = 0;
+    const char* quality = is_packed_ ? packed_quality_ :
+        (quality_.empty() ? nullptr : quality_.c_str());
+    if (quality != nullptr) {
+        for (uint32_t i = begin; i < end; ++i) {
+            sum += static_cast<uint32_t>(quality[i]) - 33;
+        }
+    } else if (!is_packed_ && !reverse_quality_.empty()) {
+        for (uint32_t i = begin; i < end; ++i) {
+            sum += static_cast<uint32_t>(reverse_quality_[length_ - 1 - i]) - 33;
+        }
+    }
+    return sum;
+}
+
+void Sequence::pack() {
+
+    if (is_packed_) {
+        return;
+    }
+
+    packed_data_.assign((data_.size() + 31) / 32, 0);
+    exceptions_.clear();
+
+    for (uint32_t i = 0; i < data_.size(); ++i) {
+        uint64_t code = 0;
+        switch (data_[i]) {
+            case 'A':
+                code = 0;
+                break;
+            case 'C':
+                code = 1;
+                break;
+            case 'G':
+                code = 2;
+                break;
+            case 'T':
+                code = 3;
+                break;
+            default:
+                exceptions_.emplace_back(i, data_[i]);
+                break;
+        }
+        packed_data_[i >> 5] |= code << ((i & 31) << 1);
+    }
+
+    std::vector<std::pair<uint32_t, char>>(exceptions_).swap(exceptions_);
+    std::string().swap(data_);
+    std::string().swap(reverse_complement_);
+    std::string().swap(reverse_quality_);
+    packed_words_ = packed_data_.data();
+    packed_quality_ = quality_.empty() ? nullptr : &(quality_[0]);
+    is_packed_ = true;
+}
+
+const char* Sequence::data(bool reverse_complement, uint32_t begin,
+    uint32_t length, std::string& buffer) const {
+
+    if (!is_packed_) {
+        return reverse_complement ? &(reverse_complement_[begin]) : &(data_[begin]);
+    }
+    if (reverse_complement && !reverse_complement_.empty()) {
+        return &(reverse_complement_[begin]);
+    }
+
+    buffer.resize(length);
+
+    // positions of the reverse complement are mirrored onto the packed data
+    uint32_t first = reverse_complement ? length_ - begin - length : begin;
+    for (uint32_t k = 0; k < length; ++k) {
+        uint32_t i = reverse_complement ? length_ - 1 - begin - k : begin + k;
+        uint64_t code = (packed_words_[i >> 5] >> ((i & 31) << 1)) & 3;
+        buffer[k] = kPackedBases[reverse_complement ? 3 - code : code];
+    }
+
+    auto it = std::lower_bound(exceptions_.begin(), exceptions_.end(),
+        std::make_pair(first, static_cast<char>(0)));
+    for (; it != exceptions_.end() && it->first < first + length; ++it) {
+        buffer[reverse_complement ? length_ - 1 - begin - it->first :
+            it->first - begin] = it->second;
+    }
+
+    return &(buffer[0]);
+}
+
+const char* Sequence::quality(bool reverse, uint32_t begin, uint32_t length,
+    std::string& buffer) const {
+
+    if (!is_packed_) {
+        if (!reverse) {
+            return quality_.empty() ? nullptr : &(quality_[begin]);
+        }
+        return reverse_quality_.empty() ? nullptr : &(reverse_quality_[begin]);
+    }
+    if (packed_quality_ == nullptr) {
+        return nullptr;
+    }
+    if (!reverse) {
+        return packed_quality_ + begin;
+    }
+    if (!reverse_quality_.empty()) {
+        return &(reverse_quality_[begin]);
+    }
+
+    buffer.resize(length);
+    for (uint32_t k = 0; k < length; ++k) {
+        buffer[k] = packed_quality_[length_ - 1 - begin - k];
+    }
+    return &(buffer[0]);
+}
+
+double Sequence::average_quality(bool reverse, uint32_t begin, uint32_t end) const {
+
+    if (!has_quality() || begin >= end) {
+        return 0;
+    }
+    if (reverse) {
+        uint32_t tmp = begin;
+        begin = length_ - end;
+        end = length_ - tmp;
+    }
+
+    // blocks inside the span are summed from the index, the rest is read
+    uint32_t first_block = (begin + kQualityBlock - 1) / kQualityBlock;
+    uint32_t last_block = end / kQualityBlock;
+    if (quality_sums_.empty() || first_block >= last_block) {
+        return quality_sum(begin, end) / static_cast<double>(end - begin);
+    }
+    uint64_t sum = quality_sums_[last_block] - quality_sums_[first_block];
+    sum += quality_sum(begin, first_block * kQualityBlock);
+    sum += quality_sum(last_block * kQualityBlock, end);
+    return sum / static_cast<double>(end - begin);
+}
+
+bool Sequence::is_low_quality(bool reverse, uint32_t begin, uint32_t end,
+    double threshold) const {
+
+    if (!has_quality() || begin >= end) {
+        return 0 < threshold;
+    }
+    if (reverse) {
+        uint32_t tmp = begin;
+        begin = length_ - end;
+        end = length_ - tmp;
+    }
+
+    uint32_t first_block = (begin + kQualityBlock - 1) / kQualityBlock;
+    uint32_t last_block = end / kQualityBlock;
+    if (!quality_sums_.empty() && first_block < last_block) {
+        // bases outside of indexed blocks contribute between 0 and the
+        // maximal quality each
+        double min_sum = quality_sums_[last_block] - quality_sums_[first_block];
+        double max_sum = min_sum + static_cast<double>(kMaxQuality) *
+            (end - begin - (last_block - first_block) * kQualityBlock);
+        if (max_sum < threshold * (end - begin)) {
+            return true;
+        }
+        if (min_sum >= threshold * (end - begin)) {
+            return false;
+        }
+    }
+
+    return average_quality(false, begin, end) < threshold;
 }
 
 }
@@ -7,9 +7,11 @@
 #pragma once
 
 #include <stdint.h>
+#include <cstddef>
 #include <memory>
 #include <vector>
 #include <string>
+#include <utility>
 
 namespace bioparser {
     template<class T>
@@ -24,11 +26,17 @@ namespace racon {
 class Sequence;
 std::unique_ptr<Sequence> createSequence(const std::string& name,
     const std::string& data);
+std::unique_ptr<Sequence> createSequence(const std::string& name,
+    const std::string& data, const std::string& quality);
 
 class Sequence {
 public:
     ~Sequence() = default;
 
+    // objects are allocated from a chunked arena shared by all sequences
+    static void* operator new(std::size_t size);
+    static void operator delete(void* ptr, std::size_t size);
+
     const std::string& name() const {
         return name_;
     }
@@ -49,14 +57,75 @@ public:
         return reverse_quality_;
     }
 
+    uint32_t length() const {
+        return length_;
+    }
+
+    bool is_packed() const {
+        return is_packed_;
+    }
+
+    bool has_quality() const {
+        return !quality_.empty() || !reverse_quality_.empty() ||
+            packed_quality_ != nullptr;
+    }
+
+    /*!
+     * @brief Returns a pointer to length bases of the sequence (or its reverse
+     * complement) starting at begin. Packed sequences are decoded into the
+     * buffer unless the requested strand is stored (see
+     * create_reverse_complement()), other are accessed directly and the
+     * buffer is left untouched.
+     */
+    const char* data(bool reverse_complement, uint32_t begin, uint32_t length,
+        std::string& buffer) const;
+
+    /*!
+     * @brief Same as data() for base qualities, returns nullptr if the
+     * sequence has none
+     */
+    const char* quality(bool reverse, uint32_t begin, uint32_t length,
+        std::string& buffer) const;
+
+    /*!
+     * @brief Returns the average base quality in [begin, end) of the sequence
+     * (or of its reverse complement)
+     */
+    double average_quality(bool reverse, uint32_t begin, uint32_t end) const;
+
+    /*!
+     * @brief Same as average_quality() < threshold, decided from the quality
+     * index alone whenever its bounds allow it (see transmute())
+     */
+    bool is_low_quality(bool reverse, uint32_t begin, uint32_t end,
+        double threshold) const;
+
+    // packed sequences keep their packed data, data() and quality() decode
+    // the reverse strand on demand either way so this is only needed for
+    // reverse_complement() and reverse_quality()
     void create_reverse_complement();
 
-    void transmute(bool has_name, bool has_data, bool has_reverse_data);
+    // drops data, qualities and the quality index of a sequence which is no
+    // longer used, its name and length are kept
+    void release();
+
+    // heap memory taken by data and qualities of the sequence, data in a
+    // ReadStore is not counted
+    uint64_t num_bytes() const;
+
+    // packed sequences are stored in 2 bits per base and drop the plain data,
+    // sequences which are packed already are only released if unused, the
+    // quality index is built for used sequences with qualities
+    void transmute(bool has_name, bool has_data, bool has_reverse_data,
+        bool pack = false);
 
     friend bioparser::FastaParser<Sequence>;
     friend bioparser::FastqParser<Sequence>;
     friend std::unique_ptr<Sequence> createSequence(const std::string& name,
         const std::string& data);
+    friend std::unique_ptr<Sequence> createSequence(const std::string& name,
+        const std::string& data, const std::string& quality);
+    friend class ReadStore;
 private:
     Sequence(const char* name, uint32_t name_length, const char* data,
         uint32_t data_length);
@@ -66,11 +135,33 @@ private:
     Sequence(const Sequence&) = delete;
     const Sequence& operator=(const Sequence&) = delete;
 
+    void pack();
+
+    void create_quality_index();
+
+    // sum of qualities in [begin, end) of the sequence (not of its reverse
+    // complement) read from whichever quality data is kept
+    uint64_t quality_sum(uint32_t begin, uint32_t end) const;
+
     std::string name_;
     std::string data_;
     std::string reverse_complement_;
     std::string quality_;
     std::string reverse_quality_;
+
+    uint32_t length_;
+    bool is_packed_;
+    std::vector<uint64_t> packed_data_;
+    // packed data and qualities of packed sequences which either point into
+    // packed_data_ and quality_ or into a ReadStore
+    const uint64_t* packed_words_;
+    const char* packed_quality_;
+    // positions and values of bases other than A, C, G and T
+    std::vector<std::pair<uint32_t, char>> exceptions_;
+    // sums of qualities of the sequence in blocks of 32 bases, quality_sums_[i]
+    // is the sum of the first 32 * i ones (modulo 2^32, differences are exact
+    // for spans shorter than 2^32 / 93 bases)
+    std::vector<uint32_t> quality_sums_;
 };
 
 }
@@ -0,0 +1,287 @@
+/*!
+ * @file sink.cpp
+ *
+ * @brief Sink class source file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "sequence.hpp"
+#include "sink.hpp"
+
+#include "thread_pool/thread_pool.hpp"
+#include "zlib.h"
+
+namespace racon {
+
+constexpr uint32_t kSinkBufferSize = 4 * 1024 * 1024; // 4MB
+// maximal uncompressed and compressed size of a BGZF block
+constexpr uint32_t kBgzfBlockSize = 0xff00;
+constexpr uint32_t kBgzfMaxBlockSize = 0x10000;
+constexpr uint32_t kBgzfHeaderSize = 18;
+constexpr uint32_t kBgzfFooterSize = 8;
+// empty block marking the end of file
+constexpr uint8_t kBgzfEof[28] = {
+    31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 66, 67, 2, 0, 27, 0, 3, 0, 0, 0,
+    0, 0, 0, 0, 0, 0
+};
+
+bool isSuffix(const std::string& src, const std::string& suffix) {
+    return src.size() >= suffix.size() &&
+        src.compare(src.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+void appendLittleEndian(uint32_t value, uint32_t num_bytes, std::string& dst) {
+    for (uint32_t i = 0; i < num_bytes; ++i) {
+        dst += static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+}
+
+// compresses src into consecutive BGZF blocks (gzip members which carry
+// their size, thus readable by both gzip and bgzip aware tools)
+std::string compressBgzf(const std::string& src) {
+
+    std::string dst;
+    std::string block(kBgzfMaxBlockSize, '\0');
+    for (uint64_t i = 0; i < src.size(); i += kBgzfBlockSize) {
+        uint32_t length = std::min(static_cast<uint64_t>(kBgzfBlockSize),
+            src.size() - i);
+
+        z_stream stream;
+        stream.zalloc = Z_NULL;
+        stream.zfree = Z_NULL;
+        stream.opaque = Z_NULL;
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(&src[i]));
+        stream.avail_in = length;
+        stream.next_out = reinterpret_cast<Bytef*>(&block[0]);
+        stream.avail_out = kBgzfMaxBlockSize - kBgzfHeaderSize - kBgzfFooterSize;
+
+        if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8,
+                Z_DEFAULT_STRATEGY) != Z_OK ||
+            deflate(&stream, Z_FINISH) != Z_STREAM_END) {
+
+            fprintf(stderr, "[racon::compressBgzf] error: "
+                "unable to compress block!\n");
+            exit(1);
+        }
+        uint32_t compressed_length = stream.total_out;
+        deflateEnd(&stream);
+
+        // blocks share the header of the empty block up to their size
+        uint32_t block_size = kBgzfHeaderSize + compressed_length + kBgzfFooterSize;
+        dst.append(reinterpret_cast<const char*>(kBgzfEof), kBgzfHeaderSize - 2);
+        appendLittleEndian(block_size - 1, 2, dst);
+        dst.append(block, 0, compressed_length);
+        appendLittleEndian(crc32(crc32(0L, Z_NULL, 0),
+            reinterpret_cast<const Bytef*>(&src[i]), length), 4, dst);
+        appendLittleEndian(length, 4, dst);
+    }
+
+    return dst;
+}
+
+/*!
+ * @brief Formats sequences into a buffer which is handed to a background
+ * thread once it is full, so that polishing does not wait for the output.
+ * Compressed buffers are compressed on a thread pool and written in order.
+ */
+class FileSink: public Sink {
+public:
+    FileSink(const std::string& path, bool fastq, uint32_t num_threads);
+    ~FileSink() override;
+
+    bool has_quality() const override {
+        return is_fastq_;
+    }
+
+    void write(std::unique_ptr<Sequence> sequence) override;
+
+private:
+    // hands the buffer over to the background thread, waits if too many
+    // buffers are already pending
+    void submit();
+    void write_blocks();
+
+    std::string path_;
+    FILE* file_;
+    bool is_fastq_;
+    bool is_compressed_;
+    std::string buffer_;
+    std::unique_ptr<thread_pool::ThreadPool> thread_pool_;
+    uint32_t max_pending_blocks_;
+    std::deque<std::future<std::string>> blocks_;
+    bool is_done_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::thread writer_;
+};
+
+class CallbackSink: public Sink {
+public:
+    CallbackSink(std::function<void(std::unique_ptr<Sequence>)> callback,
+        bool quality)
+            : Sink(), callback_(callback), has_quality_(quality) {
+    }
+    ~CallbackSink() override = default;
+
+    bool has_quality() const override {
+        return has_quality_;
+    }
+
+    void write(std::unique_ptr<Sequence> sequence) override {
+        callback_(std::move(sequence));
+    }
+
+private:
+    std::function<void(std::unique_ptr<Sequence>)> callback_;
+    bool has_quality_;
+};
+
+std::unique_ptr<Sink> createSink(const std::string& path, bool fastq,
+    uint32_t num_threads) {
+
+    if (num_threads == 0) {
+        fprintf(stderr, "[racon::createSink] error: invalid number of threads!\n");
+        exit(1);
+    }
+
+    return std::unique_ptr<Sink>(new FileSink(path, fastq, num_threads));
+}
+
+std::unique_ptr<Sink> createSink(
+    std::function<void(std::unique_ptr<Sequence>)> callback, bool quality) {
+
+    if (!callback) {
+        fprintf(stderr, "[racon::createSink] error: missing callback!\n");
+        exit(1);
+    }
+
+    return std::unique_ptr<Sink>(new CallbackSink(callback, quality));
+}
+
+FileSink::FileSink(const std::string& path, bool fastq, uint32_t num_threads)
+        : path_(path), file_(path.empty() ? stdout : fopen(path.c_str(), "wb")),
+        is_fastq_(fastq), is_compressed_(isSuffix(path, ".gz")), buffer_(),
+        thread_pool_(), max_pending_blocks_(2 * num_threads + 1), blocks_(),
+        is_done_(false), mutex_(), condition_(), writer_() {
+
+    if (file_ == nullptr) {
+        fprintf(stderr, "[racon::FileSink::FileSink] error: "
+            "unable to create file %s!\n", path_.c_str());
+        exit(1);
+    }
+    if (is_compressed_) {
+        thread_pool_ = thread_pool::createThreadPool(num_threads);
+    }
+    buffer_.reserve(kSinkBufferSize);
+
+    writer_ = std::thread(&FileSink::write_blocks, this);
+}
+
+FileSink::~FileSink() {
+
+    submit();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        is_done_ = true;
+    }
+    condition_.notify_all();
+    writer_.join();
+
+    bool is_written = true;
+    if (is_compressed_) {
+        is_written = fwrite(kBgzfEof, sizeof(kBgzfEof), 1, file_) == 1;
+    }
+    is_written &= (file_ == stdout ? fflush(file_) : fclose(file_)) == 0;
+    if (!is_written) {
+        fprintf(stderr, "[racon::FileSink::~FileSink] error: "
+            "unable to write file %s!\n", path_.c_str());
+        exit(1);
+    }
+}
+
+void FileSink::write(std::unique_ptr<Sequence> sequence) {
+
+    buffer_ += is_fastq_ ? '@' : '>';
+    buffer_ += sequence->name();
+    buffer_ += '\n';
+    buffer_ += sequence->data();
+    buffer_ += '\n';
+    if (is_fastq_) {
+        // sequences without consensus qualities get the lowest one
+        buffer_ += "+\n";
+        if (sequence->quality().empty()) {
+            buffer_.append(sequence->data().size(), '!');
+        } else {
+            buffer_ += sequence->quality();
+        }
+        buffer_ += '\n';
+    }
+    sequence.reset();
+
+    if (buffer_.size() >= kSinkBufferSize) {
+        submit();
+    }
+}
+
+void FileSink::submit() {
+
+    if (buffer_.empty()) {
+        return;
+    }
+
+    std::future<std::string> block;
+    if (is_compressed_) {
+        block = thread_pool_->submit([](const std::string& src) -> std::string {
+            return compressBgzf(src);
+        }, std::move(buffer_));
+    } else {
+        std::promise<std::string> data;
+        data.set_value(std::move(buffer_));
+        block = data.get_future();
+    }
+    buffer_ = std::string();
+    buffer_.reserve(kSinkBufferSize);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, [&]() -> bool {
+        return blocks_.size() < max_pending_blocks_;
+    });
+    blocks_.emplace_back(std::move(block));
+    condition_.notify_all();
+}
+
+void FileSink::write_blocks() {
+
+    while (true) {
+        std::future<std::string> block;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_.wait(lock, [&]() -> bool {
+                return !blocks_.empty() || is_done_;
+            });
+            if (blocks_.empty()) {
+                break;
+            }
+            block = std::move(blocks_.front());
+            blocks_.pop_front();
+        }
+        condition_.notify_all();
+
+        std::string data = block.get();
+        if (fwrite(data.data(), 1, data.size(), file_) != data.size()) {
+            fprintf(stderr, "[racon::FileSink::write_blocks] error: "
+                "unable to write file %s!\n", path_.c_str());
+            exit(1);
+        }
+    }
+}
+
+}
@@ -0,0 +1,50 @@
+/*!
+ * @file sink.hpp
+ *
+ * @brief Sink class header file
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace racon {
+
+class Sequence;
+
+class Sink;
+// writes sequences in FASTA (or FASTQ) format to path (stdout if empty)
+// through a background thread, output is compressed into BGZF blocks on
+// num_threads threads if path ends with .gz
+std::unique_ptr<Sink> createSink(const std::string& path, bool fastq,
+    uint32_t num_threads);
+
+// hands sequences over to callback (from the calling thread of
+// Polisher::polish()), quality requests consensus qualities
+std::unique_ptr<Sink> createSink(
+    std::function<void(std::unique_ptr<Sequence>)> callback,
+    bool quality = false);
+
+/*!
+ * @brief Destination of polished sequences which are pushed to it as soon as
+ * they are done
+ */
+class Sink {
+public:
+    virtual ~Sink() = default;
+
+    // returns true if sequences should carry consensus qualities
+    virtual bool has_quality() const = 0;
+
+    virtual void write(std::unique_ptr<Sequence> sequence) = 0;
+
+protected:
+    Sink() = default;
+    Sink(const Sink&) = delete;
+    const Sink& operator=(const Sink&) = delete;
+};
+
+}
@@ -0,0 +1,128 @@
+/*!
+ * @file source.hpp
+ *
+ * @brief Source class header file
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace racon {
+
+template<class T>
+class Source;
+
+// hands over all objects at once, objects are moved out of src
+template<class T>
+std::unique_ptr<Source<T>> createSource(std::vector<std::unique_ptr<T>>&& src);
+
+// next appends objects to its first argument (preferably about as many as
+// take the number of bytes given in the second one) and returns false once
+// there are none left
+template<class T>
+std::unique_ptr<Source<T>> createSource(std::function<bool(
+    std::vector<std::unique_ptr<T>>&, uint64_t)> next);
+
+/*!
+ * @brief Input of the polisher (sequences or overlaps) which is consumed in
+ * chunks, bioparser parsers of input files are wrapped into it as well
+ */
+template<class T>
+class Source {
+public:
+    virtual ~Source() = default;
+
+    // rewinds to the first object, in-memory sources can not be rewound once
+    // they are consumed
+    virtual void reset() = 0;
+
+    // false if reset() does nothing, such sources are parsed only once
+    virtual bool can_reset() const {
+        return true;
+    }
+
+    // same as bioparser::Parser::parse()
+    virtual bool parse(std::vector<std::unique_ptr<T>>& dst,
+        uint64_t max_bytes) = 0;
+
+protected:
+    Source() = default;
+    Source(const Source&) = delete;
+    const Source& operator=(const Source&) = delete;
+};
+
+template<class T>
+class VectorSource: public Source<T> {
+public:
+    VectorSource(std::vector<std::unique_ptr<T>>&& src)
+            : Source<T>(), src_(std::move(src)) {
+    }
+    ~VectorSource() override = default;
+
+    void reset() override {
+    }
+
+    bool can_reset() const override {
+        return false;
+    }
+
+    bool parse(std::vector<std::unique_ptr<T>>& dst, uint64_t) override {
+        if (dst.empty()) {
+            dst.swap(src_);
+        } else {
+            for (auto& it: src_) {
+                dst.emplace_back(std::move(it));
+            }
+            std::vector<std::unique_ptr<T>>().swap(src_);
+        }
+        return false;
+    }
+
+private:
+    std::vector<std::unique_ptr<T>> src_;
+};
+
+template<class T>
+class CallbackSource: public Source<T> {
+public:
+    CallbackSource(std::function<bool(std::vector<std::unique_ptr<T>>&,
+        uint64_t)> next)
+            : Source<T>(), next_(next), is_done_(false) {
+    }
+    ~CallbackSource() override = default;
+
+    void reset() override {
+    }
+
+    bool can_reset() const override {
+        return false;
+    }
+
+    bool parse(std::vector<std::unique_ptr<T>>& dst, uint64_t max_bytes) override {
+        if (!is_done_) {
+            is_done_ = !next_(dst, max_bytes);
+        }
+        return !is_done_;
+    }
+
+private:
+    std::function<bool(std::vector<std::unique_ptr<T>>&, uint64_t)> next_;
+    bool is_done_;
+};
+
+template<class T>
+std::unique_ptr<Source<T>> createSource(std::vector<std::unique_ptr<T>>&& src) {
+    return std::unique_ptr<Source<T>>(new VectorSource<T>(std::move(src)));
+}
+
+template<class T>
+std::unique_ptr<Source<T>> createSource(std::function<bool(
+    std::vector<std::unique_ptr<T>>&, uint64_t)> next) {
+    return std::unique_ptr<Source<T>>(new CallbackSource<T>(next));
+}
+
+}
@@ -0,0 +1,209 @@
+/*!
+ * @file stats.cpp
+ *
+ * @brief Stats class source file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "stats.hpp"
+
+namespace racon {
+
+constexpr uint32_t kNumBuckets = 32;
+constexpr uint32_t kNumLayerBuckets = 20;
+constexpr uint32_t kNumTasks = 5;
+const char* kTaskNames[kNumTasks] = {
+    "alignment", "binning", "consensus", "stitching", "output"
+};
+
+uint64_t toNanoseconds(double seconds) {
+    return static_cast<uint64_t>(seconds * 1e9);
+}
+
+// returns the index of the highest set bit, 0 for 0
+uint32_t log2Bucket(uint64_t value, uint32_t num_buckets) {
+    uint32_t bucket = 0;
+    while (value > 1 && bucket + 1 < num_buckets) {
+        value >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+double cpuTime() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+        usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+}
+
+// in kilobytes
+uint64_t peakRss() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return usage.ru_maxrss;
+}
+
+// includes reads from the page cache, 0 if /proc is not available
+uint64_t bytesRead() {
+    FILE* file = fopen("/proc/self/io", "r");
+    if (file == nullptr) {
+        return 0;
+    }
+    uint64_t bytes = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        if (strncmp(line, "rchar:", 6) == 0) {
+            bytes = strtoull(line + 6, nullptr, 10);
+            break;
+        }
+    }
+    fclose(file);
+    return bytes;
+}
+
+Stats::Histogram::Histogram()
+        : total_time(0) {
+    for (auto& it: counts) {
+        it = 0;
+    }
+}
+
+bool Stats::Histogram::isEmpty() const {
+    for (const auto& it: counts) {
+        if (it != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Stats::Histogram::add(double seconds) {
+    counts[log2Bucket(toNanoseconds(seconds) / 1000, kNumBuckets)] += 1;
+    total_time += toNanoseconds(seconds);
+}
+
+Stats::Stats(uint32_t num_threads)
+        : num_threads_(num_threads), phases_(), phase_(), phase_begin_(),
+        phase_cpu_time_(0), phase_bytes_read_(0), busy_time_(0) {
+}
+
+void Stats::begin(const std::string& phase) {
+
+    end();
+
+    phase_ = phase;
+    phase_begin_ = std::chrono::steady_clock::now();
+    phase_cpu_time_ = cpuTime();
+    phase_bytes_read_ = bytesRead();
+    busy_time_ = 0;
+}
+
+void Stats::end() {
+
+    if (phase_.empty()) {
+        return;
+    }
+
+    Phase phase;
+    phase.name = phase_;
+    phase.wall_time = std::chrono::duration_cast<std::chrono::duration<double>>(
+        std::chrono::steady_clock::now() - phase_begin_).count();
+    phase.cpu_time = cpuTime() - phase_cpu_time_;
+    phase.peak_rss = peakRss();
+    phase.bytes_read = bytesRead() - phase_bytes_read_;
+    phase.busy_time = busy_time_ / 1e9;
+    phases_.emplace_back(phase);
+
+    phase_.clear();
+}
+
+void Stats::add(StatsTask task, double seconds, uint32_t num_layers) {
+
+    tasks_[static_cast<uint32_t>(task)].add(seconds);
+    if (task == StatsTask::kConsensus) {
+        consensus_by_layers_[log2Bucket(num_layers, kNumLayerBuckets)].add(seconds);
+    }
+    if (task != StatsTask::kOutput) {
+        busy_time_ += toNanoseconds(seconds);
+    }
+}
+
+void writeHistogram(FILE* file, const std::atomic<uint64_t>* counts,
+    uint64_t total_time) {
+
+    uint32_t num_buckets = 0;
+    uint64_t total_count = 0;
+    for (uint32_t i = 0; i < kNumBuckets; ++i) {
+        if (counts[i] != 0) {
+            num_buckets = i + 1;
+            total_count += counts[i];
+        }
+    }
+
+    fprintf(file, "{\"count\": %lu, \"total_s\": %.6f, \"bucket_min_us\": [",
+        total_count, total_time / 1e9);
+    for (uint32_t i = 0; i < num_buckets; ++i) {
+        fprintf(file, "%s%lu", i == 0 ? "" : ", ", i == 0 ? 0UL : 1UL << i);
+    }
+    fprintf(file, "], \"counts\": [");
+    for (uint32_t i = 0; i < num_buckets; ++i) {
+        fprintf(file, "%s%lu", i == 0 ? "" : ", ", counts[i].load());
+    }
+    fprintf(file, "]}");
+}
+
+void Stats::write(const std::string& path) const {
+
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        fprintf(stderr, "[racon::Stats::write] error: "
+            "unable to create file %s!\n", path.c_str());
+        exit(1);
+    }
+
+    fprintf(file, "{\n  \"threads\": %u,\n  \"phases\": [", num_threads_);
+    for (uint32_t i = 0; i < phases_.size(); ++i) {
+        const auto& it = phases_[i];
+        fprintf(file, "%s\n    {\"name\": \"%s\", \"wall_s\": %.6f, "
+            "\"cpu_s\": %.6f, \"peak_rss_kb\": %lu, \"bytes_read\": %lu, "
+            "\"pool_utilization\": %.4f}", i == 0 ? "" : ",", it.name.c_str(),
+            it.wall_time, it.cpu_time, it.peak_rss, it.bytes_read,
+            it.wall_time > 0 ? it.busy_time / (it.wall_time * num_threads_) : 0);
+    }
+    fprintf(file, "\n  ],\n  \"tasks\": {");
+    for (uint32_t i = 0; i < kNumTasks; ++i) {
+        fprintf(file, "%s\n    \"%s\": ", i == 0 ? "" : ",", kTaskNames[i]);
+        writeHistogram(file, tasks_[i].counts, tasks_[i].total_time);
+    }
+    fprintf(file, "\n  },\n  \"consensus_by_layers\": [");
+    bool is_first = true;
+    for (uint32_t i = 0; i < kNumLayerBuckets; ++i) {
+        if (consensus_by_layers_[i].isEmpty()) {
+            continue;
+        }
+        fprintf(file, "%s\n    {\"min_layers\": %lu, \"histogram\": ",
+            is_first ? "" : ",", i == 0 ? 0UL : 1UL << i);
+        writeHistogram(file, consensus_by_layers_[i].counts,
+            consensus_by_layers_[i].total_time);
+        fprintf(file, "}");
+        is_first = false;
+    }
+    fprintf(file, "\n  ]\n}\n");
+
+    if (fclose(file) != 0) {
+        fprintf(stderr, "[racon::Stats::write] error: "
+            "unable to write file %s!\n", path.c_str());
+        exit(1);
+    }
+}
+
+}
@@ -0,0 +1,83 @@
+/*!
+ * @file stats.hpp
+ *
+ * @brief Stats class header file
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace racon {
+
+enum class StatsTask {
+    kAlignment, // alignment of an overlap and its breaking points
+    kBinning, // binning of layers of an aligned overlap into windows
+    kConsensus, // consensus of a window
+    kStitching, // alignment of consensuses of overlapping windows
+    kOutput // handing a polished sequence to its destination
+};
+
+/*!
+ * @brief Collects wall and CPU time, peak memory and bytes read of
+ * consecutive phases, total time and histograms of tasks, and writes them as
+ * JSON. Phases are started from one thread, tasks are added from any.
+ */
+class Stats {
+public:
+    Stats(uint32_t num_threads);
+    ~Stats() = default;
+
+    // ends the current phase (if any) and starts a new one
+    void begin(const std::string& phase);
+
+    void end();
+
+    // thread safe, layers are those of the window of a kConsensus task
+    void add(StatsTask task, double seconds, uint32_t num_layers = 0);
+
+    void write(const std::string& path) const;
+
+private:
+    Stats(const Stats&) = delete;
+    const Stats& operator=(const Stats&) = delete;
+
+    struct Phase {
+        std::string name;
+        double wall_time;
+        double cpu_time;
+        uint64_t peak_rss;
+        uint64_t bytes_read;
+        double busy_time;
+    };
+
+    // durations in log2 buckets of microseconds
+    struct Histogram {
+        Histogram();
+
+        bool isEmpty() const;
+
+        void add(double seconds);
+
+        std::atomic<uint64_t> counts[32];
+        std::atomic<uint64_t> total_time; // ns
+    };
+
+    uint32_t num_threads_;
+    std::vector<Phase> phases_;
+    std::string phase_;
+    std::chrono::time_point<std::chrono::steady_clock> phase_begin_;
+    double phase_cpu_time_;
+    uint64_t phase_bytes_read_;
+    // time spent in tasks run on the thread pool during the current phase
+    std::atomic<uint64_t> busy_time_; // ns
+    Histogram tasks_[5];
+    // consensus times by log2 buckets of window layers
+    Histogram consensus_by_layers_[20];
+};
+
+}
@@ -4,15 +4,36 @@
  * @brief Window class source file
  */
 
+#include <math.h>
 #include <algorithm>
 #include <string>
+#include <thread>
 
+#include "sequence.hpp"
 #include "window.hpp"
 
 #include "spoa/spoa.hpp"
 
 namespace racon {
 
+constexpr uint32_t kMaxConsensusQuality = 60;
+
+// phred scaled probability that a base supported by coverage out of
+// num_sequences sequences is wrong (with add-one smoothing)
+std::string consensusQuality(const std::vector<uint32_t>& coverages,
+    uint32_t num_sequences) {
+
+    std::string dst(coverages.size(), '!');
+    for (uint32_t i = 0; i < coverages.size(); ++i) {
+        uint32_t coverage = std::min(coverages[i], num_sequences);
+        double error = (num_sequences - coverage + 1) /
+            static_cast<double>(num_sequences + 2);
+        dst[i] += std::min(static_cast<uint32_t>(-10 * log10(error) + 0.5),
+            kMaxConsensusQuality);
+    }
+    return dst;
+}
+
 std::shared_ptr<Window> createWindow(uint64_t id, uint32_t rank, WindowType type, bool overlap,
     const char* backbone, uint32_t backbone_length, const char* quality,
     uint32_t quality_length) {
@@ -29,20 +50,26 @@ std::shared_ptr<Window> createWindow(uint64_t id, uint32_t rank, WindowType type
 
 Window::Window(uint64_t id, uint32_t rank, WindowType type, bool overlap, const char* backbone,
     uint32_t backbone_length, const char* quality, uint32_t quality_length)
-        : id_(id), rank_(rank), type_(type), overlap_(overlap), consensus_(), summary_(),
-        coder_(), sequences_(), qualities_(), positions_(), q_ids_() {
+        : id_(id), rank_(rank), type_(type), overlap_(overlap), consensus_(),
+        consensus_quality_(), summary_(),
+        coder_(), sequences_(), qualities_(), packed_layers_(),
+        average_qualities_(), positions_(), q_ids_(), keys_(), is_locked_(false) {
 
     sequences_.emplace_back(backbone, backbone_length);
     qualities_.emplace_back(quality, quality_length);
+    packed_layers_.push_back({ nullptr, 0, false });
+    average_qualities_.emplace_back(0);
     positions_.emplace_back(0, 0);
     q_ids_.emplace_back(-1);
+    keys_.emplace_back(0);
 }
 
 Window::~Window() {
 }
 
 void Window::add_layer(const char* sequence, uint32_t sequence_length,
-    const char* quality, uint32_t quality_length, uint32_t begin, uint32_t end, uint32_t q_id) {
+    const char* quality, uint32_t quality_length, uint32_t begin, uint32_t end, uint32_t q_id,
+    uint64_t key, double average_quality) {
 
     if (sequence_length == 0 || begin == end) {
         return;
@@ -53,6 +80,16 @@ void Window::add_layer(const char* sequence, uint32_t sequence_length,
             "unequal quality size!\n");
         exit(1);
     }
+
+    if (average_quality < 0) {
+        uint64_t sum = 0;
+        for (uint32_t i = 0; quality != nullptr && i < quality_length; ++i) {
+            sum += quality[i] - 33;
+        }
+        average_quality = quality == nullptr ? 0 : sum / static_cast<double>(quality_length);
+    }
+
+    lock();
     if (begin >= end || begin > sequences_.front().second || end > sequences_.front().second) {
         fprintf(stderr, "[racon::Window::add_layer] error: "
             "layer begin and end positions are invalid!\n");
@@ -62,19 +99,177 @@ void Window::add_layer(const char* sequence, uint32_t sequence_length,
 
     sequences_.emplace_back(sequence, sequence_length);
     qualities_.emplace_back(quality, quality_length);
+    packed_layers_.push_back({ nullptr, 0, false });
+    average_qualities_.emplace_back(average_quality);
     positions_.emplace_back(begin, end);
     q_ids_.emplace_back(q_id);
+    keys_.emplace_back(key);
+    unlock();
+}
+
+void Window::add_layer(const Sequence* sequence, bool reverse,
+    uint32_t sequence_begin, uint32_t sequence_length, uint32_t begin,
+    uint32_t end, uint32_t q_id, uint64_t key) {
+
+    if (sequence_length == 0 || begin == end) {
+        return;
+    }
+
+    double average_quality = sequence->average_quality(reverse, sequence_begin,
+        sequence_begin + sequence_length);
+
+    lock();
+    if (begin >= end || begin > sequences_.front().second || end > sequences_.front().second) {
+        fprintf(stderr, "[racon::Window::add_layer] error: "
+            "layer begin and end positions are invalid!\n");
+        exit(1);
+    }
+
+    sequences_.emplace_back(nullptr, sequence_length);
+    qualities_.emplace_back(nullptr, sequence->has_quality() ? sequence_length : 0);
+    packed_layers_.push_back({ sequence, sequence_begin, reverse });
+    average_qualities_.emplace_back(average_quality);
+    positions_.emplace_back(begin, end);
+    q_ids_.emplace_back(q_id);
+    keys_.emplace_back(key);
+    unlock();
+}
+
+std::pair<const char*, const char*> Window::layer(uint32_t i,
+    std::string& data_buffer, std::string& quality_buffer) const {
+
+    const auto& packed_layer = packed_layers_[i];
+    if (packed_layer.sequence == nullptr) {
+        return std::make_pair(sequences_[i].first, qualities_[i].first);
+    }
+    return std::make_pair(packed_layer.sequence->data(packed_layer.is_reverse,
+            packed_layer.begin, sequences_[i].second, data_buffer),
+        packed_layer.sequence->quality(packed_layer.is_reverse,
+            packed_layer.begin, sequences_[i].second, quality_buffer));
+}
+
+void Window::sort_layers() {
+
+    if (std::is_sorted(keys_.begin() + 1, keys_.end())) {
+        return;
+    }
+
+    std::vector<uint32_t> rank(sequences_.size());
+    for (uint32_t i = 0; i < rank.size(); ++i) {
+        rank[i] = i;
+    }
+    std::stable_sort(rank.begin() + 1, rank.end(), [&](uint32_t lhs, uint32_t rhs) {
+        return keys_[lhs] < keys_[rhs]; });
+
+    select_layers(rank);
+}
+
+bool Window::subsample_layers(uint32_t max_depth) {
+
+    if (max_depth == 0 || sequences_.size() - 1 <= max_depth) {
+        return false;
+    }
+
+    uint32_t offset = 0.01 * sequences_.front().second;
+    std::vector<bool> is_spanning(sequences_.size());
+    for (uint32_t i = 1; i < sequences_.size(); ++i) {
+        is_spanning[i] = positions_[i].first < offset && positions_[i].second >
+            sequences_.front().second - offset;
+    }
+
+    std::vector<uint32_t> rank(sequences_.size());
+    for (uint32_t i = 0; i < rank.size(); ++i) {
+        rank[i] = i;
+    }
+    std::stable_sort(rank.begin() + 1, rank.end(), [&](uint32_t lhs, uint32_t rhs) {
+        if (is_spanning[lhs] != is_spanning[rhs]) {
+            return is_spanning[lhs] > is_spanning[rhs];
+        }
+        return average_qualities_[lhs] > average_qualities_[rhs]; });
+
+    // kept layers retain their order
+    rank.resize(max_depth + 1);
+    std::sort(rank.begin() + 1, rank.end());
+
+    select_layers(rank);
+    return true;
+}
+
+void Window::select_layers(const std::vector<uint32_t>& rank) {
+
+    decltype(sequences_) sequences;
+    decltype(qualities_) qualities;
+    decltype(packed_layers_) packed_layers;
+    decltype(average_qualities_) average_qualities;
+    decltype(positions_) positions;
+    decltype(q_ids_) q_ids;
+    decltype(keys_) keys;
+    for (const auto& it: rank) {
+        sequences.emplace_back(sequences_[it]);
+        qualities.emplace_back(qualities_[it]);
+        packed_layers.emplace_back(packed_layers_[it]);
+        average_qualities.emplace_back(average_qualities_[it]);
+        positions.emplace_back(positions_[it]);
+        q_ids.emplace_back(q_ids_[it]);
+        keys.emplace_back(keys_[it]);
+    }
+    sequences_.swap(sequences);
+    qualities_.swap(qualities);
+    packed_layers_.swap(packed_layers);
+    average_qualities_.swap(average_qualities);
+    positions_.swap(positions);
+    q_ids_.swap(q_ids);
+    keys_.swap(keys);
+}
+
+void Window::lock() {
+    // the critical section is a few emplace_back() calls, waiting threads
+    // yield so that oversubscribed runs do not burn cores while spinning
+    while (is_locked_.exchange(true, std::memory_order_acquire)) {
+        while (is_locked_.load(std::memory_order_relaxed)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void Window::unlock() {
+    is_locked_.store(false, std::memory_order_release);
+}
+
+uint64_t Window::cost() const {
+
+    if (sequences_.size() < 3) {
+        return 0;
+    }
+
+    // each layer is aligned to the part of the graph between its positions,
+    // spanning layers to the whole graph
+    uint32_t offset = 0.01 * sequences_.front().second;
+    uint64_t cost = 0;
+    for (uint32_t i = 1; i < sequences_.size(); ++i) {
+        uint64_t span = sequences_.front().second;
+        if (positions_[i].first >= offset || positions_[i].second <=
+            sequences_.front().second - offset) {
+            span = positions_[i].second - positions_[i].first + 1;
+        }
+        cost += span * sequences_[i].second;
+    }
+    return cost;
 }
 
 bool Window::generate_consensus(std::shared_ptr<spoa::AlignmentEngine> alignment_engine,
-    bool trim) {
+    std::unique_ptr<spoa::Graph>& graph, bool trim, bool quality) {
 
     if (sequences_.size() < 3) {
         consensus_ = std::string(sequences_.front().first, sequences_.front().second);
+        if (quality) {
+            consensus_quality_ = std::string(qualities_.front().first,
+                qualities_.front().second);
+        }
         return false;
     }
 
-    auto graph = spoa::createGraph();
+    graph->clear();
     graph->add_alignment(spoa::Alignment(), sequences_.front().first,
         sequences_.front().second, qualities_.front().first,
         qualities_.front().second);
@@ -89,29 +284,32 @@ bool Window::generate_consensus(std::shared_ptr<spoa::AlignmentEngine> alignment
         return positions_[lhs].first < positions_[rhs].first; });
 
    uint32_t offset = 0.01 * sequences_.front().second;
+    std::vector<int32_t> mapping;
+    // the graph copies layers so one decoded layer is kept at a time
+    std::string data_buffer, quality_buffer;
     for (uint32_t j = 1; j < sequences_.size(); ++j) {
         uint32_t i = rank[j];
+        auto layer = this->layer(i, data_buffer, quality_buffer);
 
         spoa::Alignment alignment;
         if (positions_[i].first < offset && positions_[i].second >
             sequences_.front().second - offset) {
-            alignment = alignment_engine->align(sequences_[i].first,
+            alignment = alignment_engine->align(layer.first,
                 sequences_[i].second, graph);
         } else {
-            std::vector<int32_t> mapping;
             auto subgraph = graph->subgraph(positions_[i].first,
                 positions_[i].second, mapping);
-            alignment = alignment_engine->align( sequences_[i].first,
+            alignment = alignment_engine->align(layer.first,
                 sequences_[i].second, subgraph);
             subgraph->update_alignment(alignment, mapping);
         }
 
-        if (qualities_[i].first == nullptr) {
-            graph->add_alignment(alignment, sequences_[i].first,
+        if (layer.second == nullptr) {
+            graph->add_alignment(alignment, layer.first,
                 sequences_[i].second);
         } else {
-            graph->add_alignment(alignment, sequences_[i].first,
-                sequences_[i].second, qualities_[i].first,
+            graph->add_alignment(alignment, layer.first,
+                sequences_[i].second, layer.second,
                 qualities_[i].second);
         }
     }
@@ -122,6 +320,9 @@ bool Window::generate_consensus(std::shared_ptr<spoa::AlignmentEngine> alignment
     if (type_ == WindowType::kTGS && trim) {
         std::vector<uint32_t> coverages;
         consensus_ = graph->generate_consensus(coverages);
+        if (quality) {
+            consensus_quality_ = consensusQuality(coverages, sequences_.size());
+        }
         uint32_t average_coverage = (sequences_.size() - 1) / 2;
 
         int32_t begin = 0, end = consensus_.size() - 1;
@@ -141,10 +342,17 @@ bool Window::generate_consensus(std::shared_ptr<spoa::AlignmentEngine> alignment
                 "contig %lu might be chimeric in window %u!\n", id_, rank_);
         } else {
             consensus_ = consensus_.substr(begin, end - begin + 1);
+            if (quality) {
+                consensus_quality_ = consensus_quality_.substr(begin, end - begin + 1);
+            }
         }
     } else if (overlap_ == true) {
         consensus_ = graph->generate_consensus(summary_, true);
         coder_ = graph->coder();
+    } else if (quality) {
+        std::vector<uint32_t> coverages;
+        consensus_ = graph->generate_consensus(coverages);
+        consensus_quality_ = consensusQuality(coverages, sequences_.size());
     } else {
         consensus_ = graph->generate_consensus();
     }
@@ -7,6 +7,7 @@
 #pragma once
 
 #include <stdlib.h>
+#include <atomic>
 #include <vector>
 #include <memory>
 #include <string>
@@ -14,10 +15,13 @@
 
 namespace spoa {
     class AlignmentEngine;
+    class Graph;
 }
 
 namespace racon {
 
+class Sequence;
+
 enum class WindowType {
     kNGS, // Next Generation Sequencing
     kTGS // Third Generation Sequencing
@@ -44,6 +48,11 @@ public:
         return consensus_;
     }
 
+    // empty unless requested in generate_consensus()
+    const std::string& consensus_quality() const {
+        return consensus_quality_;
+    }
+
     const std::vector<uint32_t>& summary() const {
         return summary_;
     }
@@ -60,12 +69,44 @@ public:
         return positions_;
     }
 
+    // estimated number of cells computed in POA during generate_consensus
+    uint64_t cost() const;
+
+    // graph is cleared before use so that it can be reused between windows,
+    // consensus qualities are estimated from the number of layers supporting
+    // each base (not available for windows with overlap)
     bool generate_consensus(std::shared_ptr<spoa::AlignmentEngine> alignment_engine,
-        bool trim);
+        std::unique_ptr<spoa::Graph>& graph, bool trim, bool quality = false);
 
+    // thread safe, layers are ordered by key in sort_layers(), the average
+    // quality used by subsample_layers() is computed from quality if it is
+    // not given (negative)
     void add_layer(const char* sequence, uint32_t sequence_length,
         const char* quality, uint32_t quality_length, uint32_t begin,
-        uint32_t end, uint32_t q_id);
+        uint32_t end, uint32_t q_id, uint64_t key = 0,
+        double average_quality = -1);
+
+    // thread safe, layer of a packed sequence (or of its reverse complement)
+    // which is decoded only while the consensus is generated, the sequence
+    // has to outlive the window, its average quality is taken from the
+    // quality index of the sequence
+    void add_layer(const Sequence* sequence, bool reverse, uint32_t sequence_begin,
+        uint32_t sequence_length, uint32_t begin, uint32_t end, uint32_t q_id,
+        uint64_t key = 0);
+
+    // data and qualities (nullptr if there are none) of layer i, layers of
+    // packed sequences are decoded into the buffers
+    std::pair<const char*, const char*> layer(uint32_t i, std::string& data_buffer,
+        std::string& quality_buffer) const;
+
+    // stable sorts layers by their keys to make consensus independent of
+    // the order in which concurrent add_layer() calls were made
+    void sort_layers();
+
+    // keeps at most max_depth layers preferring the ones spanning the whole
+    // window and then the ones with higher average quality (ties are broken
+    // by layer order), returns true if any layers were dropped
+    bool subsample_layers(uint32_t max_depth);
 
     friend std::shared_ptr<Window> createWindow(uint64_t id, uint32_t rank,
         WindowType type, bool overlap, const char* backbone, uint32_t backbone_length,
@@ -80,17 +121,34 @@ private:
     Window(const Window&) = delete;
     const Window& operator=(const Window&) = delete;
 
+    void lock();
+    void unlock();
+
+    // reorders layers, rank[0] has to be the backbone
+    void select_layers(const std::vector<uint32_t>& rank);
+
     uint64_t id_;
     uint32_t rank_;
     WindowType type_;
     bool overlap_;
     std::string consensus_;
+    std::string consensus_quality_;
     std::vector<uint32_t> summary_;
     std::vector<int32_t> coder_;
+    // data is nullptr for layers of packed sequences
     std::vector<std::pair<const char*, uint32_t>> sequences_;
     std::vector<std::pair<const char*, uint32_t>> qualities_;
+    struct PackedLayer {
+        const Sequence* sequence;
+        uint32_t begin;
+        bool is_reverse;
+    };
+    std::vector<PackedLayer> packed_layers_;
+    std::vector<double> average_qualities_;
     std::vector<std::pair<uint32_t, uint32_t>> positions_;
     std::vector<uint32_t> q_ids_;
+    std::vector<uint64_t> keys_;
+    std::atomic<bool> is_locked_;
 };
 
 }
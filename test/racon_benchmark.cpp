@@ -0,0 +1,392 @@
+/*!
+ * @file racon_benchmark.cpp
+ *
+ * @brief Racon benchmark source file
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "racon_test_config.h"
+
+#include "aligner.hpp"
+#include "name_index.hpp"
+#include "overlap.hpp"
+#include "polisher.hpp"
+#include "sequence.hpp"
+#include "window.hpp"
+
+#include "bioparser/bioparser.hpp"
+#include "spoa/spoa.hpp"
+
+static struct option options[] = {
+    {"repetitions", required_argument, 0, 'r'},
+    {"threads", required_argument, 0, 't'},
+    {"window-length", required_argument, 0, 'w'},
+    {"end-to-end", no_argument, 0, 'e'},
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+};
+
+void help();
+
+// peak resident set size of the process in kilobytes
+uint64_t peakRss() {
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+}
+
+// runs setup (not measured) and body num_repetitions times and returns the
+// median running time of body in seconds
+double measure(uint32_t num_repetitions, const std::function<void()>& setup,
+    const std::function<void()>& body) {
+
+    std::vector<double> times;
+    for (uint32_t i = 0; i < num_repetitions; ++i) {
+        setup();
+        auto begin = std::chrono::steady_clock::now();
+        body();
+        times.emplace_back(std::chrono::duration_cast<std::chrono::duration<double>>(
+            std::chrono::steady_clock::now() - begin).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+void report(const std::string& name, double time, uint64_t num_items,
+    const std::string& unit) {
+    fprintf(stdout, "%-48s %12.6f s %14.1f %s/s\n", name.c_str(), time,
+        time > 0 ? num_items / time : 0, unit.c_str());
+    fflush(stdout);
+}
+
+/*!
+ * @brief Bundled sample data set up the way Polisher::initialize() does it,
+ * targets come first and are followed by reads
+ */
+struct SampleData {
+    SampleData() {
+        auto tparser = bioparser::createParser<bioparser::FastaParser,
+            racon::Sequence>(racon_test_data_path + "sample_layout.fasta.gz");
+        tparser->parse(sequences, -1);
+        targets_size = sequences.size();
+        for (uint64_t i = 0; i < targets_size; ++i) {
+            name_to_id.insert(sequences[i]->name(), true, i);
+        }
+
+        auto sparser = bioparser::createParser<bioparser::FastqParser,
+            racon::Sequence>(racon_test_data_path + "sample_reads.fastq.gz");
+        sparser->parse(sequences, -1);
+        for (uint64_t i = targets_size; i < sequences.size(); ++i) {
+            name_to_id.insert(sequences[i]->name(), false, i);
+            id_to_id[(i - targets_size) << 1 | 0] = i;
+            sequences[i]->create_reverse_complement();
+        }
+        for (uint64_t i = 0; i < targets_size; ++i) {
+            id_to_id[i << 1 | 1] = i;
+        }
+    }
+
+    template<template<class> class T>
+    void parse_overlaps(const std::string& path,
+        std::vector<std::unique_ptr<racon::Overlap>>& dst) const {
+
+        dst.clear();
+        auto oparser = bioparser::createParser<T, racon::Overlap>(path);
+        oparser->parse(dst, -1);
+        for (auto& it: dst) {
+            it->transmute(sequences, name_to_id, id_to_id);
+        }
+        dst.erase(std::remove_if(dst.begin(), dst.end(),
+            [](const std::unique_ptr<racon::Overlap>& it) -> bool {
+                return !it->is_valid();
+            }), dst.end());
+    }
+
+    std::vector<std::unique_ptr<racon::Sequence>> sequences;
+    uint64_t targets_size;
+    racon::NameIndex name_to_id;
+    std::unordered_map<uint64_t, uint64_t> id_to_id;
+};
+
+// copy of src with substitutions, insertions and deletions at rate error
+std::string mutate(const std::string& src, double error, std::mt19937& generator) {
+    const char* bases = "ACGT";
+    std::uniform_real_distribution<double> probability(0, 1);
+    std::uniform_int_distribution<uint32_t> base(0, 3);
+
+    std::string dst;
+    dst.reserve(src.size() * (1 + error));
+    for (const auto& it: src) {
+        double p = probability(generator);
+        if (p < error / 3) {
+            dst += bases[base(generator)];
+        } else if (p < 2 * error / 3) {
+            dst += it;
+            dst += bases[base(generator)];
+        } else if (p >= error) {
+            dst += it;
+        }
+    }
+    return dst;
+}
+
+void benchmarkBreakingPoints(const SampleData& data, uint32_t window_length,
+    uint32_t num_repetitions) {
+
+    auto aligner = racon::createAligner(racon::AlignerType::kEdlib);
+    std::vector<std::unique_ptr<racon::Overlap>> overlaps;
+
+    uint64_t total_length = 0;
+    double time = measure(num_repetitions, [&]() -> void {
+        data.parse_overlaps<bioparser::SamParser>(racon_test_data_path +
+            "sample_overlaps.sam.gz", overlaps);
+    }, [&]() -> void {
+        for (const auto& it: overlaps) {
+            it->find_breaking_points(data.sequences, window_length, 0, *aligner);
+        }
+    });
+    for (const auto& it: overlaps) {
+        total_length += it->length();
+    }
+    report("breaking_points_from_cigar (sam)", time, total_length, "bp");
+
+    time = measure(num_repetitions, [&]() -> void {
+        data.parse_overlaps<bioparser::PafParser>(racon_test_data_path +
+            "sample_overlaps.paf.gz", overlaps);
+    }, [&]() -> void {
+        for (const auto& it: overlaps) {
+            it->find_breaking_points(data.sequences, window_length, 0, *aligner);
+        }
+    });
+    total_length = 0;
+    for (const auto& it: overlaps) {
+        total_length += it->length();
+    }
+    report("align_overlaps (paf, edlib)", time, total_length, "bp");
+}
+
+void benchmarkReverseComplement(const SampleData& data,
+    uint32_t num_repetitions) {
+
+    std::vector<std::unique_ptr<racon::Sequence>> sequences;
+    uint64_t total_length = 0;
+    double time = measure(num_repetitions, [&]() -> void {
+        sequences.clear();
+        total_length = 0;
+        for (uint64_t i = data.targets_size; i < data.sequences.size(); ++i) {
+            sequences.emplace_back(racon::createSequence(
+                data.sequences[i]->name(), data.sequences[i]->data(),
+                data.sequences[i]->quality()));
+            total_length += sequences.back()->length();
+        }
+    }, [&]() -> void {
+        for (const auto& it: sequences) {
+            it->create_reverse_complement();
+        }
+    });
+    report("create_reverse_complement", time, total_length, "bp");
+}
+
+// synthetic windows of uniformly random backbones covered by layers with 10%
+// error, layers span the whole window
+void benchmarkConsensus(uint32_t num_repetitions) {
+
+    auto alignment_engine = std::shared_ptr<spoa::AlignmentEngine>(
+        spoa::createAlignmentEngine(spoa::AlignmentType::kNW, 3, -5, -4));
+    auto graph = spoa::createGraph();
+
+    const uint32_t kNumWindows = 8;
+    for (uint32_t length: { 500, 1000, 2000 }) {
+        for (uint32_t depth: { 10, 30, 60 }) {
+            alignment_engine->prealloc(length, 5);
+
+            std::mt19937 generator(length * depth);
+            std::uniform_int_distribution<uint32_t> base(0, 3);
+            std::vector<std::string> backbones(kNumWindows);
+            std::vector<std::vector<std::string>> layers(kNumWindows);
+            for (uint32_t i = 0; i < kNumWindows; ++i) {
+                for (uint32_t j = 0; j < length; ++j) {
+                    backbones[i] += "ACGT"[base(generator)];
+                }
+                for (uint32_t j = 0; j < depth; ++j) {
+                    layers[i].emplace_back(mutate(backbones[i], 0.1, generator));
+                }
+            }
+
+            std::vector<std::shared_ptr<racon::Window>> windows;
+            double time = measure(num_repetitions, [&]() -> void {
+                windows.clear();
+                for (uint32_t i = 0; i < kNumWindows; ++i) {
+                    windows.emplace_back(racon::createWindow(i, 0,
+                        racon::WindowType::kTGS, false, backbones[i].c_str(),
+                        length, nullptr, 0));
+                    for (uint32_t j = 0; j < depth; ++j) {
+                        windows.back()->add_layer(layers[i][j].c_str(),
+                            layers[i][j].size(), nullptr, 0, 0, length - 1, j + 1);
+                    }
+                }
+            }, [&]() -> void {
+                for (const auto& it: windows) {
+                    it->generate_consensus(alignment_engine, graph, false);
+                }
+            });
+            report("generate_consensus (length " + std::to_string(length) +
+                ", depth " + std::to_string(depth) + ")", time, kNumWindows,
+                "windows");
+        }
+    }
+}
+
+// polishes the whole data set, windows are counted from target lengths as
+// in Polisher::create_windows()
+void benchmarkPolishing(const std::string& name, const std::string& sequences_path,
+    const std::string& overlaps_path, const std::string& target_path,
+    uint32_t window_length, double overlap_percentage, uint32_t num_threads,
+    uint32_t num_repetitions) {
+
+    uint64_t num_reads = 0, num_windows = 0;
+    {
+        std::vector<std::unique_ptr<racon::Sequence>> sequences;
+        auto is_fastq = [](const std::string& path) -> bool {
+            return path.find(".fq") != std::string::npos ||
+                path.find(".fastq") != std::string::npos;
+        };
+        auto sparser = is_fastq(sequences_path) ?
+            bioparser::createParser<bioparser::FastqParser, racon::Sequence>(sequences_path) :
+            bioparser::createParser<bioparser::FastaParser, racon::Sequence>(sequences_path);
+        while (true) {
+            auto status = sparser->parse(sequences, 256 * 1024 * 1024);
+            num_reads += sequences.size();
+            sequences.clear();
+            if (!status) {
+                break;
+            }
+        }
+        auto tparser = is_fastq(target_path) ?
+            bioparser::createParser<bioparser::FastqParser, racon::Sequence>(target_path) :
+            bioparser::createParser<bioparser::FastaParser, racon::Sequence>(target_path);
+        tparser->parse(sequences, -1);
+        for (const auto& it: sequences) {
+            num_windows += (it->data().size() + window_length - 1) / window_length;
+        }
+    }
+
+    double time = measure(num_repetitions, []() -> void {}, [&]() -> void {
+        racon::PolisherOptions options;
+        options.window_length = window_length;
+        options.overlap_percentage = overlap_percentage;
+        options.num_threads = num_threads;
+        auto polisher = racon::createPolisher(sequences_path, overlaps_path,
+            target_path, options);
+        polisher->initialize();
+        std::vector<std::unique_ptr<racon::Sequence>> polished_sequences;
+        polisher->polish(polished_sequences, true);
+    });
+    report(name + " reads", time, num_reads, "reads");
+    report(name + " windows", time, num_windows, "windows");
+    fprintf(stdout, "%-48s %12lu kB\n", (name + " peak memory").c_str(), peakRss());
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+
+    uint32_t num_repetitions = 3;
+    uint32_t num_threads = 1;
+    uint32_t window_length = 500;
+    bool end_to_end_only = false;
+
+    int32_t argument;
+    while ((argument = getopt_long(argc, argv, "r:t:w:eh", options, nullptr)) != -1) {
+        switch (argument) {
+            case 'r':
+                num_repetitions = atoi(optarg);
+                break;
+            case 't':
+                num_threads = atoi(optarg);
+                break;
+            case 'w':
+                window_length = atoi(optarg);
+                break;
+            case 'e':
+                end_to_end_only = true;
+                break;
+            case 'h':
+                help();
+                exit(0);
+            default:
+                exit(1);
+        }
+    }
+
+    if (num_repetitions == 0 || num_threads == 0 || window_length == 0) {
+        fprintf(stderr, "[racon_benchmark::] error: invalid parameters!\n");
+        exit(1);
+    }
+
+    std::vector<std::string> input_paths;
+    for (int32_t i = optind; i < argc; ++i) {
+        input_paths.emplace_back(argv[i]);
+    }
+    if (!input_paths.empty() && input_paths.size() != 3) {
+        fprintf(stderr, "[racon_benchmark::] error: missing input file(s)!\n");
+        help();
+        exit(1);
+    }
+    if (input_paths.empty()) {
+        input_paths = { racon_test_data_path + "sample_reads.fastq.gz",
+            racon_test_data_path + "sample_overlaps.paf.gz",
+            racon_test_data_path + "sample_layout.fasta.gz" };
+    }
+
+    // run first so that peak memory is not inflated by the microbenchmarks
+    benchmarkPolishing("polish", input_paths[0], input_paths[1], input_paths[2],
+        window_length, 0, num_threads, num_repetitions);
+    if (end_to_end_only) {
+        return 0;
+    }
+    benchmarkPolishing("polish (overlap mode, stitching)", input_paths[0],
+        input_paths[1], input_paths[2], window_length, 0.1, num_threads,
+        num_repetitions);
+
+    SampleData data;
+    benchmarkBreakingPoints(data, window_length, num_repetitions);
+    benchmarkReverseComplement(data, num_repetitions);
+    benchmarkConsensus(num_repetitions);
+
+    return 0;
+}
+
+void help() {
+    printf(
+        "usage: racon_benchmark [options ...] [<sequences> <overlaps> <target sequences>]\n"
+        "\n"
+        "    runs polishing end-to-end on the given data set (bundled sample\n"
+        "    data if none is given) followed by microbenchmarks on the bundled\n"
+        "    sample data, reported times are medians of all repetitions\n"
+        "\n"
+        "    options:\n"
+        "        -r, --repetitions <int>\n"
+        "            default: 3\n"
+        "            number of runs of each benchmark\n"
+        "        -t, --threads <int>\n"
+        "            default: 1\n"
+        "            number of threads used for polishing\n"
+        "        -w, --window-length <int>\n"
+        "            default: 500\n"
+        "            size of window on which POA is performed\n"
+        "        -e, --end-to-end\n"
+        "            run only end-to-end polishing\n"
+        "        -h, --help\n"
+        "            prints the usage\n"
+    );
+}
@@ -4,12 +4,28 @@
  * @brief Racon unit test source file
  */
 
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
 #include "racon_test_config.h"
 
+#include "arena.hpp"
+#include "aligner.hpp"
+#include "breaking_points.hpp"
+#include "name_index.hpp"
+#include "read_store.hpp"
 #include "sequence.hpp"
 #include "polisher.hpp"
+#include "sink.hpp"
+#include "source.hpp"
+#include "overlap.hpp"
+#include "overlap_index.hpp"
+#include "window.hpp"
 
 #include "edlib.h"
+#include "zlib.h"
 #include "bioparser/bioparser.hpp"
 #include "gtest/gtest.h"
 
@@ -30,11 +46,35 @@ public:
         const std::string& target_path, racon::PolisherType type,
         uint32_t window_length, double overlap_percentage, double quality_threshold, double error_threshold,
         int8_t match, int8_t mismatch, int8_t gap, uint32_t cuda_batches = 0,
-        bool cuda_banded_alignment = false, uint32_t cudaaligner_batches = 0) {
-
+        bool cuda_banded_alignment = false, uint32_t cudaaligner_batches = 0,
+        bool stream = false) {
+
+        auto options = createOptions(type, window_length, overlap_percentage,
+            quality_threshold, error_threshold, match, mismatch, gap);
+        options.cuda_batches = cuda_batches;
+        options.cuda_banded_alignment = cuda_banded_alignment;
+        options.cudaaligner_batches = cudaaligner_batches;
+        options.stream = stream;
         polisher = racon::createPolisher(sequences_path, overlaps_path, target_path,
-            type, window_length, overlap_percentage, quality_threshold, error_threshold, true, match,
-            mismatch, gap, 4, cuda_batches, cuda_banded_alignment, cudaaligner_batches);
+            options);
+    }
+
+    // parameters of SetUp() on 4 threads, the rest are defaults
+    static racon::PolisherOptions createOptions(racon::PolisherType type,
+        uint32_t window_length, double overlap_percentage, double quality_threshold,
+        double error_threshold, int8_t match, int8_t mismatch, int8_t gap) {
+
+        racon::PolisherOptions options;
+        options.type = type;
+        options.window_length = window_length;
+        options.overlap_percentage = overlap_percentage;
+        options.quality_threshold = quality_threshold;
+        options.error_threshold = error_threshold;
+        options.match = match;
+        options.mismatch = mismatch;
+        options.gap = gap;
+        options.num_threads = 4;
+        return options;
     }
 
     void TearDown() {}
@@ -53,36 +93,555 @@ public:
 };
 
 TEST(RaconInitializeTest, PolisherTypeError) {
-    EXPECT_DEATH((racon::createPolisher("", "", "", static_cast<racon::PolisherType>(3),
-        0, 0, 0, 0, 0, 0, 0, 0, 0)), ".racon::createPolisher. error: invalid polisher"
-        " type!");
+    racon::PolisherOptions options;
+    options.type = static_cast<racon::PolisherType>(3);
+    EXPECT_DEATH((racon::createPolisher("", "", "", options)),
+        ".racon::createPolisher. error: invalid polisher type!");
 }
 
 TEST(RaconInitializeTest, WindowLengthError) {
-    EXPECT_DEATH((racon::createPolisher("", "", "", racon::PolisherType::kC, 0,
-        0, 0, 0, 0, 0, 0, 0, 0)), ".racon::createPolisher. error: invalid window length!");
+    racon::PolisherOptions options;
+    options.window_length = 0;
+    EXPECT_DEATH((racon::createPolisher("", "", "", options)),
+        ".racon::createPolisher. error: invalid window length!");
+}
+
+TEST(RaconInitializeTest, GapModelError) {
+    racon::PolisherOptions options;
+    options.gap_model = racon::GapModel::kAffine;
+    options.gap_extend = -6;
+    EXPECT_DEATH((racon::createPolisher("", "", "", options)),
+        ".racon::createPolisher. error: gap extend penalty has to be in .gap, 0.!");
+}
+
+TEST(RaconInitializeTest, RoundsError) {
+    racon::PolisherOptions options;
+    options.num_rounds = 0;
+    EXPECT_DEATH((racon::createPolisher("", "", "", options)),
+        ".racon::createPolisher. error: invalid number of rounds!");
 }
 
 TEST(RaconInitializeTest, SequencesPathExtensionError) {
-    EXPECT_DEATH((racon::createPolisher("", "", "", racon::PolisherType::kC, 500,
-        0, 0, 0, 0, 0, 0, 0, 0)), ".racon::createPolisher. error: file  has unsupported "
-        "format extension .valid extensions: .fasta, .fasta.gz, .fna, .fna.gz, "
-        ".fa, .fa.gz, .fastq, .fastq.gz, .fq, .fq.gz.!");
+    EXPECT_DEATH((racon::createPolisher("", "", "", racon::PolisherOptions())),
+        ".racon::createPolisher. error: file  has unsupported format extension "
+        ".valid extensions: .fasta, .fasta.gz, .fna, .fna.gz, .fa, .fa.gz, "
+        ".fastq, .fastq.gz, .fq, .fq.gz.!");
 }
 
 TEST(RaconInitializeTest, OverlapsPathExtensionError) {
     EXPECT_DEATH((racon::createPolisher(racon_test_data_path + "sample_reads.fastq.gz",
-        "", "", racon::PolisherType::kC, 500, 0, 0, 0, 0, 0, 0, 0, 0)),
+        "", "", racon::PolisherOptions())),
         ".racon::createPolisher. error: file  has unsupported format extension "
         ".valid extensions: .mhap, .mhap.gz, .paf, .paf.gz, .sam, .sam.gz.!");
 }
 
 TEST(RaconInitializeTest, TargetPathExtensionError) {
     EXPECT_DEATH((racon::createPolisher(racon_test_data_path + "sample_reads.fastq.gz",
-        racon_test_data_path + "sample_overlaps.paf.gz", "", racon::PolisherType::kC,
-        500, 0, 0, 0, 0, 0, 0, 0, 0)), ".racon::createPolisher. error: file  has "
-        "unsupported format extension .valid extensions: .fasta, .fasta.gz, .fna, "
-        ".fna.gz, .fa, .fa.gz, .fastq, .fastq.gz, .fq, .fq.gz.!");
+        racon_test_data_path + "sample_overlaps.paf.gz", "", racon::PolisherOptions())),
+        ".racon::createPolisher. error: file  has unsupported format extension "
+        ".valid extensions: .fasta, .fasta.gz, .fna, .fna.gz, .fa, .fa.gz, "
+        ".fastq, .fastq.gz, .fq, .fq.gz.!");
+}
+
+TEST(RaconArenaTest, ReuseAndRelease) {
+    racon::Arena arena(24, 4);
+
+    std::vector<void*> objects;
+    for (uint32_t i = 0; i < 9; ++i) {
+        objects.emplace_back(arena.allocate());
+    }
+    EXPECT_EQ(arena.num_chunks(), 3U);
+
+    arena.deallocate(objects[3]);
+    EXPECT_EQ(arena.allocate(), objects[3]);
+
+    for (const auto& it: objects) {
+        arena.deallocate(it);
+    }
+    EXPECT_EQ(arena.num_objects(), 0U);
+    EXPECT_EQ(arena.num_chunks(), 0U);
+}
+
+TEST(RaconArenaTest, Threads) {
+    racon::Arena arena(24, 16);
+
+    // objects are freed by other threads than the allocating ones
+    std::vector<std::vector<void*>> objects(4);
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < objects.size(); ++i) {
+        threads.emplace_back([&](uint32_t j) -> void {
+            for (uint32_t k = 0; k < 1000; ++k) {
+                objects[j].emplace_back(arena.allocate());
+            }
+        }, i);
+    }
+    for (auto& it: threads) {
+        it.join();
+    }
+    threads.clear();
+    EXPECT_EQ(arena.num_objects(), 4000U);
+
+    for (uint32_t i = 0; i < objects.size(); ++i) {
+        threads.emplace_back([&](uint32_t j) -> void {
+            for (const auto& it: objects[(j + 1) % objects.size()]) {
+                arena.deallocate(it);
+            }
+        }, i);
+    }
+    for (auto& it: threads) {
+        it.join();
+    }
+    EXPECT_EQ(arena.num_objects(), 0U);
+    EXPECT_EQ(arena.num_chunks(), 0U);
+}
+
+TEST(RaconBreakingPointsTest, DeltaCoding) {
+    // small, negative and large deltas
+    std::vector<std::pair<uint32_t, uint32_t>> expected = { { 100, 5 },
+        { 599, 520 }, { 550, 470 }, { 1099, 90000 }, { 1050, 89950 },
+        { 4000000000U, 3 }, { 4000000499U, 0 } };
+
+    racon::BreakingPoints breaking_points;
+    EXPECT_TRUE(breaking_points.empty());
+    for (const auto& it: expected) {
+        breaking_points.push_back(it.first, it.second);
+    }
+    EXPECT_EQ(breaking_points.size(), expected.size());
+    EXPECT_EQ(breaking_points.decode(), expected);
+
+    breaking_points.clear();
+    EXPECT_TRUE(breaking_points.empty());
+    EXPECT_TRUE(breaking_points.decode().empty());
+}
+
+TEST(RaconNameIndexTest, TargetAndQueryIds) {
+    racon::NameIndex index;
+    for (uint64_t i = 0; i < 5000; ++i) {
+        index.insert("read" + std::to_string(i), false, i);
+        if (i % 3 == 0) {
+            index.insert("read" + std::to_string(i), true, i / 3);
+        }
+    }
+    EXPECT_EQ(index.size(), 5000U);
+
+    uint64_t id = 0;
+    for (uint64_t i = 0; i < 5000; ++i) {
+        EXPECT_TRUE(index.find("read" + std::to_string(i), false, id));
+        EXPECT_EQ(id, i);
+        EXPECT_EQ(index.find("read" + std::to_string(i), true, id), i % 3 == 0);
+    }
+    EXPECT_FALSE(index.find("read5000", false, id));
+    EXPECT_FALSE(index.find("read", false, id));
+
+    index.clear();
+    EXPECT_FALSE(index.find("read0", false, id));
+}
+
+TEST(RaconOverlapIndexTest, SortedTargets) {
+    auto record = [](const std::string& query, const std::string& target) -> std::string {
+        return query + "\t1000\t0\t900\t+\t" + target + "\t5000\t10\t910\t800\t900\t60\n";
+    };
+    auto write = [](const std::string& path, const std::string& data) -> void {
+        std::ofstream file(path);
+        file << data;
+    };
+
+    // read x spans target0 and target1 (records of unknown targets are invalid)
+    std::string path = "racon_test_index.paf";
+    write(path, record("a", "target0") + record("x", "target0") +
+        record("y", "unknown") + record("x", "target1") + record("c", "target2"));
+    auto index = racon::createOverlapIndex(path);
+    ASSERT_TRUE(index != nullptr);
+    std::vector<std::string> targets = { "target0", "target1", "target2" };
+    EXPECT_TRUE(index->splits_queries(targets, { "target1" }));
+    EXPECT_FALSE(index->splits_queries(targets, { "target0", "target1" }));
+    EXPECT_FALSE(index->splits_queries(targets, { "target2" }));
+
+    // records of target0 are not consecutive
+    write(path, record("a", "target0") + record("b", "target1") + record("c", "target0"));
+    EXPECT_TRUE(racon::createOverlapIndex(path) == nullptr);
+
+    std::remove(path.c_str());
+    std::remove((path + ".ridx").c_str());
+}
+
+TEST(RaconAlignerTest, GlobalAlignment) {
+    std::string q = "ACGTTGCAAGTCCGATAGGCTTACGATCGATCGGATCGTAGCTAGCTGACTGATCG";
+    std::string t = "ACGTTGCAGTCCGATAGGCTTTACGATCGATCGGATCGTAGCAAGCTGACTGATCG";
+
+    for (const auto& type: {racon::AlignerType::kEdlib, racon::AlignerType::kEdlibBanded,
+        racon::AlignerType::kEdlibAnchored}) {
+        std::vector<uint8_t> ops;
+        EXPECT_TRUE(racon::createAligner(type)->align(q.c_str(), q.size(),
+            t.c_str(), t.size(), 0, ops));
+
+        uint32_t q_length = 0, t_length = 0, num_edits = 0;
+        for (const auto& it: ops) {
+            q_length += it != 2;
+            t_length += it != 1;
+            num_edits += it != 0;
+        }
+        EXPECT_EQ(q_length, q.size());
+        EXPECT_EQ(t_length, t.size());
+        EXPECT_EQ(num_edits, calculateEditDistance(q, t));
+    }
+}
+
+TEST(RaconAlignerTest, AnchoredLongAlignment) {
+    std::string t, q;
+    uint32_t seed = 7;
+    auto next = [&]() -> uint32_t {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) & 0x7FFF;
+    };
+    for (uint32_t i = 0; i < 100000; ++i) {
+        t += "ACGT"[next() % 4];
+        uint32_t r = next() % 100;
+        if (r < 3) {
+            q += "ACGT"[next() % 4];
+        } else if (r < 6) {
+            q += t.back();
+            q += "ACGT"[next() % 4];
+        } else if (r >= 9) {
+            q += t.back();
+        }
+    }
+
+    std::vector<uint8_t> ops;
+    EXPECT_TRUE(racon::createAligner(racon::AlignerType::kEdlibAnchored)->align(
+        q.c_str(), q.size(), t.c_str(), t.size(), 0.1, ops));
+
+    uint32_t q_length = 0, t_length = 0;
+    for (const auto& it: ops) {
+        q_length += it != 2;
+        t_length += it != 1;
+    }
+    EXPECT_EQ(q_length, q.size());
+    EXPECT_EQ(t_length, t.size());
+}
+
+TEST(RaconAlignerTest, OverlapAlignment) {
+    std::string l = "TTGACCGTAGGCTAACGTTAGC";
+    std::string r = "ACCGTAGCTAACGTTAGCATTCA";
+
+    std::string row_l, row_r;
+    std::vector<int32_t> matrix;
+    racon::alignOverlap(l.c_str(), l.size(), r.c_str(), r.size(), row_l,
+        row_r, matrix);
+    EXPECT_EQ(row_l, "TTGACCGTAGGCTAACGTTAGC-----");
+    EXPECT_EQ(row_r, "---ACCGTA-GCTAACGTTAGCATTCA");
+
+    // the band follows the length difference, a long tail of r stays an
+    // end gap
+    std::string tail;
+    for (uint32_t i = 0; i < 300; ++i) {
+        tail += "ACGT"[(i * 7 + i / 3) % 4];
+    }
+    r += tail;
+    racon::alignOverlap(l.c_str(), l.size(), r.c_str(), r.size(), row_l,
+        row_r, matrix);
+    EXPECT_EQ(row_l, "TTGACCGTAGGCTAACGTTAGC-----" + std::string(tail.size(), '-'));
+    EXPECT_EQ(row_r, "---ACCGTA-GCTAACGTTAGCATTCA" + tail);
+}
+
+TEST(RaconOverlapTest, ReciprocalBreakingPoints) {
+    std::string a;
+    uint32_t seed = 11;
+    for (uint32_t i = 0; i < 1200; ++i) {
+        seed = seed * 1103515245 + 12345;
+        a += "ACGT"[(seed >> 16) & 3];
+    }
+    // one substitution and one insertion which can be placed only once
+    std::string b = a;
+    b[300] = b[300] == 'A' ? 'C' : 'A';
+    char inserted = 'A';
+    while (inserted == b[799] || inserted == b[800]) {
+        ++inserted;
+    }
+    b.insert(b.begin() + 800, inserted);
+
+    std::vector<std::unique_ptr<racon::Sequence>> sequences;
+    sequences.emplace_back(racon::createSequence("a", a));
+    sequences.emplace_back(racon::createSequence("b", b));
+    std::string reverse_b(b.rbegin(), b.rend());
+    for (auto& it: reverse_b) {
+        it = it == 'A' ? 'T' : it == 'C' ? 'G' : it == 'G' ? 'C' : 'A';
+    }
+    sequences.emplace_back(racon::createSequence("reverse_b", reverse_b));
+
+    racon::NameIndex name_to_id;
+    std::unordered_map<uint64_t, uint64_t> id_to_id;
+    for (uint64_t i = 0; i < sequences.size(); ++i) {
+        sequences[i]->create_reverse_complement();
+        id_to_id[i << 1 | 0] = i;
+        id_to_id[i << 1 | 1] = i;
+    }
+
+    auto aligner = racon::createAligner(racon::AlignerType::kEdlib);
+    for (uint32_t strand = 0; strand < 2; ++strand) {
+        uint64_t b_id = strand ? 2 : 1;
+        auto overlap = racon::createOverlap(0, 0, a.size(), a.size(), strand,
+            b_id, 0, b.size(), b.size());
+        auto reciprocal = racon::createOverlap(b_id, 0, b.size(), b.size(), strand,
+            0, 0, a.size(), a.size());
+        auto expected = racon::createOverlap(b_id, 0, b.size(), b.size(), strand,
+            0, 0, a.size(), a.size());
+        for (const auto& it: { overlap.get(), reciprocal.get(), expected.get() }) {
+            it->transmute(sequences, name_to_id, id_to_id);
+        }
+
+        overlap->find_breaking_points(sequences, 500, 0, *aligner, reciprocal.get());
+        expected->find_breaking_points(sequences, 500, 0, *aligner);
+
+        EXPECT_FALSE(overlap->breaking_points().empty());
+        EXPECT_EQ(reciprocal->breaking_points(), expected->breaking_points());
+    }
+
+    // the reciprocal CIGAR string is replaced by the swapped one
+    auto overlap = racon::createOverlap(0, 0, a.size(), a.size(), 0, 1, 0,
+        b.size(), b.size(), "800M1D400M");
+    auto reciprocal = racon::createOverlap(1, 0, b.size(), b.size(), 0, 0, 0,
+        a.size(), a.size(), "800M1I400M");
+    auto expected = racon::createOverlap(1, 0, b.size(), b.size(), 0, 0, 0,
+        a.size(), a.size(), "800M1I400M");
+    for (const auto& it: { overlap.get(), reciprocal.get(), expected.get() }) {
+        it->transmute(sequences, name_to_id, id_to_id);
+    }
+
+    overlap->find_breaking_points(sequences, 500, 0, *aligner, reciprocal.get());
+    expected->find_breaking_points(sequences, 500, 0, *aligner);
+
+    EXPECT_FALSE(reciprocal->has_cigar());
+    EXPECT_FALSE(overlap->breaking_points().empty());
+    EXPECT_EQ(reciprocal->breaking_points(), expected->breaking_points());
+}
+
+TEST(RaconOverlapTest, ReciprocalRanges) {
+    std::string x, y;
+    uint32_t seed = 13;
+    for (uint32_t i = 0; i < 1200; ++i) {
+        seed = seed * 1103515245 + 12345;
+        (i < 600 ? x : y) += "ACGT"[(seed >> 16) & 3];
+    }
+    // both halves of a are in b in swapped order, each pair of reads has two
+    // overlaps in both directions listed in different orders
+    std::string a = x + y, b = y + x;
+    b[900] = b[900] == 'A' ? 'C' : 'A';
+
+    std::vector<std::unique_ptr<racon::Sequence>> sequences;
+    sequences.emplace_back(racon::createSequence("a", a));
+    sequences.emplace_back(racon::createSequence("b", b));
+    racon::NameIndex name_to_id;
+    std::unordered_map<uint64_t, uint64_t> id_to_id = { {0, 0}, {1, 0}, {2, 1}, {3, 1} };
+
+    std::vector<std::unique_ptr<racon::Overlap>> overlaps;
+    overlaps.emplace_back(racon::createOverlap(0, 0, 600, 1200, 0, 1, 600, 1200, 1200));
+    overlaps.emplace_back(racon::createOverlap(0, 600, 1200, 1200, 0, 1, 0, 600, 1200));
+    overlaps.emplace_back(racon::createOverlap(1, 0, 600, 1200, 0, 0, 600, 1200, 1200));
+    overlaps.emplace_back(racon::createOverlap(1, 600, 1200, 1200, 0, 0, 0, 600, 1200));
+    for (const auto& it: overlaps) {
+        it->transmute(sequences, name_to_id, id_to_id);
+    }
+
+    EXPECT_FALSE(overlaps[0]->is_reciprocal(*overlaps[2]));
+    EXPECT_TRUE(overlaps[0]->is_reciprocal(*overlaps[3]));
+    EXPECT_TRUE(overlaps[1]->is_reciprocal(*overlaps[2]));
+    EXPECT_FALSE(overlaps[1]->is_reciprocal(*overlaps[0]));
+
+    // the partner keeps its own region
+    auto aligner = racon::createAligner(racon::AlignerType::kEdlib);
+    auto expected = racon::createOverlap(1, 600, 1200, 1200, 0, 0, 0, 600, 1200);
+    expected->transmute(sequences, name_to_id, id_to_id);
+    expected->find_breaking_points(sequences, 500, 0, *aligner);
+    overlaps[0]->find_breaking_points(sequences, 500, 0, *aligner, overlaps[3].get());
+    EXPECT_FALSE(overlaps[3]->breaking_points().empty());
+    EXPECT_EQ(overlaps[3]->breaking_points(), expected->breaking_points());
+}
+
+TEST(RaconOverlapTest, LiftUnchangedSpans) {
+    std::string a;
+    uint32_t seed = 7;
+    for (uint32_t i = 0; i < 1000; ++i) {
+        seed = seed * 1103515245 + 12345;
+        a += "ACGT"[(seed >> 16) & 3];
+    }
+
+    std::vector<std::unique_ptr<racon::Sequence>> sequences;
+    sequences.emplace_back(racon::createSequence("read", a.substr(0, 600)));
+    sequences.emplace_back(racon::createSequence("target", a));
+    racon::NameIndex name_to_id;
+    std::unordered_map<uint64_t, uint64_t> id_to_id = { {0, 0}, {1, 0}, {2, 1}, {3, 1} };
+
+    auto aligner = racon::createAligner(racon::AlignerType::kEdlib);
+    auto overlap = racon::createOverlap(0, 0, 600, 600, 0, 1, 0, 600, 1000);
+    overlap->transmute(sequences, name_to_id, id_to_id);
+    overlap->find_breaking_points(sequences, 500, 0, *aligner);
+    auto breaking_points = overlap->breaking_points().decode();
+    ASSERT_FALSE(breaking_points.empty());
+
+    // the second window grew by 10 bases
+    std::vector<std::pair<uint32_t, uint32_t>> anchors = { {0, 0}, {500, 500}, {1000, 1010} };
+    overlap->lift(anchors, { {0, 500} });
+    EXPECT_TRUE(overlap->is_valid());
+    EXPECT_FALSE(overlap->has_alignment());
+
+    overlap = racon::createOverlap(0, 0, 600, 600, 0, 1, 0, 600, 1000);
+    overlap->transmute(sequences, name_to_id, id_to_id);
+    overlap->find_breaking_points(sequences, 500, 0, *aligner);
+    overlap->lift({ {0, 0}, {1000, 1000} }, { {0, 1000} });
+    EXPECT_EQ(overlap->breaking_points().decode(), breaking_points);
+}
+
+TEST(RaconSequenceTest, PackedData) {
+    auto sequence = racon::createSequence("read", "ACGTNNACRGTTAGCATGCATCGATCGACTAGCATCAGN");
+    auto packed = racon::createSequence("read", sequence->data());
+
+    sequence->create_reverse_complement();
+    packed->transmute(true, true, true, true);
+    EXPECT_TRUE(packed->is_packed());
+    EXPECT_TRUE(packed->data().empty());
+    EXPECT_EQ(packed->length(), sequence->data().size());
+
+    std::string buffer;
+    for (uint32_t begin = 0; begin < sequence->length(); begin += 7) {
+        uint32_t length = std::min(11U, sequence->length() - begin);
+        EXPECT_EQ(std::string(packed->data(false, begin, length, buffer), length),
+            sequence->data().substr(begin, length));
+        EXPECT_EQ(std::string(packed->data(true, begin, length, buffer), length),
+            sequence->reverse_complement().substr(begin, length));
+    }
+
+    packed->create_reverse_complement();
+    EXPECT_TRUE(packed->is_packed());
+    EXPECT_EQ(packed->reverse_complement(), sequence->reverse_complement());
+
+    packed->release();
+    EXPECT_EQ(packed->num_bytes(), 0U);
+    EXPECT_EQ(packed->name(), "read");
+    EXPECT_EQ(packed->length(), sequence->length());
+}
+
+TEST(RaconSequenceTest, QualityIndex) {
+    std::string data, quality;
+    for (uint32_t i = 0; i < 300; ++i) {
+        data += "ACGT"[(i * 7) % 4];
+        quality += static_cast<char>('!' + (i * 37) % 41);
+    }
+    auto plain = racon::createSequence("read", data, quality);
+    auto packed = racon::createSequence("read", data, quality);
+    plain->transmute(true, false, true);
+    packed->transmute(true, true, true, true);
+
+    for (uint32_t begin = 0; begin < data.size(); begin += 13) {
+        for (uint32_t end = begin + 1; end <= data.size(); end += 29) {
+            for (bool reverse: { false, true }) {
+                double sum = 0;
+                for (uint32_t i = begin; i < end; ++i) {
+                    sum += (reverse ? quality[data.size() - 1 - i] : quality[i]) - 33;
+                }
+                double expected = sum / (end - begin);
+                EXPECT_DOUBLE_EQ(plain->average_quality(reverse, begin, end), expected);
+                EXPECT_DOUBLE_EQ(packed->average_quality(reverse, begin, end), expected);
+                for (double threshold: { 5.0, 15.0, 20.0, 25.0, 40.0 }) {
+                    EXPECT_EQ(plain->is_low_quality(reverse, begin, end, threshold),
+                        expected < threshold);
+                    EXPECT_EQ(packed->is_low_quality(reverse, begin, end, threshold),
+                        expected < threshold);
+                }
+            }
+        }
+    }
+}
+
+TEST(RaconSequenceTest, ReadStore) {
+    std::vector<std::unique_ptr<racon::Sequence>> sequences, stored;
+    auto parser = bioparser::createParser<bioparser::FastqParser, racon::Sequence>(
+        racon_test_data_path + "sample_reads.fastq.gz");
+    parser->parse(sequences, 1024 * 1024);
+    parser->reset();
+    parser->parse(stored, 1024 * 1024);
+    ASSERT_EQ(sequences.size(), stored.size());
+
+    racon::ReadStore store("racon_test_reads.store");
+    for (uint64_t i = 0; i < stored.size(); ++i) {
+        sequences[i]->create_reverse_complement();
+        stored[i]->transmute(true, true, true, true);
+    }
+    store.store(stored, 0, stored.size());
+    EXPECT_GT(store.size(), 0U);
+
+    std::string data_buffer, quality_buffer;
+    for (uint64_t i = 0; i < stored.size(); ++i) {
+        uint32_t length = std::min(100U, stored[i]->length());
+        for (bool strand: { false, true }) {
+            EXPECT_EQ(std::string(stored[i]->data(strand, 0, length, data_buffer), length),
+                (strand ? sequences[i]->reverse_complement() : sequences[i]->data()).substr(0, length));
+            if (sequences[i]->has_quality()) {
+                EXPECT_EQ(std::string(stored[i]->quality(strand, 0, length, quality_buffer), length),
+                    (strand ? sequences[i]->reverse_quality() : sequences[i]->quality()).substr(0, length));
+            }
+        }
+        EXPECT_EQ(stored[i]->has_quality(), sequences[i]->has_quality());
+    }
+}
+
+TEST(RaconWindowTest, SubsampleLayers) {
+    std::string backbone(100, 'A'), quality(100, '!');
+    auto window = racon::createWindow(0, 0, racon::WindowType::kTGS, false,
+        backbone.c_str(), backbone.size(), quality.c_str(), quality.size());
+
+    std::string low(100, '#'), medium(50, '5'), high(50, 'I');
+    window->add_layer(backbone.c_str(), 100, low.c_str(), 100, 0, 100, 1);
+    window->add_layer(backbone.c_str(), 50, high.c_str(), 50, 10, 60, 2);
+    window->add_layer(backbone.c_str(), 50, medium.c_str(), 50, 20, 70, 3);
+    window->add_layer(backbone.c_str(), 100, nullptr, 0, 0, 100, 4);
+    window->add_layer(backbone.c_str(), 50, medium.c_str(), 50, 30, 80, 5);
+
+    EXPECT_FALSE(window->subsample_layers(0));
+    EXPECT_FALSE(window->subsample_layers(5));
+    EXPECT_TRUE(window->subsample_layers(3));
+
+    const auto& q_ids = window->q_ids();
+    ASSERT_EQ(q_ids.size(), 4U);
+    EXPECT_EQ(q_ids[1], 1U);
+    EXPECT_EQ(q_ids[2], 2U);
+    EXPECT_EQ(q_ids[3], 4U);
+
+    // given average qualities are used instead of the layer qualities
+    auto indexed_window = racon::createWindow(0, 0, racon::WindowType::kTGS, false,
+        backbone.c_str(), backbone.size(), quality.c_str(), quality.size());
+    indexed_window->add_layer(backbone.c_str(), 50, low.c_str(), 50, 10, 60, 1, 0, 40);
+    indexed_window->add_layer(backbone.c_str(), 50, high.c_str(), 50, 10, 60, 2, 0, 2);
+    EXPECT_TRUE(indexed_window->subsample_layers(1));
+    ASSERT_EQ(indexed_window->q_ids().size(), 2U);
+    EXPECT_EQ(indexed_window->q_ids()[1], 1U);
+}
+
+TEST(RaconWindowTest, PackedLayers) {
+    std::string data, quality;
+    for (uint32_t i = 0; i < 200; ++i) {
+        data += "ACGT"[(i * 7) % 4];
+        quality += static_cast<char>('!' + (i * 37) % 41);
+    }
+    auto plain = racon::createSequence("read", data, quality);
+    auto packed = racon::createSequence("read", data, quality);
+    plain->transmute(true, true, true);
+    packed->transmute(true, true, true, true);
+
+    std::string backbone(100, 'A'), backbone_quality(100, '!');
+    auto window = racon::createWindow(0, 0, racon::WindowType::kTGS, false,
+        backbone.c_str(), backbone.size(), backbone_quality.c_str(),
+        backbone_quality.size());
+    window->add_layer(packed.get(), false, 10, 80, 0, 90, 1);
+    window->add_layer(packed.get(), true, 30, 60, 20, 80, 2);
+
+    std::string data_buffer, quality_buffer;
+    auto forward = window->layer(1, data_buffer, quality_buffer);
+    EXPECT_EQ(std::string(forward.first, 80), plain->data().substr(10, 80));
+    EXPECT_EQ(std::string(forward.second, 80), plain->quality().substr(10, 80));
+    auto reverse = window->layer(2, data_buffer, quality_buffer);
+    EXPECT_EQ(std::string(reverse.first, 60), plain->reverse_complement().substr(30, 60));
+    EXPECT_EQ(std::string(reverse.second, 60), plain->reverse_quality().substr(30, 60));
 }
 
 TEST_F(RaconPolishingTest, ConsensusWithQualities) {
@@ -107,6 +666,305 @@ TEST_F(RaconPolishingTest, ConsensusWithQualities) {
         polished_sequences[1]->data()), 1312);
 }
 
+TEST_F(RaconPolishingTest, ConsensusWithQualitiesOverlappingWindows) {
+    // joins of overlapping windows are stitched by whichever worker finishes
+    // the latter window, the result does not depend on the number of threads
+    std::vector<std::vector<std::unique_ptr<racon::Sequence>>> polished_sequences(2);
+    auto options = createOptions(racon::PolisherType::kC, 500, 0.1, 10, 0.3, 5, -4, -8);
+    for (uint32_t i = 0; i < 2; ++i) {
+        options.num_threads = i == 0 ? 1 : 4;
+        polisher = racon::createPolisher(racon_test_data_path + "sample_reads.fastq.gz",
+            racon_test_data_path + "sample_overlaps.paf.gz", racon_test_data_path +
+            "sample_layout.fasta.gz", options);
+
+        initialize();
+        polish(polished_sequences[i], true);
+        ASSERT_EQ(polished_sequences[i].size(), 1);
+    }
+    EXPECT_EQ(polished_sequences[0][0]->data(), polished_sequences[1][0]->data());
+    EXPECT_EQ(polished_sequences[0][0]->quality(), polished_sequences[1][0]->quality());
+}
+
+TEST_F(RaconPolishingTest, ConsensusWithQualitiesCache) {
+    std::string cache_path = "racon_test_overlaps.cache";
+    std::remove(cache_path.c_str());
+
+    std::vector<std::unique_ptr<racon::Sequence>> polished_sequences;
+    for (uint32_t i = 0; i < 2; ++i) {
+        auto options = createOptions(racon::PolisherType::kC, 500, 0, 10, 0.3,
+            5, -4, -8);
+        options.cache_path = cache_path;
+        polisher = racon::createPolisher(racon_test_data_path + "sample_reads.fastq.gz",
+            racon_test_data_path + "sample_overlaps.paf.gz", racon_test_data_path +
+            "sample_layout.fasta.gz", options);
+
+        initialize();
+        polish(polished_sequences, true);
+        EXPECT_EQ(polished_sequences.size(), i + 1);
+    }
+    std::remove(cache_path.c_str());
+
+    EXPECT_EQ(polished_sequences[0]->data(), polished_sequences[1]->data());
+
+    polished_sequences[0]->create_reverse_complement();
+
+    auto parser = bioparser::createParser<bioparser::FastaParser, racon::Sequence>(
+        racon_test_data_path + "sample_reference.fasta.gz");
+    parser->parse(polished_sequences, -1);
+    EXPECT_EQ(polished_sequences.size(), 3);
+
+    EXPECT_EQ(calculateEditDistance(polished_sequences[0]->reverse_complement(),
+        polished_sequences[2]->data()), 1312);
+}
+
+TEST_F(RaconPolishingTest, ConsensusWithQualitiesSink) {
+    SetUp(racon_test_data_path + "sample_reads.fastq.gz", racon_test_data_path +
+        "sample_overlaps.paf.gz", racon_test_data_path + "sample_layout.fasta.gz",
+        racon::PolisherType::kC, 500, 0, 10, 0.3, 5, -4, -8);
+
+    initialize();
+
+    std::string output_path = "racon_test_consensus.fastq.gz";
+    {
+        auto sink = racon::createSink(output_path, true, 2);
+        polisher->polish(*sink, true);
+    }
+
+    std::vector<std::unique_ptr<racon::Sequence>> polished_sequences;
+    auto parser = bioparser::createParser<bioparser::FastqParser, racon::Sequence>(
+        output_path);
+    parser->parse(polished_sequences, -1);
+    std::remove(output_path.c_str());
+    EXPECT_EQ(polished_sequences.size(), 1);
+    EXPECT_EQ(polished_sequences[0]->quality().size(),
+        polished_sequences[0]->data().size());
+
+    polished_sequences[0]->create_reverse_complement();
+
+    parser = bioparser::createParser<bioparser::FastaParser, racon::Sequence>(
+        racon_test_data_path + "sample_reference.fasta.gz");
+    parser->parse(polished_sequences, -1);
+    EXPECT_EQ(polished_sequences.size(), 2);
+
+    EXPECT_EQ(calculateEditDistance(polished_sequences[0]->reverse_complement(),
+        polished_sequences[1]->data()), 1312);
+}
+
+TEST_F(RaconPolishingTest, ConsensusWithQualitiesStats) {
+    std::string stats_path = "racon_test_stats.json";
+    auto options = createOptions(racon::PolisherType::kC, 500, 0, 10, 0.3, 5, -4, -8);
+    options.stats_path = stats_path;
+    polisher = racon::createPolisher(racon_test_data_path + "sample_reads.fastq.gz",
+        racon_test_data_path + "sample_overlaps.paf.gz", racon_test_data_path +
+        "sample_layout.fasta.gz", options);
+
+    initialize();
+
+    std::vector<std::unique_ptr<racon::Sequence>> polished_sequences;
+    polish(polished_sequences, true);
+    EXPECT_EQ(polished_sequences.size(), 1);
+
+    // stats are written once the polisher is destroyed
+    polisher.reset();
+
+    std::ifstream stats_file(stats_path);
+    std::string stats((std::istreambuf_iterator<char>(stats_file)),
+        std::istreambuf_iterator<char>());
+    stats_file.close();
+    std::remove(stats_path.c_str());
+
+    for (const auto& it: { "\"phases\"", "\"target_load\"", "\"read_load\"",
+        "\"overlap_parse\"", "\"transmute\"", "\"alignment\"",
+        "\"consensus\"", "\"consensus_by_layers\"" }) {
+        EXPECT_NE(stats.find(it), std::string::npos) << it;
+    }
+}
+
+TEST_F(RaconPolishingTest, ConsensusWithQualitiesNuma) {
+    // falls back to unpinned threads on machines with a single node, the
+    // output does not depend on which node polishes which window
+    auto options = createOptions(racon::PolisherType::kC, 500, 0, 10, 0.3, 5, -4, -8);
+    options.numa = true;
+    polisher = racon::createPolisher(racon_test_data_path + "sample_reads.fastq.gz",
+        racon_test_data_path + "sample_overlaps.paf.gz", racon_test_data_path +
+        "sample_layout.fasta.gz", options);
+
+    initialize();
+
+    std::vector<std::unique_ptr<racon::Sequence>> polished_sequences;
+    polish(polished_sequences, true);
+    EXPECT_EQ(polished_sequences.size(), 1);
+
+    polished_sequences[0]->create_reverse_complement();
+
+    auto parser = bioparser::createParser<bioparser::FastaParser, racon::Sequence>(
+        racon_test_data_path + "sample_reference.fasta.gz");
+    parser->parse(polished_sequences, -1);
+    EXPECT_EQ(polished_sequences.size(), 2);
+
+    EXPECT_EQ(calculateEditDistance(polished_sequences[0]->reverse_complement(),
+        polished_sequences[1]->data()), 1312);
+}
+
+TEST_F(RaconPolishingTest, ConsensusWithQualitiesOverlapIndex) {
+    // the index is built over a plain copy of the overlaps
+    std::string overlaps_path = "racon_test_overlaps.paf";
+    std::string targets_path = "racon_test_targets.txt";
+    gzFile src = gzopen((racon_test_data_path + "sample_overlaps.paf.gz").c_str(), "rb");
+    ASSERT_TRUE(src != nullptr);
+    std::ofstream overlaps_file(overlaps_path);
+    char buffer[65536];
+    int32_t length = 0;
+    while ((length = gzread(src, buffer, sizeof(buffer))) > 0) {
+        overlaps_file.write(buffer, length);
+    }
+    gzclose(src);
+    overlaps_file.close();
+
+    std::vector<std::unique_ptr<racon::Sequence>> targets;
+    auto tparser = bioparser::createParser<bioparser::FastaParser, racon::Sequence>(
+        racon_test_data_path + "sample_layout.fasta.gz");
+    tparser->parse(targets, -1);
+    ASSERT_EQ(targets.size(), 1);
+    std::ofstream targets_file(targets_path);
+    targets_file << targets[0]->name() << std::endl;
+    targets_file.close();
+
+    std::vector<std::unique_ptr<racon::Sequence>> polished_sequences;
+    auto options = createOptions(racon::PolisherType::kC, 500, 0, 10, 0.3, 5, -4, -8);
+    options.targets_path = targets_path;
+    options.overlap_index = true;
+    for (uint32_t i = 0; i < 2; ++i) {
+        polisher = racon::createPolisher(racon_test_data_path + "sample_reads.fastq.gz",
+            overlaps_path, racon_test_data_path + "sample_layout.fasta.gz", options);
+
+        // the second run reuses the index of the first one
+        EXPECT_TRUE(std::ifstream(overlaps_path + ".ridx").good());
+
+        initialize();
+        polish(polished_sequences, true);
+    }
+    std::remove(overlaps_path.c_str());
+    std::remove((overlaps_path + ".ridx").c_str());
+    std::remove(targets_path.c_str());
+    EXPECT_EQ(polished_sequences.size(), 2);
+
+    polished_sequences[0]->create_reverse_complement();
+
+    auto parser = bioparser::createParser<bioparser::FastaParser, racon::Sequence>(
+        racon_test_data_path + "sample_reference.fasta.gz");
+    parser->parse(polished_sequences, -1);
+    EXPECT_EQ(polished_sequences.size(), 3);
+
+    EXPECT_EQ(polished_sequences[0]->data(), polished_sequences[1]->data());
+    EXPECT_EQ(calculateEditDistance(polished_sequences[0]->reverse_complement(),
+        polished_sequences[2]->data()), 1312);
+}
+
+TEST_F(RaconPolishingTest, ConsensusWithQualitiesMemory) {
+    std::vector<std::unique_ptr<racon::Sequence>> sequences, targets;
+    std::vector<std::unique_ptr<racon::Overlap>> overlaps;
+    bioparser::createParser<bioparser::FastqParser, racon::Sequence>(
+        racon_test_data_path + "sample_reads.fastq.gz")->parse(sequences, -1);
+    bioparser::createParser<bioparser::PafParser, racon::Overlap>(
+        racon_test_data_path + "sample_overlaps.paf.gz")->parse(overlaps, -1);
+    bioparser::createParser<bioparser::FastaParser, racon::Sequence>(
+        racon_test_data_path + "sample_layout.fasta.gz")->parse(targets, -1);
+
+    polisher = racon::createPolisher(racon::createSource(std::move(sequences)),
+        racon::createSource(std::move(overlaps)), racon::createSource(std::move(targets)),
+        createOptions(racon::PolisherType::kC, 500, 0, 10, 0.3, 5, -4, -8));
+
+    initialize();
+
+    std::vector<std::unique_ptr<racon::Sequence>> polished_sequences;
+    auto sink = racon::createSink([&](std::unique_ptr<racon::Sequence> sequence) -> void {
+        polished_sequences.emplace_back(std::move(sequence));
+    });
+    polisher->polish(*sink, true);
+    EXPECT_EQ(polished_sequences.size(), 1);
+
+    polished_sequences[0]->create_reverse_complement();
+
+    auto parser = bioparser::createParser<bioparser::FastaParser, racon::Sequence>(
+        racon_test_data_path + "sample_reference.fasta.gz");
+    parser->parse(polished_sequences, -1);
+    EXPECT_EQ(polished_sequences.size(), 2);
+
+    EXPECT_EQ(calculateEditDistance(polished_sequences[0]->reverse_complement(),
+        polished_sequences[1]->data()), 1312);
+}
+
+TEST_F(RaconPolishingTest, ConsensusWithQualitiesMemoryStream) {
+    std::vector<std::unique_ptr<racon::Sequence>> sequences, targets;
+    std::vector<std::unique_ptr<racon::Overlap>> overlaps;
+    bioparser::createParser<bioparser::FastqParser, racon::Sequence>(
+        racon_test_data_path + "sample_reads.fastq.gz")->parse(sequences, -1);
+    bioparser::createParser<bioparser::PafParser, racon::Overlap>(
+        racon_test_data_path + "sample_overlaps.paf.gz")->parse(overlaps, -1);
+    bioparser::createParser<bioparser::FastaParser, racon::Sequence>(
+        racon_test_data_path + "sample_layout.fasta.gz")->parse(targets, -1);
+
+    // in-memory overlaps can be parsed only once, they are not scanned
+    auto options = createOptions(racon::PolisherType::kC, 500, 0, 10, 0.3, 5, -4, -8);
+    options.stream = true;
+    polisher = racon::createPolisher(racon::createSource(std::move(sequences)),
+        racon::createSource(std::move(overlaps)), racon::createSource(std::move(targets)),
+        options);
+
+    initialize();
+
+    std::vector<std::unique_ptr<racon::Sequence>> polished_sequences;
+    polish(polished_sequences, true);
+    EXPECT_EQ(polished_sequences.size(), 1);
+
+    polished_sequences[0]->create_reverse_complement();
+
+    auto parser = bioparser::createParser<bioparser::FastaParser, racon::Sequence>(
+        racon_test_data_path + "sample_reference.fasta.gz");
+    parser->parse(polished_sequences, -1);
+    EXPECT_EQ(polished_sequences.size(), 2);
+
+    EXPECT_EQ(calculateEditDistance(polished_sequences[0]->reverse_complement(),
+        polished_sequences[1]->data()), 1312);
+}
+
+TEST_F(RaconPolishingTest, ConsensusMemoryOverlapIds) {
+    std::string target;
+    for (uint32_t i = 0, x = 1; i < 1000; ++i) {
+        x = x * 1103515245 + 12345;
+        target += "ACGT"[(x >> 16) & 3];
+    }
+    std::string reverse_target(target.rbegin(), target.rend());
+    for (auto& it: reverse_target) {
+        it = it == 'A' ? 'T' : it == 'C' ? 'G' : it == 'G' ? 'C' : 'A';
+    }
+
+    // reads on the reverse strand are aligned with edlib, the rest have
+    // their alignments
+    std::vector<std::unique_ptr<racon::Sequence>> sequences;
+    std::vector<std::unique_ptr<racon::Overlap>> overlaps;
+    for (uint32_t i = 0; i < 4; ++i) {
+        sequences.emplace_back(racon::createSequence("read" + std::to_string(i),
+            i % 2 ? reverse_target : target));
+        overlaps.emplace_back(racon::createOverlap(i, 0, 1000, 1000, i % 2, 0,
+            0, 1000, 1000, i % 2 ? "" : "1000M"));
+    }
+    std::vector<std::unique_ptr<racon::Sequence>> targets;
+    targets.emplace_back(racon::createSequence("contig", target));
+
+    polisher = racon::createPolisher(racon::createSource(std::move(sequences)),
+        racon::createSource(std::move(overlaps)), racon::createSource(std::move(targets)),
+        createOptions(racon::PolisherType::kC, 500, 0, 10, 0.3, 5, -4, -8));
+
+    initialize();
+
+    std::vector<std::unique_ptr<racon::Sequence>> polished_sequences;
+    polish(polished_sequences, true);
+    ASSERT_EQ(polished_sequences.size(), 1);
+    EXPECT_EQ(polished_sequences[0]->data(), target);
+}
+
 TEST_F(RaconPolishingTest, ConsensusWithoutQualities) {
     SetUp(racon_test_data_path + "sample_reads.fasta.gz", racon_test_data_path +
         "sample_overlaps.paf.gz", racon_test_data_path + "sample_layout.fasta.gz",
@@ -217,6 +1075,50 @@ TEST_F(RaconPolishingTest, ConsensusWithQualitiesEditDistance) {
         polished_sequences[1]->data()), 1321);
 }
 
+TEST_F(RaconPolishingTest, ConsensusWithQualitiesStream) {
+    SetUp(racon_test_data_path + "sample_reads.fastq.gz", racon_test_data_path +
+        "sample_overlaps.paf.gz", racon_test_data_path + "sample_layout.fasta.gz",
+        racon::PolisherType::kC, 500, 0, 10, 0.3, 5, -4, -8, 0, false, 0, true);
+
+    initialize();
+
+    std::vector<std::unique_ptr<racon::Sequence>> polished_sequences;
+    polish(polished_sequences, true);
+    EXPECT_EQ(polished_sequences.size(), 1);
+
+    polished_sequences[0]->create_reverse_complement();
+
+    auto parser = bioparser::createParser<bioparser::FastaParser, racon::Sequence>(
+        racon_test_data_path + "sample_reference.fasta.gz");
+    parser->parse(polished_sequences, -1);
+    EXPECT_EQ(polished_sequences.size(), 2);
+
+    EXPECT_EQ(calculateEditDistance(polished_sequences[0]->reverse_complement(),
+        polished_sequences[1]->data()), 1312);
+}
+
+TEST_F(RaconPolishingTest, ConsensusWithQualitiesAndAlignmentsStream) {
+    SetUp(racon_test_data_path + "sample_reads.fastq.gz", racon_test_data_path +
+        "sample_overlaps.sam.gz", racon_test_data_path + "sample_layout.fasta.gz",
+        racon::PolisherType::kC, 500, 0, 10, 0.3, 5, -4, -8, 0, false, 0, true);
+
+    initialize();
+
+    std::vector<std::unique_ptr<racon::Sequence>> polished_sequences;
+    polish(polished_sequences, true);
+    EXPECT_EQ(polished_sequences.size(), 1);
+
+    polished_sequences[0]->create_reverse_complement();
+
+    auto parser = bioparser::createParser<bioparser::FastaParser, racon::Sequence>(
+        racon_test_data_path + "sample_reference.fasta.gz");
+    parser->parse(polished_sequences, -1);
+    EXPECT_EQ(polished_sequences.size(), 2);
+
+    EXPECT_EQ(calculateEditDistance(polished_sequences[0]->reverse_complement(),
+        polished_sequences[1]->data()), 1317);
+}
+
 TEST_F(RaconPolishingTest, FragmentCorrectionWithQualities) {
     SetUp(racon_test_data_path + "sample_reads.fastq.gz", racon_test_data_path +
         "sample_ava_overlaps.paf.gz", racon_test_data_path + "sample_reads.fastq.gz",
@@ -235,6 +1137,81 @@ TEST_F(RaconPolishingTest, FragmentCorrectionWithQualities) {
     EXPECT_EQ(total_length, 389394);
 }
 
+TEST_F(RaconPolishingTest, FragmentCorrectionWithQualitiesUnordered) {
+    SetUp(racon_test_data_path + "sample_reads.fastq.gz", racon_test_data_path +
+        "sample_ava_overlaps.paf.gz", racon_test_data_path + "sample_reads.fastq.gz",
+        racon::PolisherType::kC, 500, 0, 10, 0.3, 1, -1, -1);
+
+    initialize();
+
+    std::vector<std::unique_ptr<racon::Sequence>> polished_sequences;
+    polish(polished_sequences, true);
+
+    auto options = createOptions(racon::PolisherType::kC, 500, 0, 10, 0.3, 1, -1, -1);
+    options.unordered_output = true;
+    polisher = racon::createPolisher(racon_test_data_path + "sample_reads.fastq.gz",
+        racon_test_data_path + "sample_ava_overlaps.paf.gz", racon_test_data_path +
+        "sample_reads.fastq.gz", options);
+
+    initialize();
+
+    std::vector<std::unique_ptr<racon::Sequence>> unordered_sequences;
+    polish(unordered_sequences, true);
+
+    // the same sequences, possibly in a different order
+    auto by_name = [](const std::unique_ptr<racon::Sequence>& lhs,
+        const std::unique_ptr<racon::Sequence>& rhs) -> bool {
+        return lhs->name() < rhs->name();
+    };
+    std::sort(polished_sequences.begin(), polished_sequences.end(), by_name);
+    std::sort(unordered_sequences.begin(), unordered_sequences.end(), by_name);
+    ASSERT_EQ(unordered_sequences.size(), polished_sequences.size());
+    for (uint32_t i = 0; i < polished_sequences.size(); ++i) {
+        EXPECT_EQ(unordered_sequences[i]->name(), polished_sequences[i]->name());
+        EXPECT_EQ(unordered_sequences[i]->data(), polished_sequences[i]->data());
+    }
+}
+
+TEST_F(RaconPolishingTest, FragmentCorrectionWithQualitiesShards) {
+    std::vector<std::unique_ptr<racon::Sequence>> polished_sequences;
+    auto options = createOptions(racon::PolisherType::kC, 500, 0, 10, 0.3, 1, -1, -1);
+    options.num_shards = 3;
+    for (uint32_t i = 0; i < 3; ++i) {
+        options.shard = i;
+        polisher = racon::createPolisher(racon_test_data_path + "sample_reads.fastq.gz",
+            racon_test_data_path + "sample_ava_overlaps.paf.gz", racon_test_data_path +
+            "sample_reads.fastq.gz", options);
+
+        initialize();
+        polish(polished_sequences, true);
+    }
+    EXPECT_EQ(polished_sequences.size(), 39);
+
+    uint32_t total_length = 0;
+    for (const auto& it: polished_sequences) {
+        total_length += it->data().size();
+    }
+    EXPECT_EQ(total_length, 389394);
+
+    // concatenated shards are identical to a single run
+    options.shard = 0;
+    options.num_shards = 1;
+    polisher = racon::createPolisher(racon_test_data_path + "sample_reads.fastq.gz",
+        racon_test_data_path + "sample_ava_overlaps.paf.gz", racon_test_data_path +
+        "sample_reads.fastq.gz", options);
+
+    initialize();
+
+    std::vector<std::unique_ptr<racon::Sequence>> single_sequences;
+    polish(single_sequences, true);
+    ASSERT_EQ(single_sequences.size(), polished_sequences.size());
+    for (uint32_t i = 0; i < single_sequences.size(); ++i) {
+        EXPECT_EQ(polished_sequences[i]->name(), single_sequences[i]->name());
+        EXPECT_EQ(polished_sequences[i]->data(), single_sequences[i]->data());
+        EXPECT_EQ(polished_sequences[i]->quality(), single_sequences[i]->quality());
+    }
+}
+
 TEST_F(RaconPolishingTest, FragmentCorrectionWithQualitiesFull) {
     SetUp(racon_test_data_path + "sample_reads.fastq.gz", racon_test_data_path +
         "sample_ava_overlaps.paf.gz", racon_test_data_path + "sample_reads.fastq.gz",